@@ -1,6 +1,11 @@
 /*
  * this file take from grub 2.0
  * for btrfs UEFI driver
+ *
+ * Also used by the ext4 driver for metadata checksums. The table-driven
+ * code processes 8 bytes per step (slicing-by-8); on x86-64 CPUs with
+ * SSE4.2 and on ARMv8 targets built with the CRC extension, the CPU's
+ * crc32c instructions are used instead.
  */
 /*
  *  GRUB  --  GRand Unified Bootloader
@@ -20,61 +25,129 @@
  *  along with GRUB.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-static uint32_t crc32c_table [256];
+/* Castagnoli polynomial 0x1edc6f41, bit-reflected */
+#define CRC32C_POLY_REFLECTED 0x82f63b78
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define CRC32C_HW_X86 1
+#elif defined(__GNUC__) && defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#define CRC32C_HW_ARM 1
+#endif
+
+/* little-endian load that compilers turn into a single, possibly unaligned, read */
+#define CRC32C_LOAD32(p) ((fsw_u32) (p)[0] | ((fsw_u32) (p)[1] << 8) \
+                          | ((fsw_u32) (p)[2] << 16) | ((fsw_u32) (p)[3] << 24))
+
+/* crc32c_table[k][b]: CRC of byte b followed by k zero bytes */
+static fsw_u32 crc32c_table[8][256];
+static int crc32c_table_inited;
+static int crc32c_hw;
+
+#ifdef CRC32C_HW_X86
+static int
+crc32c_have_sse42 (void)
+{
+  fsw_u32 eax = 1, ebx, ecx = 0, edx;
+
+  __asm__ ("cpuid" : "+a" (eax), "=b" (ebx), "+c" (ecx), "=d" (edx));
+  return (ecx >> 20) & 1;
+}
+#endif
 
 static void
 init_crc32c_table (void)
 {
-  auto uint32_t reflect (uint32_t ref, int len);
-  uint32_t reflect (uint32_t ref, int len)
-    {
-      uint32_t result = 0;
-      int i;
+  fsw_u32 crc;
+  int i, j;
 
-      for (i = 1; i <= len; i++)
-        {
-          if (ref & 1)
-            result |= 1 << (len - i);
-          ref >>= 1;
-        }
+  if (crc32c_table_inited)
+    return;
+  crc32c_table_inited = 1;
 
-      return result;
+  for (i = 0; i < 256; i++)
+    {
+      crc = i;
+      for (j = 0; j < 8; j++)
+        crc = (crc >> 1) ^ (crc & 1 ? CRC32C_POLY_REFLECTED : 0);
+      crc32c_table[0][i] = crc;
     }
+  for (i = 0; i < 256; i++)
+    for (j = 1; j < 8; j++)
+      crc32c_table[j][i] = (crc32c_table[j - 1][i] >> 8)
+        ^ crc32c_table[0][crc32c_table[j - 1][i] & 0xFF];
 
-  static int crc32c_table_inited;
-  if(crc32c_table_inited)
-	  return;
-  crc32c_table_inited = 1;
+#if defined(CRC32C_HW_X86)
+  crc32c_hw = crc32c_have_sse42 ();
+#elif defined(CRC32C_HW_ARM)
+  crc32c_hw = 1;
+#endif
+}
 
-  uint32_t polynomial = 0x1edc6f41;
-  int i, j;
+#if defined(CRC32C_HW_X86) || defined(CRC32C_HW_ARM)
+static fsw_u32
+crc32c_update_hw (fsw_u32 crc, const fsw_u8 *data, fsw_u32 size)
+{
+  fsw_u64 crc64 = crc, word;
 
-  for(i = 0; i < 256; i++)
+  for (; size >= 8; size -= 8, data += 8)
     {
-      crc32c_table[i] = reflect(i, 8) << 24;
-      for (j = 0; j < 8; j++)
-        crc32c_table[i] = (crc32c_table[i] << 1) ^
-            (crc32c_table[i] & (1 << 31) ? polynomial : 0);
-      crc32c_table[i] = reflect(crc32c_table[i], 32);
+      word = CRC32C_LOAD32 (data) | ((fsw_u64) CRC32C_LOAD32 (data + 4) << 32);
+#ifdef CRC32C_HW_X86
+      __asm__ ("crc32q %1, %0" : "+r" (crc64) : "rm" (word));
+#else
+      __asm__ ("crc32cx %w0, %w0, %x1" : "+r" (crc64) : "r" (word));
+#endif
     }
+  crc = (fsw_u32) crc64;
+
+  for (; size > 0; size--, data++)
+#ifdef CRC32C_HW_X86
+    __asm__ ("crc32b %1, %0" : "+r" (crc) : "rm" (*data));
+#else
+    __asm__ ("crc32cb %w0, %w0, %w1" : "+r" (crc) : "r" (*data));
+#endif
+
+  return crc;
 }
+#endif
 
-uint32_t
-grub_getcrc32c (uint32_t crc, const void *buf, int size)
+/*
+ * Update a crc32c without the usual pre- and post-inversion, the way the
+ * Linux kernel's crc32c() and ext4 use it. init_crc32c_table must have
+ * been called.
+ */
+static fsw_u32
+crc32c_update (fsw_u32 crc, const void *buf, fsw_u32 size)
 {
-  int i;
-  const uint8_t *data = buf;
+  const fsw_u8 *data = buf;
+  fsw_u32 lo, hi;
 
-  if (! crc32c_table[1])
-    init_crc32c_table ();
+#if defined(CRC32C_HW_X86) || defined(CRC32C_HW_ARM)
+  if (crc32c_hw)
+    return crc32c_update_hw (crc, data, size);
+#endif
 
-  crc^= 0xffffffff;
-
-  for (i = 0; i < size; i++)
+  for (; size >= 8; size -= 8, data += 8)
     {
-      crc = (crc >> 8) ^ crc32c_table[(crc & 0xFF) ^ *data];
-      data++;
+      lo = CRC32C_LOAD32 (data) ^ crc;
+      hi = CRC32C_LOAD32 (data + 4);
+      crc = crc32c_table[7][lo & 0xFF] ^ crc32c_table[6][(lo >> 8) & 0xFF]
+        ^ crc32c_table[5][(lo >> 16) & 0xFF] ^ crc32c_table[4][lo >> 24]
+        ^ crc32c_table[3][hi & 0xFF] ^ crc32c_table[2][(hi >> 8) & 0xFF]
+        ^ crc32c_table[1][(hi >> 16) & 0xFF] ^ crc32c_table[0][hi >> 24];
     }
 
-  return crc ^ 0xffffffff;
+  for (; size > 0; size--, data++)
+    crc = (crc >> 8) ^ crc32c_table[0][(crc ^ *data) & 0xFF];
+
+  return crc;
+}
+
+fsw_u32
+grub_getcrc32c (fsw_u32 crc, const void *buf, int size)
+{
+  if (! crc32c_table_inited)
+    init_crc32c_table ();
+
+  return crc32c_update (crc ^ 0xffffffff, buf, size) ^ 0xffffffff;
 }
@@ -1104,6 +1104,15 @@ begin_direct_read:
                     uint32_t off = paddr & (vol->sectorsize - 1);
                     paddr >>= vol->sectorshift;
                     uint64_t n = 0;
+                    if(cache_level == 0 && off == 0 && csize >= vol->sectorsize) {
+                        /* file data: whole sectors go straight to the caller */
+                        uint32_t nsec = csize >> vol->sectorshift;
+                        err = fsw_block_read_direct(dev, paddr, nsec, buf);
+                        if(err)
+                            continue;
+                        n = (uint64_t)nsec << vol->sectorshift;
+                        paddr += nsec;
+                    }
                     while(n < csize) {
                         char *buffer;
                         err = fsw_block_get(dev, paddr, cache_level, (void **)&buffer);
@@ -1174,10 +1183,12 @@ begin_direct_read:
 			goto io_error;
 		    } else if(rcache->valid) {
 			// hit recovered cache
+                        vol->g.stats.drv_cache_hits++;
                         fsw_memcpy(buf+n, rcache->buffer+off, used_bytes);
 
                     } else {
 			// need recover data
+                        vol->g.stats.drv_cache_misses++;
 			if(!stripe_table) {
 			    // build&rotate(raid6) stripe table
 			    err = fsw_alloc_zero(sizeof(struct stripe_table) * nstripes, (void **)&stripe_table);
@@ -1389,7 +1400,7 @@ static void fsw_btrfs_volume_free(struct fsw_volume *volg)
 	/* The device 0 is closed one layer upper.  */
 	for (i = 1; i < vol->n_devices_attached; i++) {
 	    if(vol->devices_attached[i].dev)
-		fsw_unmount (vol->devices_attached[i].dev);
+		free_dummy_volume (vol->devices_attached[i].dev);
 	}
 	FreePool (vol->devices_attached);
     }
@@ -2087,6 +2098,9 @@ static fsw_status_t fsw_btrfs_dir_read(struct fsw_volume *volg, struct fsw_dnode
         return FSW_NOT_FOUND;
     }
 
+    /* item buffers of the previous entry are no longer needed */
+    fsw_arena_reset (&shand->arena);
+
     err = lower_bound (vol, &key_in, &key_out, tree, &elemaddr, &elemsize, &desc, 0);
     if (err) {
         return err;
@@ -2128,10 +2142,7 @@ static fsw_status_t fsw_btrfs_dir_read(struct fsw_volume *volg, struct fsw_dnode
         if (elemsize > allocated)
         {
             allocated = 2 * elemsize;
-            if(direl)
-                FreePool (direl);
-            direl = AllocatePool (allocated + 1);
-            if (!direl)
+            if (fsw_arena_alloc (&shand->arena, allocated + 1, (void **) &direl))
             {
                 r = -FSW_OUT_OF_MEMORY;
                 break;
@@ -2160,8 +2171,6 @@ static fsw_status_t fsw_btrfs_dir_read(struct fsw_volume *volg, struct fsw_dnode
                     cdirel->key.object_id, cdirel->key.type, cdirel->key.offset, cdirel->type, s.size);
             if(!err) {
                 err = fsw_btrfs_get_sub_dnode(vol, dno, cdirel, &s, child_dno_out);
-                if(direl)
-                    FreePool (direl);
                 free_iterator (&desc);
                 shand->pos = key_out.offset;
                 return FSW_SUCCESS;
@@ -2174,8 +2183,6 @@ static fsw_status_t fsw_btrfs_dir_read(struct fsw_volume *volg, struct fsw_dnode
     while (r > 0);
 
 out:
-    if(direl)
-        FreePool (direl);
     free_iterator (&desc);
 
     r = r < 0 ? -r : FSW_NOT_FOUND;
@@ -38,14 +38,113 @@
  */
 
 #include "fsw_core.h"
-#include "fsw_efi.h"
 
 
 // functions
 
+static struct fsw_blockcache *fsw_blockcache_lookup(struct fsw_volume *vol, fsw_u64 phys_bno);
+static void fsw_blockcache_hash_insert(struct fsw_volume *vol, struct fsw_blockcache *bc);
+static void fsw_blockcache_lru_insert(struct fsw_volume *vol, struct fsw_blockcache *bc);
+static void fsw_blockcache_lru_remove(struct fsw_volume *vol, struct fsw_blockcache *bc);
+static void fsw_blockcache_put_free(struct fsw_volume *vol, struct fsw_blockcache *bc);
+static void fsw_blockcache_trim(struct fsw_volume *vol);
+static struct fsw_blockcache *fsw_blockcache_take(struct fsw_volume *vol);
+static fsw_status_t fsw_blockcache_grow(struct fsw_volume *vol);
 static void fsw_blockcache_free(struct fsw_volume *vol);
+static void fsw_shared_attach(struct fsw_volume *vol);
+static int fsw_shared_read(struct fsw_volume *vol, fsw_u64 phys_bno, void *buffer);
+static void fsw_shared_store(struct fsw_volume *vol, fsw_u64 phys_bno, void *data);
+static fsw_status_t fsw_blockspan_fill(struct fsw_volume *vol, struct fsw_blockspan *span);
+static void fsw_blockspan_trim(struct fsw_volume *vol, fsw_u32 keep);
+static struct fsw_dnode *fsw_dnode_find(struct fsw_volume *vol, fsw_u64 tree_id, fsw_u64 dnode_id);
+static void fsw_dnode_trim(struct fsw_volume *vol);
+static void fsw_dnode_destroy(struct fsw_dnode *dno);
+static void fsw_dentry_free(struct fsw_volume *vol);
+static struct fsw_extent *fsw_extent_map_lookup(struct fsw_dnode *dno, fsw_u64 log_bno);
+static int fsw_extent_continues(struct fsw_volume *vol, struct fsw_extent *a, struct fsw_extent *b);
+static void fsw_extent_map_insert(struct fsw_dnode *dno, struct fsw_extent *extent);
+static void fsw_extent_map_free(struct fsw_dnode *dno, struct fsw_extent *map, fsw_u32 size);
+static fsw_status_t fsw_shandle_get_extent(struct fsw_shandle *shand, fsw_u64 log_bno);
+static fsw_status_t fsw_shandle_readahead(struct fsw_shandle *shand, fsw_u64 pos);
 
-#define MAX_CACHE_LEVEL (5)
+/**
+ * Block cache entries are allocated in chunks, which are chained for freeing. The
+ * entries follow the chunk header in the same allocation.
+ */
+
+struct fsw_blockcache_chunk {
+    struct fsw_blockcache_chunk *next;  //!< Next chunk allocated for this volume
+    fsw_u32     count;                  //!< Number of entries in this chunk
+};
+
+#define FSW_BLOCKCACHE_CHUNK_ENTRIES(chunk) ((struct fsw_blockcache *)((chunk) + 1))
+
+/**
+ * A device known to the shared cache, identified by the key the host's device_key
+ * function reported for it. The key follows the structure in the same allocation.
+ * Devices are kept as long as the driver is loaded, so that volumes mounted later on
+ * the same device find the blocks cached for earlier ones.
+ */
+
+struct fsw_shared_device {
+    struct fsw_shared_device *next; //!< Next known device
+    fsw_u32     id;                 //!< Number of the device, for hashing
+    fsw_u32     key_size;           //!< Size of the key in bytes
+};
+
+#define FSW_SHARED_DEVICE_KEY(dev) ((fsw_u8 *)((dev) + 1))
+
+/**
+ * A block in the shared cache. The shared cache holds copies of metadata blocks across
+ * all volumes and outlives them, so that mounting a device again, or probing it from
+ * another volume, doesn't go to the disk for the same superblocks and tree roots.
+ * The block data follows the structure in the same allocation.
+ */
+
+struct fsw_shared_block {
+    struct fsw_shared_block *hash_next; //!< Next block in the same hash bucket
+    struct fsw_shared_block *lru_prev;  //!< LRU list: more recently used block
+    struct fsw_shared_block *lru_next;  //!< LRU list: less recently used block
+    struct fsw_shared_device *dev;      //!< Device the block was read from
+    fsw_u64     phys_bno;           //!< Physical block number
+    fsw_u32     blocksize;          //!< Block size the block was read with
+};
+
+#define FSW_SHARED_BLOCK_DATA(sb) ((void *)((sb) + 1))
+
+/**
+ * Remembered result of a directory lookup. A successful lookup only records the id of
+ * the child; the entry is used as long as that dnode is still allocated.
+ */
+
+struct fsw_dentry {
+    fsw_u64     parent_tree_id;     //!< Directory the name was looked up in
+    fsw_u64     parent_dnode_id;
+    struct fsw_string name;         //!< Name looked up, in the encoding it was given in
+    fsw_status_t status;            //!< FSW_SUCCESS or FSW_NOT_FOUND
+    fsw_u64     tree_id;            //!< Child found, if status is FSW_SUCCESS
+    fsw_u64     dnode_id;
+};
+
+/** Budget for cached block data across all volumes handled by this driver. */
+static fsw_u32 fsw_bcache_global_budget = FSW_BCACHE_GLOBAL_BUDGET;
+/** Bytes of cached block data across all volumes. */
+static fsw_u32 fsw_bcache_global_bytes;
+/** High-water mark of fsw_bcache_global_bytes. */
+static fsw_u32 fsw_bcache_global_hwm;
+
+/** Devices known to the shared cache. */
+static struct fsw_shared_device *fsw_shared_devices;
+/** Number of devices known to the shared cache. */
+static fsw_u32 fsw_shared_device_count;
+/** Hash table of the blocks in the shared cache, chained. */
+static struct fsw_shared_block *fsw_shared_hash[FSW_SHARED_CACHE_HASH_SIZE];
+/** Blocks in the shared cache, most recently used first. */
+static struct fsw_shared_block *fsw_shared_lru_head;
+/** Least recently used block in the shared cache. */
+static struct fsw_shared_block *fsw_shared_lru_tail;
+/** Bytes of block data in the shared cache. */
+static fsw_u32 fsw_shared_bytes;
 
 /**
  * Mount a volume with a given file system driver. This function is called by the
@@ -82,9 +181,17 @@ fsw_status_t fsw_mount(void *host_data,
     vol->host_table     = host_table;
     vol->fstype_table   = fstype_table;
     vol->host_string_type = host_table->native_string_type;
+    vol->bcache_budget  = FSW_BCACHE_BUDGET;
+    vol->bcache_meta_reserve = FSW_BCACHE_META_RESERVE;
+    vol->dnode_lru_max  = FSW_DNODE_CACHE_SIZE;
+    vol->readahead_max  = FSW_READAHEAD_MAX;
+    fsw_slab_init(&vol->dnode_slab, fstype_table->dnode_struct_size);
+    fsw_slab_init(&vol->extent_slab, sizeof(struct fsw_extent) * FSW_EXTENT_MAP_SLAB);
 
     // let the fs driver mount the file system
+    vol->mounting = 1;
     status = vol->fstype_table->volume_mount(vol);
+    vol->mounting = 0;
     if (status)
         goto errorexit;
 
@@ -112,8 +219,20 @@ void fsw_unmount(struct fsw_volume *vol)
         fsw_dnode_release(vol->root);
     // TODO: check that no other dnodes are still around
 
+    // free the released dnodes kept for reuse
+    vol->dnode_lru_max = 0;
+    fsw_dnode_trim(vol);
+    if (vol->dnode_hash != NULL)
+        fsw_free(vol->dnode_hash);
+    fsw_dentry_free(vol);
+
     vol->fstype_table->volume_free(vol);
 
+    // dnodes still referenced by someone else keep their memory
+    if (vol->dnode_count == 0)
+        fsw_slab_destroy(&vol->dnode_slab);
+    fsw_slab_destroy(&vol->extent_slab);
+    fsw_blockspan_trim(vol, 0);
     fsw_blockcache_free(vol);
     fsw_strfree(&vol->label);
     fsw_free(vol);
@@ -149,7 +268,8 @@ void fsw_set_blocksize(struct fsw_volume *vol, fsw_u32 phys_blocksize, fsw_u32 l
     // TODO: Check the sizes. Both must be powers of 2. log_blocksize must not be smaller than
     //  phys_blocksize.
 
-    // drop core block cache if present
+    // drop core block cache and spans if present
+    fsw_blockspan_trim(vol, 0);
     fsw_blockcache_free(vol);
 
     // signal host driver to drop caches etc.
@@ -161,13 +281,64 @@ void fsw_set_blocksize(struct fsw_volume *vol, fsw_u32 phys_blocksize, fsw_u32 l
     vol->log_blocksize = log_blocksize;
 }
 
+/**
+ * Set the block cache budget of a volume. This function can be called by the host
+ * driver after mounting. The budget limits the bytes of block data kept in the cache;
+ * blocks still referenced by the file system driver may exceed it temporarily.
+ * Unreferenced blocks are purged to stay within the budget, but metadata blocks
+ * (cache level 2 and up) are only purged if they use more than meta_reserve bytes.
+ */
+
+void fsw_set_cache_budget(struct fsw_volume *vol, fsw_u32 budget, fsw_u32 meta_reserve)
+{
+    if (meta_reserve > budget)
+        meta_reserve = budget;
+    vol->bcache_budget = budget;
+    vol->bcache_meta_reserve = meta_reserve;
+    fsw_blockcache_trim(vol);
+}
+
+/**
+ * Set the read-ahead cap of a volume. This function can be called by the host driver
+ * after mounting. When a file is read sequentially in pieces smaller than the current
+ * read-ahead window, the core reads a whole window ahead into a buffer attached to the
+ * shandle. The window starts at FSW_READAHEAD_MIN and doubles with each refill up to
+ * readahead_max bytes. Setting it to zero disables read-ahead.
+ */
+
+void fsw_set_readahead(struct fsw_volume *vol, fsw_u32 readahead_max)
+{
+    vol->readahead_max = readahead_max;
+}
+
+/**
+ * Set the block cache budget shared by all volumes. A volume that finds the total
+ * over budget purges its own unreferenced blocks as if its per-volume budget was hit.
+ */
+
+void fsw_set_global_cache_budget(fsw_u32 budget)
+{
+    fsw_bcache_global_budget = budget;
+}
+
+/**
+ * Get the highest number of bytes of block data that was cached at any one time
+ * across all volumes. The per-volume value is kept in vol->bcache_bytes_hwm.
+ */
+
+fsw_u32 fsw_get_global_cache_hwm(void)
+{
+    return fsw_bcache_global_hwm;
+}
+
 /**
  * Get a block of data from the disk. This function is called by the file system driver
  * or by core functions. It calls through to the host driver's device access routine.
  * Given a physical block number, it reads the block into memory (or fetches it from the
  * block cache) and returns the address of the memory buffer. The caller should provide
  * an indication of how important the block is in the cache_level parameter. Blocks with
- * a low level are purged first. Some suggestions for cache levels:
+ * a low level are purged first; within a level, the least recently released block goes
+ * first. Some suggestions for cache levels:
  *
  *  - 0: File data
  *  - 1: Directory data, symlink data
@@ -181,139 +352,923 @@ void fsw_set_blocksize(struct fsw_volume *vol, fsw_u32 phys_blocksize, fsw_u32 l
 fsw_status_t fsw_block_get(struct VOLSTRUCTNAME *vol, fsw_u64 phys_bno, fsw_u32 cache_level, void **buffer_out)
 {
     fsw_status_t    status;
-    fsw_u32         i, discard_level, new_bcache_size;
-    struct fsw_blockcache *new_bcache;
+    struct fsw_blockcache *bc;
+    fsw_u64         start;
 
     // TODO: allow the host driver to do its own caching; just call through if
     //  the appropriate function pointers are set
 
-    if (cache_level > MAX_CACHE_LEVEL)
-        cache_level = MAX_CACHE_LEVEL;
+    if (cache_level > FSW_MAX_CACHE_LEVEL)
+        cache_level = FSW_MAX_CACHE_LEVEL;
 
     // check block cache
-    for (i = 0; i < vol->bcache_size; i++) {
-        if (vol->bcache[i].phys_bno == phys_bno) {
-            // cache hit!
-            if (vol->bcache[i].cache_level < cache_level)
-                vol->bcache[i].cache_level = cache_level;  // promote the entry
-            vol->bcache[i].refcount++;
-            *buffer_out = vol->bcache[i].data;
+    vol->stats.bcache_lookups++;
+    bc = fsw_blockcache_lookup(vol, phys_bno);
+    if (bc != NULL) {
+        // cache hit!
+        vol->stats.bcache_hits++;
+        if (bc->refcount == 0)
+            fsw_blockcache_lru_remove(vol, bc);
+        if (bc->cache_level < cache_level) {
+            if (bc->cache_level < FSW_META_CACHE_LEVEL && cache_level >= FSW_META_CACHE_LEVEL) {
+                vol->bcache_meta_bytes += vol->phys_blocksize;
+                fsw_shared_store(vol, phys_bno, bc->data);
+            }
+            bc->cache_level = cache_level;  // promote the entry
+        }
+        bc->refcount++;
+        *buffer_out = bc->data;
+        return FSW_SUCCESS;
+    }
+
+    // take a free entry while within the budgets, or discard the least recently used
+    //  unreferenced entry with the lowest cache level, or enlarge the cache
+    bc = fsw_blockcache_take(vol);
+    if (bc == NULL) {
+        status = fsw_blockcache_grow(vol);
+        if (status)
+            return status;
+        bc = fsw_blockcache_take(vol);
+    }
+
+    // read the data
+    if (bc->data == NULL) {
+        status = fsw_alloc(vol->phys_blocksize, &bc->data);
+        if (status) {
+            fsw_blockcache_put_free(vol, bc);
+            return status;
+        }
+        vol->bcache_bytes += vol->phys_blocksize;
+        if (vol->bcache_bytes_hwm < vol->bcache_bytes)
+            vol->bcache_bytes_hwm = vol->bcache_bytes;
+        fsw_bcache_global_bytes += vol->phys_blocksize;
+        if (fsw_bcache_global_hwm < fsw_bcache_global_bytes)
+            fsw_bcache_global_hwm = fsw_bcache_global_bytes;
+    }
+    vol->stats.bcache_misses++;
+    if (!vol->shared_dev_checked)
+        fsw_shared_attach(vol);
+    if (fsw_shared_read(vol, phys_bno, bc->data)) {
+        vol->stats.shared_cache_hits++;
+    } else {
+        start = FSW_TICKS();
+        status = vol->host_table->read_block(vol, phys_bno, bc->data);
+        vol->stats.read_ticks += FSW_TICKS() - start;
+        vol->stats.device_calls++;
+        vol->stats.bytes_read += vol->phys_blocksize;
+        if (status) {
+            fsw_blockcache_put_free(vol, bc);
+            return status;
+        }
+        if (cache_level >= FSW_META_CACHE_LEVEL || vol->mounting)
+            fsw_shared_store(vol, phys_bno, bc->data);
+    }
+
+    bc->phys_bno = phys_bno;
+    bc->cache_level = cache_level;
+    bc->refcount = 1;
+    if (cache_level >= FSW_META_CACHE_LEVEL)
+        vol->bcache_meta_bytes += vol->phys_blocksize;
+    fsw_blockcache_hash_insert(vol, bc);
+    fsw_blockcache_trim(vol);
+    *buffer_out = bc->data;
+    return FSW_SUCCESS;
+}
+
+/**
+ * Releases a disk block. This function must be called to release disk blocks returned
+ * from fsw_block_get.
+ */
+
+void fsw_block_release(struct VOLSTRUCTNAME *vol, fsw_u64 phys_bno, void *buffer)
+{
+    struct fsw_blockcache *bc;
+
+    // TODO: allow the host driver to do its own caching; just call through if
+    //  the appropriate function pointers are set
+
+    // update block cache
+    bc = fsw_blockcache_lookup(vol, phys_bno);
+    if (bc != NULL && bc->refcount > 0) {
+        bc->refcount--;
+        if (bc->refcount == 0) {
+            fsw_blockcache_lru_insert(vol, bc);
+            fsw_blockcache_trim(vol);
+        }
+    }
+}
+
+/**
+ * Pin a run of consecutive disk blocks in one contiguous buffer. This function is
+ * meant for file system drivers that parse on-disk structures larger than a physical
+ * block, e.g. B-tree nodes, in place. The returned pointer stays valid until the
+ * caller hands it (or any pointer into the span) to fsw_block_unpin.
+ *
+ * A single block is pinned straight in the block cache. Longer spans are assembled
+ * from blocks already in the block cache plus direct reads for the rest, and a few
+ * of them are kept after unpinning, so that revisiting a node costs no I/O and no
+ * copy.
+ */
+
+fsw_status_t fsw_block_pin(struct VOLSTRUCTNAME *vol, fsw_u64 phys_bno, fsw_u32 count, fsw_u32 cache_level, void **buffer_out)
+{
+    fsw_status_t    status;
+    struct fsw_blockspan *span, **link;
+
+    if (count == 0)
+        return FSW_UNSUPPORTED;
+
+    // check the spans already in memory
+    for (link = &vol->bspan_head; (span = *link) != NULL; link = &span->next) {
+        if (span->phys_bno == phys_bno && span->count == count) {
+            // move it to the front
+            *link = span->next;
+            span->next = vol->bspan_head;
+            vol->bspan_head = span;
+            if (span->refcount == 0)
+                vol->bspan_unused--;
+            span->refcount++;
+            *buffer_out = span->data;
+            return FSW_SUCCESS;
+        }
+    }
+
+    status = fsw_alloc_zero(sizeof(struct fsw_blockspan), (void **)&span);
+    if (status)
+        return status;
+    span->phys_bno = phys_bno;
+    span->count = count;
+    if (count == 1) {
+        status = fsw_block_get(vol, phys_bno, cache_level, &span->data);
+    } else {
+        status = fsw_alloc(count * vol->phys_blocksize, &span->data);
+        if (status == FSW_SUCCESS) {
+            status = fsw_blockspan_fill(vol, span);
+            if (status)
+                fsw_free(span->data);
+        }
+    }
+    if (status) {
+        fsw_free(span);
+        return status;
+    }
+
+    span->refcount = 1;
+    span->next = vol->bspan_head;
+    vol->bspan_head = span;
+    *buffer_out = span->data;
+    return FSW_SUCCESS;
+}
+
+/**
+ * Unpin a span returned from fsw_block_pin. The buffer may point anywhere into the
+ * span. Returns FSW_NOT_FOUND if the buffer doesn't belong to a pinned span.
+ */
+
+fsw_status_t fsw_block_unpin(struct VOLSTRUCTNAME *vol, void *buffer)
+{
+    struct fsw_blockspan *span, **link;
+    fsw_u8          *data;
+
+    for (link = &vol->bspan_head; (span = *link) != NULL; link = &span->next) {
+        data = (fsw_u8 *)span->data;
+        if (span->refcount == 0 || (fsw_u8 *)buffer < data ||
+            (fsw_u8 *)buffer >= data + span->count * vol->phys_blocksize)
+            continue;
+
+        span->refcount--;
+        if (span->refcount > 0)
             return FSW_SUCCESS;
+        if (span->count == 1) {
+            // the block cache keeps single blocks
+            *link = span->next;
+            fsw_block_release(vol, span->phys_bno, span->data);
+            fsw_free(span);
+        } else {
+            vol->bspan_unused++;
+            if (vol->bspan_unused > FSW_BLOCKSPAN_CACHE_SIZE)
+                fsw_blockspan_trim(vol, FSW_BLOCKSPAN_CACHE_SIZE);
         }
+        return FSW_SUCCESS;
     }
+    return FSW_NOT_FOUND;
+}
+
+/**
+ * Fill the buffer of a new span. Blocks that are in the block cache are copied from
+ * there, runs of the others are read from the disk with one request each. The requests
+ * are submitted before waiting for any, so a host with asynchronous reads can overlap them.
+ */
 
-    // find a free entry in the cache table
-    for (i = 0; i < vol->bcache_size; i++) {
-        if (vol->bcache[i].phys_bno == (fsw_u64)FSW_INVALID_BNO)
+static fsw_status_t fsw_blockspan_fill(struct fsw_volume *vol, struct fsw_blockspan *span)
+{
+    fsw_status_t    status = FSW_SUCCESS, req_status;
+    struct fsw_blockcache *bc;
+    void            *requests[FSW_READ_REQUESTS];
+    fsw_u32         i, run, nreq = 0;
+    fsw_u8          *dest;
+
+    for (i = 0; i < span->count; i += run) {
+        dest = (fsw_u8 *)span->data + i * vol->phys_blocksize;
+        bc = fsw_blockcache_lookup(vol, span->phys_bno + i);
+        if (bc != NULL) {
+            fsw_memcpy(dest, bc->data, vol->phys_blocksize);
+            run = 1;
+            continue;
+        }
+
+        for (run = 1; i + run < span->count; run++) {
+            if (fsw_blockcache_lookup(vol, span->phys_bno + i + run) != NULL)
+                break;
+        }
+        if (nreq == FSW_READ_REQUESTS) {
+            status = fsw_block_read_wait(vol, requests, &nreq);
+            if (status)
+                break;
+        }
+        status = fsw_block_read_submit(vol, span->phys_bno + i, run, dest, &requests[nreq]);
+        if (status)
             break;
+        nreq++;
     }
-    if (i >= vol->bcache_size) {
-        for (discard_level = 0; discard_level <= MAX_CACHE_LEVEL; discard_level++) {
-            for (i = 0; i < vol->bcache_size; i++) {
-                if (vol->bcache[i].refcount == 0 && vol->bcache[i].cache_level <= discard_level)
-                    break;
+
+    req_status = fsw_block_read_wait(vol, requests, &nreq);
+    return status ? status : req_status;
+}
+
+/**
+ * Free unpinned spans beyond the keep most recently used ones.
+ */
+
+static void fsw_blockspan_trim(struct fsw_volume *vol, fsw_u32 keep)
+{
+    struct fsw_blockspan *span, **link;
+    fsw_u32         kept = 0;
+
+    link = &vol->bspan_head;
+    while ((span = *link) != NULL) {
+        if (span->refcount == 0) {
+            if (kept >= keep) {
+                *link = span->next;
+                fsw_free(span->data);
+                fsw_free(span);
+                vol->bspan_unused--;
+                continue;
             }
-            if (i < vol->bcache_size)
+            kept++;
+        }
+        link = &span->next;
+    }
+}
+
+/**
+ * Read a run of consecutive disk blocks straight into a caller's buffer, bypassing the
+ * block cache. This is used for the block-aligned bulk of file reads, which would only
+ * churn the cache and cost an extra copy per block. If the host provides a read_blocks
+ * function, the whole run is handed to it as one request.
+ */
+
+fsw_status_t fsw_block_read_direct(struct fsw_volume *vol, fsw_u64 phys_bno, fsw_u32 count, void *buffer)
+{
+    fsw_status_t    status = FSW_SUCCESS;
+    fsw_u32         i;
+    fsw_u64         start;
+
+    if (count == 0)
+        return FSW_SUCCESS;
+
+    start = FSW_TICKS();
+    if (vol->host_table->read_blocks != NULL) {
+        status = vol->host_table->read_blocks(vol, phys_bno, count, buffer);
+        vol->stats.device_calls++;
+        vol->stats.bytes_read += (fsw_u64)count * vol->phys_blocksize;
+    } else {
+        for (i = 0; i < count; i++) {
+            status = vol->host_table->read_block(vol, phys_bno + i, (fsw_u8 *)buffer + i * vol->phys_blocksize);
+            vol->stats.device_calls++;
+            vol->stats.bytes_read += vol->phys_blocksize;
+            if (status)
                 break;
         }
     }
-    if (i >= vol->bcache_size) {
-        // enlarge / create the cache
-        if (vol->bcache_size < 16)
-            new_bcache_size = 16;
-        else
-            new_bcache_size = vol->bcache_size << 1;
-        status = fsw_alloc(new_bcache_size * sizeof(struct fsw_blockcache), &new_bcache);
-        if (status)
-            return status;
-        if (vol->bcache_size > 0)
-            fsw_memcpy(new_bcache, vol->bcache, vol->bcache_size * sizeof(struct fsw_blockcache));
-        for (i = vol->bcache_size; i < new_bcache_size; i++) {
-            new_bcache[i].refcount = 0;
-            new_bcache[i].cache_level = 0;
-            new_bcache[i].phys_bno = (fsw_u64)FSW_INVALID_BNO;
-            new_bcache[i].data = NULL;
+    vol->stats.read_ticks += FSW_TICKS() - start;
+    return status;
+}
+
+/**
+ * Start reading a run of consecutive disk blocks into a caller's buffer. The buffer must
+ * stay valid until fsw_block_read_complete has reported the request as finished.
+ *
+ * If the host can't read asynchronously, the read is done right here and *request_out
+ * is set to NULL; fsw_block_read_complete accepts that as an already finished request.
+ * On error, no request is left pending.
+ */
+
+fsw_status_t fsw_block_read_submit(struct fsw_volume *vol, fsw_u64 phys_bno, fsw_u32 count, void *buffer,
+                                   void **request_out)
+{
+    fsw_status_t    status;
+    fsw_u64         start;
+
+    *request_out = NULL;
+    if (count > 0 && vol->host_table->read_blocks_submit != NULL && vol->host_table->read_blocks_complete != NULL) {
+        start = FSW_TICKS();
+        status = vol->host_table->read_blocks_submit(vol, phys_bno, count, buffer, request_out);
+        vol->stats.read_ticks += FSW_TICKS() - start;
+        vol->stats.device_calls++;
+        vol->stats.bytes_read += (fsw_u64)count * vol->phys_blocksize;
+        return status;
+    }
+    return fsw_block_read_direct(vol, phys_bno, count, buffer);
+}
+
+/**
+ * Finish a read started with fsw_block_read_submit. With wait set, this blocks until the
+ * data has arrived. Without it, FSW_NOT_READY is returned while the read is still in
+ * progress, and the request stays valid. Any other return value ends the request.
+ */
+
+fsw_status_t fsw_block_read_complete(struct fsw_volume *vol, void *request, int wait)
+{
+    fsw_status_t    status;
+    fsw_u64         start;
+
+    if (request == NULL)
+        return FSW_SUCCESS;
+    start = FSW_TICKS();
+    status = vol->host_table->read_blocks_complete(vol, request, wait);
+    vol->stats.read_ticks += FSW_TICKS() - start;
+    return status;
+}
+
+/**
+ * Wait for a list of reads started with fsw_block_read_submit. All of them are finished
+ * and the list is emptied, even if some fail; the first error is returned.
+ */
+
+fsw_status_t fsw_block_read_wait(struct fsw_volume *vol, void **requests, fsw_u32 *count_inout)
+{
+    fsw_status_t    status = FSW_SUCCESS, req_status;
+    fsw_u32         i;
+
+    for (i = 0; i < *count_inout; i++) {
+        req_status = fsw_block_read_complete(vol, requests[i], 1);
+        if (req_status && !status)
+            status = req_status;
+    }
+    *count_inout = 0;
+    return status;
+}
+
+/**
+ * Compute the home slot of a physical block number in the block cache hash table.
+ */
+
+static fsw_u32 fsw_blockcache_hash(struct fsw_volume *vol, fsw_u64 phys_bno)
+{
+    fsw_u32 h;
+
+    h = (fsw_u32)phys_bno ^ (fsw_u32)FSW_U64_SHR(phys_bno, 32);
+    h *= 0x9E3779B1;    // Fibonacci hashing spreads runs of consecutive block numbers
+    return (h ^ (h >> 16)) & (vol->bcache_hash_size - 1);
+}
+
+/**
+ * Find the valid block cache entry for a physical block number. Returns NULL if the
+ * block is not in the cache.
+ */
+
+static struct fsw_blockcache *fsw_blockcache_lookup(struct fsw_volume *vol, fsw_u64 phys_bno)
+{
+    fsw_u32 i;
+
+    if (vol->bcache_hash == NULL)
+        return NULL;
+    for (i = fsw_blockcache_hash(vol, phys_bno); vol->bcache_hash[i] != NULL;
+         i = (i + 1) & (vol->bcache_hash_size - 1)) {
+        if (vol->bcache_hash[i]->phys_bno == phys_bno)
+            return vol->bcache_hash[i];
+    }
+    return NULL;
+}
+
+/**
+ * Add a valid entry to the hash table. The table is always kept at most half full,
+ * so there is guaranteed to be an empty slot.
+ */
+
+static void fsw_blockcache_hash_insert(struct fsw_volume *vol, struct fsw_blockcache *bc)
+{
+    fsw_u32 i;
+
+    for (i = fsw_blockcache_hash(vol, bc->phys_bno); vol->bcache_hash[i] != NULL;
+         i = (i + 1) & (vol->bcache_hash_size - 1))
+        ;
+    vol->bcache_hash[i] = bc;
+}
+
+/**
+ * Remove an entry from the hash table. Following entries of the same probe run are
+ * shifted back into the hole, so lookups never need tombstones.
+ */
+
+static void fsw_blockcache_hash_remove(struct fsw_volume *vol, struct fsw_blockcache *bc)
+{
+    fsw_u32 mask = vol->bcache_hash_size - 1;
+    fsw_u32 i, j, home;
+
+    for (i = fsw_blockcache_hash(vol, bc->phys_bno); vol->bcache_hash[i] != bc; i = (i + 1) & mask)
+        ;
+    for (j = (i + 1) & mask; vol->bcache_hash[j] != NULL; j = (j + 1) & mask) {
+        home = fsw_blockcache_hash(vol, vol->bcache_hash[j]->phys_bno);
+        // move the entry unless its home slot lies cyclically in (i, j]
+        if ((i <= j) ? (home <= i || home > j) : (home <= i && home > j)) {
+            vol->bcache_hash[i] = vol->bcache_hash[j];
+            i = j;
+        }
+    }
+    vol->bcache_hash[i] = NULL;
+}
+
+/**
+ * Put an unreferenced entry at the head of the LRU list for its cache level.
+ */
+
+static void fsw_blockcache_lru_insert(struct fsw_volume *vol, struct fsw_blockcache *bc)
+{
+    struct fsw_blockcache *head = vol->bcache_lru[bc->cache_level];
+
+    if (head == NULL) {
+        bc->lru_prev = bc->lru_next = bc;
+    } else {
+        bc->lru_next = head;
+        bc->lru_prev = head->lru_prev;
+        head->lru_prev->lru_next = bc;
+        head->lru_prev = bc;
+    }
+    vol->bcache_lru[bc->cache_level] = bc;
+    vol->bcache_lru_count[bc->cache_level]++;
+}
+
+/**
+ * Unlink an entry from the LRU list for its cache level.
+ */
+
+static void fsw_blockcache_lru_remove(struct fsw_volume *vol, struct fsw_blockcache *bc)
+{
+    if (bc->lru_next == bc) {
+        vol->bcache_lru[bc->cache_level] = NULL;
+    } else {
+        bc->lru_prev->lru_next = bc->lru_next;
+        bc->lru_next->lru_prev = bc->lru_prev;
+        if (vol->bcache_lru[bc->cache_level] == bc)
+            vol->bcache_lru[bc->cache_level] = bc->lru_next;
+    }
+    bc->lru_prev = bc->lru_next = NULL;
+    vol->bcache_lru_count[bc->cache_level]--;
+}
+
+/**
+ * Return an entry to the list of unused entries. Its data buffer is freed, so unused
+ * entries never count against the budget.
+ */
+
+static void fsw_blockcache_put_free(struct fsw_volume *vol, struct fsw_blockcache *bc)
+{
+    if (bc->data != NULL) {
+        fsw_free(bc->data);
+        bc->data = NULL;
+        vol->bcache_bytes -= vol->phys_blocksize;
+        fsw_bcache_global_bytes -= vol->phys_blocksize;
+    }
+    bc->phys_bno = (fsw_u64)FSW_INVALID_BNO;
+    bc->refcount = 0;
+    bc->cache_level = 0;
+    bc->lru_next = vol->bcache_free;
+    vol->bcache_free = bc;
+}
+
+/**
+ * Get an entry to load a new block into. While another block fits into the volume and
+ * the global budget, an unused entry is taken, or NULL is returned so that the caller
+ * enlarges the cache. Over budget, the least recently used unreferenced block is
+ * discarded and its buffer reused, starting with the lowest cache level and in the same
+ * order as fsw_blockcache_trim, i.e. never metadata within its reserved quota. If no
+ * block may be discarded, the cache exceeds the budget rather than fail.
+ */
+
+static struct fsw_blockcache *fsw_blockcache_take(struct fsw_volume *vol)
+{
+    struct fsw_blockcache *bc;
+    fsw_u32 discard_level;
+
+    if (vol->bcache_bytes + vol->phys_blocksize > vol->bcache_budget ||
+        fsw_bcache_global_bytes + vol->phys_blocksize > fsw_bcache_global_budget) {
+        for (discard_level = 0; discard_level <= FSW_MAX_CACHE_LEVEL; discard_level++) {
+            if (discard_level >= FSW_META_CACHE_LEVEL && vol->bcache_meta_bytes <= vol->bcache_meta_reserve)
+                break;
+            if (vol->bcache_lru[discard_level] == NULL)
+                continue;
+            bc = vol->bcache_lru[discard_level]->lru_prev;     // tail of the list
+            vol->stats.bcache_evictions[discard_level]++;
+            fsw_blockcache_lru_remove(vol, bc);
+            fsw_blockcache_hash_remove(vol, bc);
+            if (bc->cache_level >= FSW_META_CACHE_LEVEL)
+                vol->bcache_meta_bytes -= vol->phys_blocksize;
+            bc->phys_bno = (fsw_u64)FSW_INVALID_BNO;
+            return bc;    // the data buffer is reused for the new block
+        }
+    }
+
+    bc = vol->bcache_free;
+    if (bc != NULL) {
+        vol->bcache_free = bc->lru_next;
+        bc->lru_next = NULL;
+    }
+    return bc;
+}
+
+/**
+ * Drop an unreferenced block from the cache and free its data buffer.
+ */
+
+static void fsw_blockcache_discard(struct fsw_volume *vol, struct fsw_blockcache *bc)
+{
+    vol->stats.bcache_evictions[bc->cache_level]++;
+    fsw_blockcache_lru_remove(vol, bc);
+    fsw_blockcache_hash_remove(vol, bc);
+    if (bc->cache_level >= FSW_META_CACHE_LEVEL)
+        vol->bcache_meta_bytes -= vol->phys_blocksize;
+    fsw_blockcache_put_free(vol, bc);
+}
+
+/**
+ * Enforce the cache limits after a block was loaded or released. File data is streamed
+ * through a small ring of blocks instead of accumulating. Then unreferenced blocks
+ * are purged in the usual order until the volume and the global budget are met, except
+ * that metadata within its reserved quota is never given up for file or directory data.
+ */
+
+static void fsw_blockcache_trim(struct fsw_volume *vol)
+{
+    struct fsw_blockcache *bc;
+    fsw_u32 level;
+
+    while (vol->bcache_lru_count[0] > FSW_BCACHE_DATA_RING)
+        fsw_blockcache_discard(vol, vol->bcache_lru[0]->lru_prev);
+
+    while (vol->bcache_bytes > vol->bcache_budget || fsw_bcache_global_bytes > fsw_bcache_global_budget) {
+        bc = NULL;
+        for (level = 0; level <= FSW_MAX_CACHE_LEVEL; level++) {
+            if (level >= FSW_META_CACHE_LEVEL && vol->bcache_meta_bytes <= vol->bcache_meta_reserve)
+                break;
+            if (vol->bcache_lru[level] != NULL) {
+                bc = vol->bcache_lru[level]->lru_prev;
+                break;
+            }
+        }
+        if (bc == NULL)
+            break;      // everything left is referenced or within the metadata reserve
+        fsw_blockcache_discard(vol, bc);
+    }
+}
+
+/**
+ * Enlarge the block cache. The number of entries is doubled (starting at 16), the new
+ * entries go to the free list and the hash table is rebuilt at twice the entry count.
+ */
+
+static fsw_status_t fsw_blockcache_grow(struct fsw_volume *vol)
+{
+    fsw_status_t    status;
+    struct fsw_blockcache_chunk *chunk;
+    struct fsw_blockcache **new_hash, **old_hash;
+    fsw_u32         i, count, old_hash_size;
+
+    count = (vol->bcache_size < 16) ? 16 : vol->bcache_size;
+
+    status = fsw_alloc_zero(sizeof(struct fsw_blockcache *) * (vol->bcache_size + count) * 2, (void **)&new_hash);
+    if (status)
+        return status;
+    status = fsw_alloc(sizeof(struct fsw_blockcache_chunk) + count * sizeof(struct fsw_blockcache), &chunk);
+    if (status) {
+        fsw_free(new_hash);
+        return status;
+    }
+    chunk->count = count;
+    chunk->next = vol->bcache_chunks;
+    vol->bcache_chunks = chunk;
+    for (i = 0; i < count; i++) {
+        FSW_BLOCKCACHE_CHUNK_ENTRIES(chunk)[i].data = NULL;
+        fsw_blockcache_put_free(vol, &FSW_BLOCKCACHE_CHUNK_ENTRIES(chunk)[i]);
+    }
+    vol->bcache_size += count;
+
+    // switch hash tables and re-insert all valid entries
+    old_hash = vol->bcache_hash;
+    old_hash_size = vol->bcache_hash_size;
+    vol->bcache_hash = new_hash;
+    vol->bcache_hash_size = vol->bcache_size * 2;
+    for (i = 0; i < old_hash_size; i++) {
+        if (old_hash[i] != NULL)
+            fsw_blockcache_hash_insert(vol, old_hash[i]);
+    }
+    if (old_hash != NULL)
+        fsw_free(old_hash);
+
+    return FSW_SUCCESS;
+}
+
+/**
+ * Release the block cache. Called internally when changing block sizes and when
+ * unmounting the volume. It frees all data occupied by the generic block cache.
+ */
+
+static void fsw_blockcache_free(struct fsw_volume *vol)
+{
+    struct fsw_blockcache_chunk *chunk;
+    fsw_u32 i;
+
+    while ((chunk = vol->bcache_chunks) != NULL) {
+        vol->bcache_chunks = chunk->next;
+        for (i = 0; i < chunk->count; i++) {
+            if (FSW_BLOCKCACHE_CHUNK_ENTRIES(chunk)[i].data != NULL)
+                fsw_free(FSW_BLOCKCACHE_CHUNK_ENTRIES(chunk)[i].data);
+        }
+        fsw_free(chunk);
+    }
+    if (vol->bcache_hash != NULL) {
+        fsw_free(vol->bcache_hash);
+        vol->bcache_hash = NULL;
+    }
+    vol->bcache_hash_size = 0;
+    vol->bcache_size = 0;
+    vol->bcache_free = NULL;
+    for (i = 0; i <= FSW_MAX_CACHE_LEVEL; i++) {
+        vol->bcache_lru[i] = NULL;
+        vol->bcache_lru_count[i] = 0;
+    }
+    fsw_bcache_global_bytes -= vol->bcache_bytes;
+    vol->bcache_bytes = 0;
+    vol->bcache_meta_bytes = 0;
+}
+
+/**
+ * Look up the device of a volume in the shared cache, adding it if it's new. Without
+ * a key from the host, the volume doesn't use the shared cache.
+ */
+
+static void fsw_shared_attach(struct fsw_volume *vol)
+{
+    struct fsw_shared_device *dev;
+    fsw_u8      key[FSW_DEVICE_KEY_MAX];
+    fsw_u32     key_size;
+
+    vol->shared_dev_checked = 1;
+    if (FSW_SHARED_CACHE_BUDGET == 0 || vol->host_table->device_key == NULL)
+        return;
+    key_size = vol->host_table->device_key(vol, key, sizeof(key));
+    if (key_size == 0 || key_size > sizeof(key))
+        return;
+
+    for (dev = fsw_shared_devices; dev != NULL; dev = dev->next) {
+        if (dev->key_size == key_size && fsw_memeq(FSW_SHARED_DEVICE_KEY(dev), key, key_size)) {
+            vol->shared_dev = dev;
+            return;
         }
-        i = vol->bcache_size;
+    }
+    if (fsw_alloc(sizeof(struct fsw_shared_device) + key_size, &dev))
+        return;
+    dev->id = fsw_shared_device_count++;
+    dev->key_size = key_size;
+    fsw_memcpy(FSW_SHARED_DEVICE_KEY(dev), key, key_size);
+    dev->next = fsw_shared_devices;
+    fsw_shared_devices = dev;
+    vol->shared_dev = dev;
+}
+
+/**
+ * Compute the bucket of a block in the shared cache hash table.
+ */
+
+static fsw_u32 fsw_shared_hash_bucket(struct fsw_shared_device *dev, fsw_u64 phys_bno)
+{
+    fsw_u32 h;
+
+    h = (fsw_u32)phys_bno ^ (fsw_u32)FSW_U64_SHR(phys_bno, 32);
+    h ^= dev->id * 0x85EBCA6B;
+    h *= 0x9E3779B1;
+    return (h ^ (h >> 16)) & (FSW_SHARED_CACHE_HASH_SIZE - 1);
+}
+
+/**
+ * Find a block of a volume's device, read at the volume's current block size, in the
+ * shared cache. Returns NULL if it isn't there.
+ */
+
+static struct fsw_shared_block *fsw_shared_lookup(struct fsw_volume *vol, fsw_u64 phys_bno)
+{
+    struct fsw_shared_block *sb;
+
+    for (sb = fsw_shared_hash[fsw_shared_hash_bucket(vol->shared_dev, phys_bno)]; sb != NULL; sb = sb->hash_next) {
+        if (sb->dev == vol->shared_dev && sb->phys_bno == phys_bno && sb->blocksize == vol->phys_blocksize)
+            return sb;
+    }
+    return NULL;
+}
+
+/**
+ * Remove a block from the shared cache LRU list.
+ */
+
+static void fsw_shared_lru_remove(struct fsw_shared_block *sb)
+{
+    if (sb->lru_prev != NULL)
+        sb->lru_prev->lru_next = sb->lru_next;
+    else
+        fsw_shared_lru_head = sb->lru_next;
+    if (sb->lru_next != NULL)
+        sb->lru_next->lru_prev = sb->lru_prev;
+    else
+        fsw_shared_lru_tail = sb->lru_prev;
+}
+
+/**
+ * Put a block at the front of the shared cache LRU list.
+ */
+
+static void fsw_shared_lru_insert(struct fsw_shared_block *sb)
+{
+    sb->lru_prev = NULL;
+    sb->lru_next = fsw_shared_lru_head;
+    if (fsw_shared_lru_head != NULL)
+        fsw_shared_lru_head->lru_prev = sb;
+    else
+        fsw_shared_lru_tail = sb;
+    fsw_shared_lru_head = sb;
+}
+
+/**
+ * Remove a block from the shared cache and free it.
+ */
+
+static void fsw_shared_discard(struct fsw_shared_block *sb)
+{
+    struct fsw_shared_block **link;
+
+    for (link = &fsw_shared_hash[fsw_shared_hash_bucket(sb->dev, sb->phys_bno)]; *link != sb;
+         link = &(*link)->hash_next)
+        ;
+    *link = sb->hash_next;
+    fsw_shared_lru_remove(sb);
+    fsw_shared_bytes -= sb->blocksize;
+    fsw_free(sb);
+}
 
-        // switch caches
-        if (vol->bcache != NULL)
-            fsw_free(vol->bcache);
-        vol->bcache = new_bcache;
-        vol->bcache_size = new_bcache_size;
-    }
-    vol->bcache[i].phys_bno = (fsw_u64)FSW_INVALID_BNO;
+/**
+ * Copy a block from the shared cache into a buffer. Returns 1 if the block was found,
+ * 0 if it has to be read from the disk.
+ */
 
-    // read the data
-    if (vol->bcache[i].data == NULL) {
-        status = fsw_alloc(vol->phys_blocksize, &vol->bcache[i].data);
-        if (status)
-            return status;
-    }
-    status = vol->host_table->read_block(vol, phys_bno, vol->bcache[i].data);
-    if (status)
-        return status;
+static int fsw_shared_read(struct fsw_volume *vol, fsw_u64 phys_bno, void *buffer)
+{
+    struct fsw_shared_block *sb;
+
+    if (vol->shared_dev == NULL)
+        return 0;
+    sb = fsw_shared_lookup(vol, phys_bno);
+    if (sb == NULL)
+        return 0;
+    fsw_memcpy(buffer, FSW_SHARED_BLOCK_DATA(sb), sb->blocksize);
+    fsw_shared_lru_remove(sb);
+    fsw_shared_lru_insert(sb);
+    return 1;
+}
 
-    vol->bcache[i].phys_bno = phys_bno;
-    vol->bcache[i].cache_level = cache_level;
-    vol->bcache[i].refcount = 1;
-    *buffer_out = vol->bcache[i].data;
-    return FSW_SUCCESS;
+/**
+ * Keep a copy of a block just read from the disk in the shared cache. The least
+ * recently used blocks are dropped to stay within FSW_SHARED_CACHE_BUDGET. Failing
+ * to allocate memory is not an error; the block just isn't shared.
+ */
+
+static void fsw_shared_store(struct fsw_volume *vol, fsw_u64 phys_bno, void *data)
+{
+    struct fsw_shared_block *sb;
+    fsw_u32         bucket;
+
+    if (vol->shared_dev == NULL || vol->phys_blocksize > FSW_SHARED_CACHE_BUDGET)
+        return;
+    if (fsw_shared_lookup(vol, phys_bno) != NULL)
+        return;
+    if (fsw_alloc(sizeof(struct fsw_shared_block) + vol->phys_blocksize, &sb))
+        return;
+    sb->dev = vol->shared_dev;
+    sb->phys_bno = phys_bno;
+    sb->blocksize = vol->phys_blocksize;
+    fsw_memcpy(FSW_SHARED_BLOCK_DATA(sb), data, vol->phys_blocksize);
+
+    bucket = fsw_shared_hash_bucket(sb->dev, phys_bno);
+    sb->hash_next = fsw_shared_hash[bucket];
+    fsw_shared_hash[bucket] = sb;
+    fsw_shared_lru_insert(sb);
+    fsw_shared_bytes += sb->blocksize;
+
+    while (fsw_shared_bytes > FSW_SHARED_CACHE_BUDGET)
+        fsw_shared_discard(fsw_shared_lru_tail);
 }
 
 /**
- * Releases a disk block. This function must be called to release disk blocks returned
- * from fsw_block_get.
+ * Drop all blocks from the shared cache. The known devices are kept, since mounted
+ * volumes refer to them.
  */
 
-void fsw_block_release(struct VOLSTRUCTNAME *vol, fsw_u64 phys_bno, void *buffer)
+void fsw_shared_cache_flush(void)
 {
-    fsw_u32 i;
+    while (fsw_shared_lru_head != NULL)
+        fsw_shared_discard(fsw_shared_lru_head);
+}
 
-    // TODO: allow the host driver to do its own caching; just call through if
-    //  the appropriate function pointers are set
+/**
+ * Compute the bucket of a dnode id in the dnode hash table.
+ */
 
-    // update block cache
-    for (i = 0; i < vol->bcache_size; i++) {
-        if (vol->bcache[i].phys_bno == phys_bno && vol->bcache[i].refcount > 0)
-            vol->bcache[i].refcount--;
-    }
+static fsw_u32 fsw_dnode_hash(struct fsw_volume *vol, fsw_u64 tree_id, fsw_u64 dnode_id)
+{
+    fsw_u32 h;
+
+    h = (fsw_u32)dnode_id ^ (fsw_u32)FSW_U64_SHR(dnode_id, 32);
+    h ^= ((fsw_u32)tree_id ^ (fsw_u32)FSW_U64_SHR(tree_id, 32)) * 0x85EBCA6B;
+    h *= 0x9E3779B1;
+    return (h ^ (h >> 16)) & (vol->dnode_hash_size - 1);
 }
 
 /**
- * Release the block cache. Called internally when changing block sizes and when
- * unmounting the volume. It frees all data occupied by the generic block cache.
+ * Find an allocated dnode by id. This includes released dnodes that are kept for
+ * reuse; the caller must retain the dnode it gets. Returns NULL if there is none.
  */
 
-static void fsw_blockcache_free(struct fsw_volume *vol)
+static struct fsw_dnode *fsw_dnode_find(struct fsw_volume *vol, fsw_u64 tree_id, fsw_u64 dnode_id)
 {
-    fsw_u32 i;
+    struct fsw_dnode *dno;
 
-    for (i = 0; i < vol->bcache_size; i++) {
-        if (vol->bcache[i].data != NULL)
-            fsw_free(vol->bcache[i].data);
-    }
-    if (vol->bcache != NULL) {
-        fsw_free(vol->bcache);
-        vol->bcache = NULL;
+    if (vol->dnode_hash == NULL)
+        return NULL;
+    for (dno = vol->dnode_hash[fsw_dnode_hash(vol, tree_id, dnode_id)]; dno; dno = dno->hash_next) {
+        if (dno->dnode_id == dnode_id && dno->tree_id == tree_id)
+            return dno;
     }
-    vol->bcache_size = 0;
-    fsw_efi_clear_cache();
+    return NULL;
 }
 
 /**
  * Add a new dnode to the list of known dnodes. This internal function is used when a
- * dnode is created to add it to the dnode list that is used to search for existing
- * dnodes by id.
+ * dnode is created to add it to the dnode list and to the hash table that is used to
+ * search for existing dnodes by id. The hash table is doubled in size (starting at 64
+ * buckets) when there are more dnodes than buckets.
  */
 
-static void fsw_dnode_register(struct fsw_volume *vol, struct fsw_dnode *dno)
+static fsw_status_t fsw_dnode_register(struct fsw_volume *vol, struct fsw_dnode *dno)
 {
+    fsw_status_t    status;
+    struct fsw_dnode **new_hash, **old_hash, *hdno;
+    fsw_u32         i, h, old_hash_size;
+
+    if (vol->dnode_count >= vol->dnode_hash_size) {
+        old_hash = vol->dnode_hash;
+        old_hash_size = vol->dnode_hash_size;
+        status = fsw_alloc_zero(sizeof(struct fsw_dnode *) * (old_hash_size ? old_hash_size * 2 : 64),
+                                (void **)&new_hash);
+        if (status) {
+            // a full table only makes the chains longer
+            if (old_hash == NULL)
+                return status;
+        } else {
+            vol->dnode_hash = new_hash;
+            vol->dnode_hash_size = old_hash_size ? old_hash_size * 2 : 64;
+            for (i = 0; i < old_hash_size; i++) {
+                while ((hdno = old_hash[i]) != NULL) {
+                    old_hash[i] = hdno->hash_next;
+                    h = fsw_dnode_hash(vol, hdno->tree_id, hdno->dnode_id);
+                    hdno->hash_next = vol->dnode_hash[h];
+                    vol->dnode_hash[h] = hdno;
+                }
+            }
+            if (old_hash != NULL)
+                fsw_free(old_hash);
+        }
+    }
+
+    h = fsw_dnode_hash(vol, dno->tree_id, dno->dnode_id);
+    dno->hash_next = vol->dnode_hash[h];
+    vol->dnode_hash[h] = dno;
+    vol->dnode_count++;
+
     dno->next = vol->dnode_head;
     if (vol->dnode_head != NULL)
         vol->dnode_head->prev = dno;
     dno->prev = NULL;
     vol->dnode_head = dno;
+    return FSW_SUCCESS;
 }
 
 /**
@@ -329,7 +1284,7 @@ fsw_status_t fsw_dnode_create_root_with_tree(struct fsw_volume *vol, fsw_u64 tre
     struct fsw_dnode *dno;
 
     // allocate memory for the structure
-    status = fsw_alloc_zero(vol->fstype_table->dnode_struct_size, (void **)&dno);
+    status = fsw_slab_alloc(&vol->dnode_slab, (void **)&dno);
     if (status)
         return status;
 
@@ -343,7 +1298,11 @@ fsw_status_t fsw_dnode_create_root_with_tree(struct fsw_volume *vol, fsw_u64 tre
     dno->name.type = FSW_STRING_TYPE_EMPTY;
     // TODO: instead, call a function to create an empty string in the native string type
 
-    fsw_dnode_register(vol, dno);
+    status = fsw_dnode_register(vol, dno);
+    if (status) {
+        fsw_slab_free(&vol->dnode_slab, dno);
+        return status;
+    }
 
     *dno_out = dno;
     return FSW_SUCCESS;
@@ -379,16 +1338,15 @@ fsw_status_t fsw_dnode_create_with_tree(struct fsw_dnode *parent_dno, fsw_u64 tr
     struct fsw_dnode *dno;
 
     // check if we already have a dnode with the same id
-    for (dno = vol->dnode_head; dno; dno = dno->next) {
-        if (dno->dnode_id == dnode_id && dno->tree_id == tree_id) {
-            fsw_dnode_retain(dno);
-            *dno_out = dno;
-            return FSW_SUCCESS;
-        }
+    dno = fsw_dnode_find(vol, tree_id, dnode_id);
+    if (dno != NULL) {
+        fsw_dnode_retain(dno);
+        *dno_out = dno;
+        return FSW_SUCCESS;
     }
 
     // allocate memory for the structure
-    status = fsw_alloc_zero(vol->fstype_table->dnode_struct_size, (void **)&dno);
+    status = fsw_slab_alloc(&vol->dnode_slab, (void **)&dno);
     if (status)
         return status;
 
@@ -402,11 +1360,18 @@ fsw_status_t fsw_dnode_create_with_tree(struct fsw_dnode *parent_dno, fsw_u64 tr
     dno->refcount = 1;
     status = fsw_strdup_coerce(&dno->name, vol->host_table->native_string_type, name);
     if (status) {
-        fsw_free(dno);
+        fsw_dnode_release(dno->parent);
+        fsw_slab_free(&vol->dnode_slab, dno);
         return status;
     }
 
-    fsw_dnode_register(vol, dno);
+    status = fsw_dnode_register(vol, dno);
+    if (status) {
+        fsw_strfree(&dno->name);
+        fsw_dnode_release(dno->parent);
+        fsw_slab_free(&vol->dnode_slab, dno);
+        return status;
+    }
 
     *dno_out = dno;
     return FSW_SUCCESS;
@@ -426,46 +1391,113 @@ fsw_status_t fsw_dnode_create(struct fsw_dnode *parent_dno, fsw_u64 dnode_id, in
 
 void fsw_dnode_retain(struct fsw_dnode *dno)
 {
+    struct fsw_volume *vol = dno->vol;
+
+    if (dno->refcount == 0) {
+        // take it off the list of released dnodes
+        if (dno->lru_next == dno) {
+            vol->dnode_lru = NULL;
+        } else {
+            dno->lru_prev->lru_next = dno->lru_next;
+            dno->lru_next->lru_prev = dno->lru_prev;
+            if (vol->dnode_lru == dno)
+                vol->dnode_lru = dno->lru_next;
+        }
+        vol->dnode_lru_count--;
+    }
     dno->refcount++;
 }
 
 /**
- * Release a dnode pointer, deallocating it if this was the last reference.
- * This function decrements the reference counter of the dnode. If the counter
- * reaches zero, the dnode is freed. Since the parent dnode is released
- * during that process, this function may cause it to be freed, too.
+ * Release a dnode pointer. This function decrements the reference counter of the
+ * dnode. If the counter reaches zero, the dnode is kept for reuse, so that another
+ * lookup of the same object finds it with its information already filled in. Only
+ * the least recently released dnodes beyond the volume's limit are actually freed.
+ * Since the parent dnode is released during that process, this function may cause
+ * it to be freed, too.
  */
 
 void fsw_dnode_release(struct fsw_dnode *dno)
 {
     struct fsw_volume *vol = dno->vol;
-    struct fsw_dnode *parent_dno;
+    struct fsw_dnode *head;
 
     dno->refcount--;
 
     if (dno->refcount == 0) {
-        parent_dno = dno->parent;
+        // put it at the head of the list of released dnodes
+        head = vol->dnode_lru;
+        if (head == NULL) {
+            dno->lru_prev = dno->lru_next = dno;
+        } else {
+            dno->lru_next = head;
+            dno->lru_prev = head->lru_prev;
+            head->lru_prev->lru_next = dno;
+            head->lru_prev = dno;
+        }
+        vol->dnode_lru = dno;
+        vol->dnode_lru_count++;
 
-        // de-register from volume's list
-        if (dno->next)
-            dno->next->prev = dno->prev;
-        if (dno->prev)
-            dno->prev->next = dno->next;
-        if (vol->dnode_head == dno)
-            vol->dnode_head = dno->next;
+        fsw_dnode_trim(vol);
+    }
+}
 
-        // run fstype-specific cleanup
-        vol->fstype_table->dnode_free(vol, dno);
+/**
+ * Free released dnodes until no more than the volume's limit are kept. The least
+ * recently released ones go first.
+ */
 
-        fsw_strfree(&dno->name);
-        fsw_free(dno);
+static void fsw_dnode_trim(struct fsw_volume *vol)
+{
+    struct fsw_dnode *dno;
 
-        // release our pointer to the parent, possibly deallocating it, too
-        if (parent_dno)
-            fsw_dnode_release(parent_dno);
+    while (vol->dnode_lru_count > vol->dnode_lru_max) {
+        // the tail of the list; retaining takes it off the list
+        dno = vol->dnode_lru->lru_prev;
+        fsw_dnode_retain(dno);
+        fsw_dnode_destroy(dno);
     }
 }
 
+/**
+ * Deallocate a dnode that is not on the list of released dnodes. This function
+ * removes the dnode from the volume's list and hash table, and releases the parent
+ * dnode.
+ */
+
+static void fsw_dnode_destroy(struct fsw_dnode *dno)
+{
+    struct fsw_volume *vol = dno->vol;
+    struct fsw_dnode *parent_dno = dno->parent;
+    struct fsw_dnode **link;
+
+    // de-register from volume's list
+    if (dno->next)
+        dno->next->prev = dno->prev;
+    if (dno->prev)
+        dno->prev->next = dno->next;
+    if (vol->dnode_head == dno)
+        vol->dnode_head = dno->next;
+
+    // and from the hash table
+    for (link = &vol->dnode_hash[fsw_dnode_hash(vol, dno->tree_id, dno->dnode_id)]; *link != dno;
+         link = &(*link)->hash_next)
+        ;
+    *link = dno->hash_next;
+    vol->dnode_count--;
+
+    // run fstype-specific cleanup
+    vol->fstype_table->dnode_free(vol, dno);
+
+    fsw_extent_map_free(dno, dno->extent_map, dno->extent_map_size);
+    fsw_strfree(&dno->name);
+    fsw_slab_free(&vol->dnode_slab, dno);
+
+    // release our pointer to the parent, possibly deallocating it, too
+    if (parent_dno)
+        fsw_dnode_release(parent_dno);
+}
+
 /**
  * Get full information about a dnode from disk. This function is called by the host
  * driver as well as by the core functions. Some file systems defer reading full
@@ -509,6 +1541,97 @@ fsw_status_t fsw_dnode_stat(struct fsw_dnode *dno, struct fsw_dnode_stat *sb)
     return status;
 }
 
+/**
+ * Compute the slot of a directory lookup in the volume's lookup cache.
+ */
+
+static fsw_u32 fsw_dentry_hash(struct fsw_dnode *dno, struct fsw_string *name)
+{
+    fsw_u32 h = 2166136261U;
+    fsw_u8  *p = (fsw_u8 *)name->data;
+    int     i;
+
+    for (i = 0; i < name->size; i++)
+        h = (h ^ p[i]) * 16777619;
+    h ^= (fsw_u32)dno->dnode_id ^ (fsw_u32)FSW_U64_SHR(dno->dnode_id, 32);
+    h ^= ((fsw_u32)dno->tree_id ^ (fsw_u32)FSW_U64_SHR(dno->tree_id, 32)) * 0x85EBCA6B;
+    h *= 0x9E3779B1;
+    return (h ^ (h >> 16)) & (FSW_DENTRY_CACHE_SIZE - 1);
+}
+
+/**
+ * Look up a name in a directory, using the volume's cache of earlier lookups before
+ * asking the file system driver. The cache remembers both names that were found and
+ * names that were not found. Names are compared byte for byte in the encoding they
+ * were given in, so a cached answer is only ever one the driver gave for the same
+ * string. The caller must make sure that dno is a directory.
+ */
+
+static fsw_status_t fsw_dnode_lookup_cached(struct fsw_dnode *dno,
+                                            struct fsw_string *lookup_name, struct fsw_dnode **child_dno_out)
+{
+    fsw_status_t    status;
+    struct fsw_volume *vol = dno->vol;
+    struct fsw_dentry *de = NULL;
+    struct fsw_dnode *child_dno;
+
+    if (fsw_strlen(lookup_name) == 0)
+        return vol->fstype_table->dir_lookup(vol, dno, lookup_name, child_dno_out);
+
+    if (vol->dentry_cache == NULL)
+        fsw_alloc_zero(sizeof(struct fsw_dentry) * FSW_DENTRY_CACHE_SIZE, (void **)&vol->dentry_cache);
+    if (vol->dentry_cache != NULL) {
+        de = &vol->dentry_cache[fsw_dentry_hash(dno, lookup_name)];
+        if (de->name.type == lookup_name->type && de->name.size == lookup_name->size &&
+            de->parent_dnode_id == dno->dnode_id && de->parent_tree_id == dno->tree_id &&
+            fsw_memeq(de->name.data, lookup_name->data, lookup_name->size)) {
+            if (de->status == FSW_NOT_FOUND)
+                return FSW_NOT_FOUND;
+            child_dno = fsw_dnode_find(vol, de->tree_id, de->dnode_id);
+            if (child_dno != NULL) {
+                fsw_dnode_retain(child_dno);
+                *child_dno_out = child_dno;
+                return FSW_SUCCESS;
+            }
+        }
+    }
+
+    status = vol->fstype_table->dir_lookup(vol, dno, lookup_name, child_dno_out);
+
+    // remember definite answers
+    if (de != NULL && (status == FSW_SUCCESS || status == FSW_NOT_FOUND)) {
+        fsw_strfree(&de->name);
+        if (fsw_strdup_coerce(&de->name, lookup_name->type, lookup_name) == FSW_SUCCESS) {
+            de->parent_tree_id = dno->tree_id;
+            de->parent_dnode_id = dno->dnode_id;
+            de->status = status;
+            if (status == FSW_SUCCESS) {
+                de->tree_id = (*child_dno_out)->tree_id;
+                de->dnode_id = (*child_dno_out)->dnode_id;
+            }
+        } else {
+            de->name.type = FSW_STRING_TYPE_EMPTY;
+        }
+    }
+    return status;
+}
+
+/**
+ * Free the volume's cache of directory lookups.
+ */
+
+static void fsw_dentry_free(struct fsw_volume *vol)
+{
+    fsw_u32 i;
+
+    if (vol->dentry_cache == NULL)
+        return;
+    for (i = 0; i < FSW_DENTRY_CACHE_SIZE; i++)
+        fsw_strfree(&vol->dentry_cache[i].name);
+    fsw_free(vol->dentry_cache);
+    vol->dentry_cache = NULL;
+}
+
 /**
  * Lookup a directory entry by name. This function is called by the host driver.
  * Given a directory dnode and a file name, it looks up the named entry in the
@@ -532,7 +1655,7 @@ fsw_status_t fsw_dnode_lookup(struct fsw_dnode *dno,
     if (dno->type != FSW_DNODE_TYPE_DIR)
         return FSW_UNSUPPORTED;
 
-    return dno->vol->fstype_table->dir_lookup(dno->vol, dno, lookup_name, child_dno_out);
+    return fsw_dnode_lookup_cached(dno, lookup_name, child_dno_out);
 }
 
 /**
@@ -624,7 +1747,7 @@ fsw_status_t fsw_dnode_lookup_path(struct fsw_dnode *dno,
 
             } else {
                 // do an actual lookup
-                status = vol->fstype_table->dir_lookup(vol, dno, &lookup_name, &child_dno);
+                status = fsw_dnode_lookup_cached(dno, &lookup_name, &child_dno);
                 if (status)
                     goto errorexit;
             }
@@ -835,6 +1958,13 @@ fsw_status_t fsw_shandle_open(struct fsw_dnode *dno, struct fsw_shandle *shand)
     shand->dnode = dno;
     shand->pos = 0;
     shand->extent.type = FSW_EXTENT_TYPE_INVALID;
+    shand->ra_next = 0;
+    shand->ra_window = 0;
+    shand->ra_size = 0;
+    shand->ra_buffer = NULL;
+    shand->ra_start = 0;
+    shand->ra_len = 0;
+    fsw_memzero(&shand->arena, sizeof(struct fsw_arena));
 
     return FSW_SUCCESS;
 }
@@ -850,23 +1980,338 @@ void fsw_shandle_close(struct fsw_shandle *shand)
 {
     if (shand->extent.type == FSW_EXTENT_TYPE_BUFFER)
         fsw_free(shand->extent.buffer);
+    if (shand->ra_buffer != NULL)
+        fsw_free(shand->ra_buffer);
+    fsw_arena_free(&shand->arena);
     fsw_dnode_release(shand->dnode);
 }
 
+/**
+ * Find the remembered extent of a dnode that covers a logical block. The map is searched
+ * for the last extent starting at or before the block. Returns NULL if that one does
+ * not cover the block.
+ */
+
+static struct fsw_extent *fsw_extent_map_lookup(struct fsw_dnode *dno, fsw_u64 log_bno)
+{
+    fsw_u32 lo, hi, mid;
+    struct fsw_extent *extent;
+
+    // binary search for the first extent starting after log_bno
+    lo = 0;
+    hi = dno->extent_map_count;
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (dno->extent_map[mid].log_start <= log_bno)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo == 0)
+        return NULL;
+    extent = &dno->extent_map[lo - 1];
+    if (log_bno >= extent->log_start + extent->log_count)
+        return NULL;
+    return extent;
+}
+
+/**
+ * Free the storage of a dnode's extent map. Maps of the smallest size come from
+ * the volume's extent slab, larger ones directly from the host.
+ */
+
+static void fsw_extent_map_free(struct fsw_dnode *dno, struct fsw_extent *map, fsw_u32 size)
+{
+    if (map == NULL)
+        return;
+    if (size == FSW_EXTENT_MAP_SLAB)
+        fsw_slab_free(&dno->vol->extent_slab, map);
+    else
+        fsw_free(map);
+}
+
+/**
+ * Check whether extent b directly continues extent a, both logically and on disk.
+ */
+
+static int fsw_extent_continues(struct fsw_volume *vol, struct fsw_extent *a, struct fsw_extent *b)
+{
+    if (a->type != b->type || a->log_start + a->log_count != b->log_start ||
+        a->log_count + b->log_count < a->log_count)
+        return 0;
+    if (a->type == FSW_EXTENT_TYPE_SPARSE)
+        return 1;
+    return a->phys_start + (fsw_u64)a->log_count * (vol->log_blocksize / vol->phys_blocksize) == b->phys_start;
+}
+
+/**
+ * Remember an extent returned by the file system driver. Only physical and sparse
+ * extents are kept; buffer extents own memory that belongs to the shandle. The map is
+ * kept sorted by logical start block, and extents that continue each other are merged,
+ * so drivers that return short extents (e.g. one block at a time) still end up with a
+ * compact map. It stops growing at FSW_EXTENT_MAP_MAX entries.
+ */
+
+static void fsw_extent_map_insert(struct fsw_dnode *dno, struct fsw_extent *extent)
+{
+    struct fsw_volume *vol = dno->vol;
+    struct fsw_extent *map;
+    fsw_u32 i, j, new_size;
+    struct fsw_extent *new_map;
+
+    if ((extent->type != FSW_EXTENT_TYPE_PHYSBLOCK && extent->type != FSW_EXTENT_TYPE_SPARSE) ||
+        extent->log_count == 0)
+        return;
+
+    // find the insertion point; an extent with the same start is replaced if shorter
+    for (i = dno->extent_map_count; i > 0 && dno->extent_map[i - 1].log_start > extent->log_start; i--)
+        ;
+    map = dno->extent_map;
+    if (i > 0 && map[i - 1].log_start == extent->log_start) {
+        if (map[i - 1].log_count < extent->log_count) {
+            map[i - 1] = *extent;
+            map[i - 1].buffer = NULL;
+        }
+        return;
+    }
+
+    // merge with the neighbours if possible
+    if (i > 0 && fsw_extent_continues(vol, &map[i - 1], extent)) {
+        map[i - 1].log_count += extent->log_count;
+        if (i < dno->extent_map_count && fsw_extent_continues(vol, &map[i - 1], &map[i])) {
+            map[i - 1].log_count += map[i].log_count;
+            for (j = i + 1; j < dno->extent_map_count; j++)
+                map[j - 1] = map[j];
+            dno->extent_map_count--;
+        }
+        return;
+    }
+    if (i < dno->extent_map_count && fsw_extent_continues(vol, extent, &map[i])) {
+        map[i].log_start = extent->log_start;
+        map[i].phys_start = extent->phys_start;
+        map[i].log_count += extent->log_count;
+        return;
+    }
+
+    if (dno->extent_map_count == dno->extent_map_size) {
+        if (dno->extent_map_size >= FSW_EXTENT_MAP_MAX)
+            return;
+        new_size = dno->extent_map_size ? dno->extent_map_size * 2 : FSW_EXTENT_MAP_SLAB;
+        if (new_size == FSW_EXTENT_MAP_SLAB) {
+            if (fsw_slab_alloc(&vol->extent_slab, (void **)&new_map))
+                return;
+        } else if (fsw_alloc(sizeof(struct fsw_extent) * new_size, &new_map))
+            return;
+        if (dno->extent_map != NULL) {
+            fsw_memcpy(new_map, dno->extent_map, sizeof(struct fsw_extent) * dno->extent_map_count);
+            fsw_extent_map_free(dno, dno->extent_map, dno->extent_map_size);
+        }
+        dno->extent_map = new_map;
+        dno->extent_map_size = new_size;
+    }
+
+    for (j = dno->extent_map_count; j > i; j--)
+        dno->extent_map[j] = dno->extent_map[j - 1];
+    dno->extent_map[i] = *extent;
+    dno->extent_map[i].buffer = NULL;
+    dno->extent_map_count++;
+}
+
+/**
+ * Make sure the shandle's current extent covers a logical block. Extents the file
+ * system driver returned before for the same dnode are reused from the dnode's extent
+ * map, which is shared by all shandles on the dnode; otherwise the driver is asked for
+ * a new extent, and the result is added to the map.
+ */
+
+static fsw_status_t fsw_shandle_get_extent(struct fsw_shandle *shand, fsw_u64 log_bno)
+{
+    fsw_status_t    status;
+    struct fsw_dnode *dno = shand->dnode;
+    struct fsw_volume *vol = dno->vol;
+    struct fsw_extent *extent;
+
+    if (shand->extent.type != FSW_EXTENT_TYPE_INVALID &&
+        log_bno >= shand->extent.log_start &&
+        log_bno < shand->extent.log_start + shand->extent.log_count)
+        return FSW_SUCCESS;
+
+    if (shand->extent.type == FSW_EXTENT_TYPE_BUFFER)
+        fsw_free(shand->extent.buffer);
+
+    extent = fsw_extent_map_lookup(dno, log_bno);
+    if (extent != NULL) {
+        shand->extent = *extent;
+        return FSW_SUCCESS;
+    }
+
+    // ask the file system for the proper extent
+    shand->extent.log_start = log_bno;
+    status = vol->fstype_table->get_extent(vol, dno, &shand->extent);
+    if (status) {
+        shand->extent.type = FSW_EXTENT_TYPE_INVALID;
+        return status;
+    }
+    fsw_extent_map_insert(dno, &shand->extent);
+    return FSW_SUCCESS;
+}
+
+/**
+ * Map all extents of a range of a shandle's data ahead of a large read. The file system
+ * driver is asked for each extent in turn and the results go into the dnode's extent
+ * map, where extents that continue each other on disk are merged. The read that
+ * follows then finds the merged extents and reads each of them with a single device
+ * request, instead of one request per extent as returned by the driver.
+ *
+ * Mapping stops early, without an error, at a buffer extent (inline data) or when the
+ * extent map is full; the rest of the range is then mapped by the read as usual.
+ */
+
+fsw_status_t fsw_shandle_map(struct fsw_shandle *shand, fsw_u64 pos, fsw_u64 len)
+{
+    fsw_status_t    status;
+    struct fsw_dnode *dno = shand->dnode;
+    struct fsw_volume *vol = dno->vol;
+    struct fsw_extent *known, extent;
+    fsw_u64         log_bno, log_end;
+
+    if (pos >= dno->size || len == 0)
+        return FSW_SUCCESS;
+    if (len > dno->size - pos)
+        len = dno->size - pos;
+    log_bno = FSW_U64_DIV(pos, vol->log_blocksize);
+    log_end = FSW_U64_DIV(pos + len - 1, vol->log_blocksize) + 1;
+
+    while (log_bno < log_end) {
+        known = fsw_extent_map_lookup(dno, log_bno);
+        if (known != NULL) {
+            log_bno = known->log_start + known->log_count;
+            continue;
+        }
+
+        extent.type = FSW_EXTENT_TYPE_INVALID;
+        extent.log_start = log_bno;
+        extent.buffer = NULL;
+        status = vol->fstype_table->get_extent(vol, dno, &extent);
+        if (status)
+            return status;
+        if (extent.type == FSW_EXTENT_TYPE_BUFFER) {
+            fsw_free(extent.buffer);
+            break;
+        }
+        fsw_extent_map_insert(dno, &extent);
+        if (fsw_extent_map_lookup(dno, log_bno) == NULL)
+            break;      // map is full
+    }
+
+    return FSW_SUCCESS;
+}
+
+/**
+ * Fill the shandle's read-ahead buffer with file data, starting at the logical block
+ * that contains pos. The amount is the current read-ahead window, limited by the
+ * buffer size and the end of the file. The window may span several extents; the disk
+ * reads for them are all submitted before waiting for any, so a host with asynchronous
+ * reads can overlap them.
+ */
+
+static fsw_status_t fsw_shandle_readahead(struct fsw_shandle *shand, fsw_u64 pos)
+{
+    fsw_status_t    status = FSW_SUCCESS, req_status;
+    struct fsw_dnode *dno = shand->dnode;
+    struct fsw_volume *vol = dno->vol;
+    void            *requests[FSW_READ_REQUESTS];
+    fsw_u32         nreq = 0;
+    fsw_u64         start, end, fill_pos, pos_in_extent, copylen, len;
+    fsw_u8          *dest;
+
+    if (shand->ra_buffer == NULL) {
+        shand->ra_size = vol->readahead_max - (vol->readahead_max & (vol->log_blocksize - 1));
+        status = fsw_alloc(shand->ra_size, &shand->ra_buffer);
+        if (status)
+            return status;
+    }
+    shand->ra_len = 0;
+
+    // whole logical blocks, as many as the window and the buffer allow
+    len = shand->ra_window;
+    if (len > shand->ra_size)
+        len = shand->ra_size;
+    len -= len & (vol->log_blocksize - 1);
+    if (len < vol->log_blocksize)
+        len = vol->log_blocksize;
+    start = pos - (pos & (vol->log_blocksize - 1));
+    end = start + len;
+    if (end > dno->size)
+        end = dno->size + ((vol->log_blocksize - (dno->size & (vol->log_blocksize - 1))) & (vol->log_blocksize - 1));
+
+    for (fill_pos = start; fill_pos < end; fill_pos += copylen) {
+        status = fsw_shandle_get_extent(shand, FSW_U64_DIV(fill_pos, vol->log_blocksize));
+        if (status)
+            break;
+
+        pos_in_extent = fill_pos - shand->extent.log_start * vol->log_blocksize;
+        copylen = (fsw_u64)shand->extent.log_count * vol->log_blocksize - pos_in_extent;
+        if (copylen > end - fill_pos)
+            copylen = end - fill_pos;
+        dest = shand->ra_buffer + (fsw_u32)(fill_pos - start);
+
+        if (shand->extent.type == FSW_EXTENT_TYPE_PHYSBLOCK) {
+            if (nreq == FSW_READ_REQUESTS) {
+                status = fsw_block_read_wait(vol, requests, &nreq);
+                if (status)
+                    break;
+            }
+            status = fsw_block_read_submit(vol,
+                                           shand->extent.phys_start + FSW_U64_DIV(pos_in_extent, vol->phys_blocksize),
+                                           (fsw_u32)FSW_U64_DIV(copylen, vol->phys_blocksize),
+                                           dest, &requests[nreq]);
+            if (status)
+                break;
+            nreq++;
+
+        } else if (shand->extent.type == FSW_EXTENT_TYPE_BUFFER) {
+            fsw_memcpy(dest, (fsw_u8 *)shand->extent.buffer + pos_in_extent, copylen);
+
+        } else {   // _SPARSE or _INVALID
+            fsw_memzero(dest, copylen);
+        }
+    }
+
+    // all reads must be finished before the buffer can be used or reused
+    req_status = fsw_block_read_wait(vol, requests, &nreq);
+    if (status)
+        return status;
+    if (req_status)
+        return req_status;
+
+    if (end > dno->size)
+        end = dno->size;
+    shand->ra_start = start;
+    shand->ra_len = (fsw_u32)(end - start);
+    return FSW_SUCCESS;
+}
+
 /**
  * Read data from a shandle (storage handle for a dnode). This function is called by the
  * host driver or internally when data is read from a file. TODO: more
+ *
+ * Sequential reads of regular files in pieces smaller than the read-ahead window are
+ * served from the shandle's read-ahead buffer, which is refilled a whole window at a
+ * time. Any other access reads from the extents directly.
  */
 
 fsw_status_t fsw_shandle_read(struct fsw_shandle *shand, fsw_u32 *buffer_size_inout, void *buffer_in)
 {
-    fsw_status_t    status;
+    fsw_status_t    status = FSW_SUCCESS, req_status;
     struct fsw_dnode *dno = shand->dnode;
     struct fsw_volume *vol = dno->vol;
     fsw_u8          *buffer, *block_buffer;
     fsw_u64         buflen, copylen, pos;
     fsw_u64         log_bno, pos_in_extent, phys_bno, pos_in_physblock;
-    fsw_u32         cache_level;
+    fsw_u32         cache_level, phys_bcnt;
+    void            *requests[FSW_READ_REQUESTS];
+    fsw_u32         nreq = 0;
 
     if (shand->pos >= dno->size) {   // already at EOF
         *buffer_size_inout = 0;
@@ -876,31 +2321,56 @@ fsw_status_t fsw_shandle_read(struct fsw_shandle *shand, fsw_u32 *buffer_size_in
     // initialize vars
     buffer = buffer_in;
     buflen = *buffer_size_inout;
-    pos = (fsw_u32)shand->pos;
+    pos = shand->pos;
     cache_level = (dno->type != FSW_DNODE_TYPE_FILE) ? 1 : 0;
     // restrict read to file size
     if (buflen > dno->size - pos)
         buflen = (fsw_u32)(dno->size - pos);
 
+    // detect sequential access to file data
+    if (cache_level == 0 && vol->readahead_max >= vol->log_blocksize && pos == shand->ra_next) {
+        if (shand->ra_window == 0)
+            shand->ra_window = FSW_READAHEAD_MIN;
+        else if (buflen >= shand->ra_window && shand->ra_window < vol->readahead_max)
+            shand->ra_window *= 2;      // grow past the caller's read size
+        if (shand->ra_window > vol->readahead_max)
+            shand->ra_window = vol->readahead_max;
+    } else {
+        shand->ra_window = 0;
+    }
+
     while (buflen > 0) {
-        // get extent for the current logical block
-        log_bno = FSW_U64_DIV(pos, vol->log_blocksize);
-        if (shand->extent.type == FSW_EXTENT_TYPE_INVALID ||
-            log_bno < shand->extent.log_start ||
-            log_bno >= shand->extent.log_start + shand->extent.log_count) {
-
-            if (shand->extent.type == FSW_EXTENT_TYPE_BUFFER)
-                fsw_free(shand->extent.buffer);
-
-            // ask the file system for the proper extent
-            shand->extent.log_start = log_bno;
-            status = vol->fstype_table->get_extent(vol, dno, &shand->extent);
-            if (status) {
-                shand->extent.type = FSW_EXTENT_TYPE_INVALID;
-                return status;
+        // use data from the read-ahead buffer
+        if (shand->ra_len > 0 && pos >= shand->ra_start && pos < shand->ra_start + shand->ra_len) {
+            copylen = shand->ra_start + shand->ra_len - pos;
+            if (copylen > buflen)
+                copylen = buflen;
+            fsw_memcpy(buffer, shand->ra_buffer + (fsw_u32)(pos - shand->ra_start), copylen);
+
+            buffer += copylen;
+            buflen -= copylen;
+            pos    += copylen;
+            continue;
+        }
+
+        // refill it for small sequential reads; large ones are better read directly
+        if (shand->ra_window > 0 && buflen < shand->ra_window) {
+            if (fsw_shandle_readahead(shand, pos) == FSW_SUCCESS) {
+                shand->ra_window *= 2;
+                if (shand->ra_window > vol->readahead_max)
+                    shand->ra_window = vol->readahead_max;
+                continue;
             }
+            // fall back to plain reads for the rest of this sequence
+            shand->ra_window = 0;
         }
 
+        // get extent for the current logical block
+        log_bno = FSW_U64_DIV(pos, vol->log_blocksize);
+        status = fsw_shandle_get_extent(shand, log_bno);
+        if (status)
+            break;
+
         pos_in_extent = pos - shand->extent.log_start * vol->log_blocksize;
 
         // dispatch by extent type
@@ -908,18 +2378,41 @@ fsw_status_t fsw_shandle_read(struct fsw_shandle *shand, fsw_u32 *buffer_size_in
             // convert to physical block number and offset
             phys_bno = shand->extent.phys_start + FSW_U64_DIV(pos_in_extent, vol->phys_blocksize);
             pos_in_physblock = pos_in_extent & (vol->phys_blocksize - 1);
-            copylen = vol->phys_blocksize - pos_in_physblock;
-            if (copylen > buflen)
-                copylen = buflen;
 
-            // get one physical block
-            status = fsw_block_get(vol, phys_bno, cache_level, (void **)&block_buffer);
-            if (status)
-                return status;
+            if (pos_in_physblock == 0 && buflen >= vol->phys_blocksize) {
+                // whole blocks: read the rest of the extent that fits the buffer in one go
+                copylen = (fsw_u64)shand->extent.log_count * vol->log_blocksize - pos_in_extent;
+                if (copylen > buflen)
+                    copylen = buflen;
+                phys_bcnt = (fsw_u32)FSW_U64_DIV(copylen, vol->phys_blocksize);
+                copylen = (fsw_u64)phys_bcnt * vol->phys_blocksize;
+
+                // each extent is a separate request, so reads of several extents overlap
+                if (nreq == FSW_READ_REQUESTS) {
+                    status = fsw_block_read_wait(vol, requests, &nreq);
+                    if (status)
+                        break;
+                }
+                status = fsw_block_read_submit(vol, phys_bno, phys_bcnt, buffer, &requests[nreq]);
+                if (status)
+                    break;
+                nreq++;
+
+            } else {
+                // partial block at the head or tail of the read, go through the cache
+                copylen = vol->phys_blocksize - pos_in_physblock;
+                if (copylen > buflen)
+                    copylen = buflen;
+
+                // get one physical block
+                status = fsw_block_get(vol, phys_bno, cache_level, (void **)&block_buffer);
+                if (status)
+                    break;
 
-            // copy data from it
-            fsw_memcpy(buffer, block_buffer + pos_in_physblock, copylen);
-            fsw_block_release(vol, phys_bno, block_buffer);
+                // copy data from it
+                fsw_memcpy(buffer, block_buffer + pos_in_physblock, copylen);
+                fsw_block_release(vol, phys_bno, block_buffer);
+            }
 
         } else if (shand->extent.type == FSW_EXTENT_TYPE_BUFFER) {
             copylen = shand->extent.log_count * vol->log_blocksize - pos_in_extent;
@@ -940,8 +2433,16 @@ fsw_status_t fsw_shandle_read(struct fsw_shandle *shand, fsw_u32 *buffer_size_in
         pos    += copylen;
     }
 
+    // the caller's buffer is only complete once all direct reads have finished
+    req_status = fsw_block_read_wait(vol, requests, &nreq);
+    if (status)
+        return status;
+    if (req_status)
+        return req_status;
+
     *buffer_size_inout = (fsw_u32)(pos - shand->pos);
     shand->pos = pos;
+    shand->ra_next = pos;
 
     return FSW_SUCCESS;
 }
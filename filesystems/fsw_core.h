@@ -56,6 +56,74 @@
 /** Indicates that the block cache entry is empty. */
 #define FSW_INVALID_BNO 0xFFFFFFFFFFFFFFFF
 
+/** Highest cache level accepted by fsw_block_get. */
+#define FSW_MAX_CACHE_LEVEL (5)
+/** Lowest cache level counted as file system metadata for the block cache budget. */
+#define FSW_META_CACHE_LEVEL (2)
+
+#ifndef FSW_BCACHE_BUDGET
+/** Default per-volume byte budget for cached block data. */
+#define FSW_BCACHE_BUDGET (2*1024*1024)
+#endif
+#ifndef FSW_BCACHE_META_RESERVE
+/** Default part of the per-volume budget reserved for metadata blocks. */
+#define FSW_BCACHE_META_RESERVE (1024*1024)
+#endif
+#ifndef FSW_BCACHE_GLOBAL_BUDGET
+/** Default byte budget for cached block data across all mounted volumes. */
+#define FSW_BCACHE_GLOBAL_BUDGET (8*1024*1024)
+#endif
+#ifndef FSW_SHARED_CACHE_BUDGET
+/** Default byte budget for metadata blocks kept across mounts in the shared cache, 0 disables it. */
+#define FSW_SHARED_CACHE_BUDGET (1024*1024)
+#endif
+#ifndef FSW_SHARED_CACHE_HASH_SIZE
+/** Number of buckets in the hash table of the shared cache (power of 2). */
+#define FSW_SHARED_CACHE_HASH_SIZE (256)
+#endif
+/** Maximum size of a device key handed to the core by the host's device_key function. */
+#define FSW_DEVICE_KEY_MAX (256)
+#ifndef FSW_BCACHE_DATA_RING
+/** Number of unreferenced file data (level 0) blocks kept per volume. */
+#define FSW_BCACHE_DATA_RING (16)
+#endif
+#ifndef FSW_TICKS
+/** Time stamp for the I/O statistics, in a host-defined unit. Hosts without a clock report 0. */
+#define FSW_TICKS() (0)
+#endif
+#ifndef FSW_BLOCKSPAN_CACHE_SIZE
+/** Number of unpinned multi-block spans kept per volume for reuse. */
+#define FSW_BLOCKSPAN_CACHE_SIZE (16)
+#endif
+#ifndef FSW_READAHEAD_MIN
+/** Initial read-ahead window in bytes once sequential file access is detected. */
+#define FSW_READAHEAD_MIN (16*1024)
+#endif
+#ifndef FSW_READAHEAD_MAX
+/** Default per-volume cap for the read-ahead window in bytes. */
+#define FSW_READAHEAD_MAX (256*1024)
+#endif
+#ifndef FSW_READ_REQUESTS
+/** Maximum number of disk reads a single file or span read keeps in flight. */
+#define FSW_READ_REQUESTS (8)
+#endif
+#ifndef FSW_EXTENT_MAP_MAX
+/** Maximum number of extents remembered per dnode. */
+#define FSW_EXTENT_MAP_MAX (1024)
+#endif
+#ifndef FSW_EXTENT_MAP_SLAB
+/** Number of extents in a dnode's extent map that are allocated from the volume's slab. */
+#define FSW_EXTENT_MAP_SLAB (8)
+#endif
+#ifndef FSW_DNODE_CACHE_SIZE
+/** Number of released dnodes kept per volume for reuse. */
+#define FSW_DNODE_CACHE_SIZE (128)
+#endif
+#ifndef FSW_DENTRY_CACHE_SIZE
+/** Number of directory lookup results remembered per volume (power of 2). */
+#define FSW_DENTRY_CACHE_SIZE (256)
+#endif
+
 
 //
 // Byte-swapping macros
@@ -163,6 +231,7 @@ enum {
     FSW_UNSUPPORTED,
     FSW_NOT_FOUND,
     FSW_VOLUME_CORRUPTED,
+    FSW_NOT_READY,
     FSW_UNKNOWN_ERROR
 };
 
@@ -207,12 +276,78 @@ enum {
 struct fsw_dnode;
 struct fsw_host_table;
 struct fsw_fstype_table;
+struct fsw_blockcache_chunk;
+struct fsw_shared_device;
+struct fsw_dentry;
+struct fsw_arena_chunk;
 
 struct fsw_blockcache {
     fsw_u32     refcount;           //!< Reference count
     fsw_u32     cache_level;        //!< Level of importance of this block
     fsw_u64     phys_bno;           //!< Physical block number
     void        *data;              //!< Block data buffer
+    struct fsw_blockcache *lru_prev;    //!< Circular LRU list of unreferenced blocks: previous entry
+    struct fsw_blockcache *lru_next;    //!< Circular LRU list of unreferenced blocks: next entry
+};
+
+/**
+ * Core: A run of consecutive disk blocks pinned in one contiguous buffer.
+ */
+
+struct fsw_blockspan {
+    struct fsw_blockspan *next;     //!< Next span of this volume, most recently used first
+    fsw_u32     refcount;           //!< Number of pins held on this span
+    fsw_u32     count;              //!< Number of physical blocks in the span
+    fsw_u64     phys_bno;           //!< Physical block number of the first block
+    void        *data;              //!< Span data buffer
+};
+
+/**
+ * Core: Allocator for objects of one fixed size. Objects are carved out of larger
+ * chunks allocated from the host, and freed objects are kept on a free list for
+ * reuse. Chunks are only given back when the slab is destroyed.
+ */
+
+struct fsw_slab {
+    fsw_u32     obj_size;           //!< Size of one object, rounded up for alignment
+    fsw_u32     chunk_objs;         //!< Number of objects per chunk
+    void        *free_list;         //!< Unused objects, linked through their first word
+    void        *chunks;            //!< Allocated chunks, linked through their first word
+    fsw_u32     alloc_count;        //!< Number of objects handed out
+    fsw_u32     chunk_count;        //!< Number of chunks allocated from the host
+};
+
+/**
+ * Core: Bump allocator for short-lived data. Allocations can't be freed one by one;
+ * the whole arena is reset or freed at once.
+ */
+
+struct fsw_arena {
+    struct fsw_arena_chunk *chunks; //!< Allocated chunks, the current one first
+    fsw_u32     alloc_count;        //!< Number of allocations served
+    fsw_u32     chunk_count;        //!< Number of chunks allocated from the host
+};
+
+/**
+ * Core: Per-volume counters for cache and I/O behaviour. The block cache and device
+ * counters are kept by the core. The host driver counts hits in its own read cache,
+ * and file system drivers with caches of their own count them in the drv_cache_*
+ * fields. read_ticks is in the unit of FSW_TICKS.
+ */
+
+struct fsw_volume_stats {
+    fsw_u64     bcache_lookups;     //!< Calls to fsw_block_get
+    fsw_u64     bcache_hits;        //!< Blocks found in the block cache
+    fsw_u64     bcache_misses;      //!< Blocks not found in the block cache
+    fsw_u64     bcache_evictions[FSW_MAX_CACHE_LEVEL+1];    //!< Cached blocks discarded, per cache level
+    fsw_u64     shared_cache_hits;  //!< Block cache misses served from the shared cache instead of the device
+    fsw_u64     device_calls;       //!< Read requests passed to the host driver
+    fsw_u64     bytes_read;         //!< Bytes requested from the host driver
+    fsw_u64     read_ticks;         //!< Time spent in the host driver's read functions
+    fsw_u64     host_cache_hits;    //!< Reads served from the host driver's cache
+    fsw_u64     host_cache_misses;  //!< Reads the host driver passed on to the disk
+    fsw_u64     drv_cache_hits;     //!< Hits in caches of the file system driver
+    fsw_u64     drv_cache_misses;   //!< Misses in caches of the file system driver
 };
 
 /**
@@ -227,9 +362,35 @@ struct fsw_volume {
     struct fsw_string label;        //!< Volume label
 
     struct fsw_dnode *dnode_head;   //!< List of all dnodes allocated for this volume
-
-    struct fsw_blockcache *bcache;  //!< Array of block cache entries
-    fsw_u32     bcache_size;        //!< Number of entries in the block cache array
+    struct fsw_dnode **dnode_hash;  //!< Hash table of all dnodes by tree_id and dnode_id, chained
+    fsw_u32     dnode_hash_size;    //!< Number of buckets in the hash table (power of 2)
+    fsw_u32     dnode_count;        //!< Number of dnodes allocated, including released ones kept for reuse
+    struct fsw_dnode *dnode_lru;    //!< Released dnodes kept for reuse, most recent first
+    fsw_u32     dnode_lru_count;    //!< Number of dnodes on the LRU list
+    fsw_u32     dnode_lru_max;      //!< Maximum number of released dnodes to keep
+    struct fsw_dentry *dentry_cache;    //!< Directory lookup results, indexed by hash
+    struct fsw_slab dnode_slab;     //!< Allocator for dnode structures
+    struct fsw_slab extent_slab;    //!< Allocator for small per-dnode extent maps
+
+    struct fsw_blockcache **bcache_hash;    //!< Open-addressed hash table of valid block cache entries
+    fsw_u32     bcache_hash_size;   //!< Number of slots in the hash table (power of 2)
+    fsw_u32     bcache_size;        //!< Number of block cache entries allocated
+    struct fsw_blockcache_chunk *bcache_chunks;             //!< List of allocated block cache entry chunks
+    struct fsw_blockcache *bcache_free;                     //!< List of unused block cache entries
+    struct fsw_blockcache *bcache_lru[FSW_MAX_CACHE_LEVEL+1];  //!< Unreferenced entries per cache level, most recent first
+    fsw_u32     bcache_lru_count[FSW_MAX_CACHE_LEVEL+1];        //!< Number of entries on each LRU list
+    fsw_u32     bcache_budget;      //!< Maximum bytes of block data to keep cached
+    fsw_u32     bcache_meta_reserve;    //!< Bytes of the budget that file and directory data cannot claim
+    fsw_u32     bcache_bytes;       //!< Bytes of block data currently allocated
+    fsw_u32     bcache_meta_bytes;  //!< Bytes of block data holding metadata (level 2 and up)
+    fsw_u32     bcache_bytes_hwm;   //!< High-water mark of bcache_bytes
+    struct fsw_blockspan *bspan_head;   //!< Multi-block spans, most recently used first
+    fsw_u32     bspan_unused;       //!< Number of spans without pins
+    fsw_u32     readahead_max;      //!< Cap for the read-ahead window of file shandles, 0 disables it
+    struct fsw_shared_device *shared_dev;   //!< The device in the shared cache, NULL if the host can't identify it
+    int         shared_dev_checked; //!< Set once the host has been asked for the device key
+    int         mounting;           //!< Set while mounting or probing; every block read then goes to the shared cache
+    struct fsw_volume_stats stats;  //!< Cache and I/O counters
 
     void        *host_data;         //!< Hook for a host-specific data structure
     struct fsw_host_table *host_table;      //!< Dispatch table for host-specific functions
@@ -255,6 +416,12 @@ struct fsw_dnode {
 
     struct fsw_dnode *next;         //!< Doubly-linked list of all dnodes: previous dnode
     struct fsw_dnode *prev;         //!< Doubly-linked list of all dnodes: next dnode
+    struct fsw_dnode *hash_next;    //!< Next dnode in the same hash bucket
+    struct fsw_extent *extent_map;  //!< Extents returned by get_extent, sorted by log_start
+    fsw_u32     extent_map_count;   //!< Number of extents in extent_map
+    fsw_u32     extent_map_size;    //!< Number of extents allocated for extent_map
+    struct fsw_dnode *lru_prev;     //!< Circular LRU list of released dnodes: previous dnode
+    struct fsw_dnode *lru_next;     //!< Circular LRU list of released dnodes: next dnode
 };
 
 /**
@@ -302,6 +469,15 @@ struct fsw_shandle {
 
     fsw_u64     pos;                //!< Current file pointer in bytes
     struct fsw_extent extent;       //!< Current extent
+
+    fsw_u64     ra_next;            //!< File position a sequential read would continue at
+    fsw_u32     ra_window;          //!< Size of the next read-ahead, 0 while access is not sequential
+    fsw_u32     ra_size;            //!< Size of the read-ahead buffer
+    fsw_u8      *ra_buffer;         //!< Read-ahead buffer, allocated on first use
+    fsw_u64     ra_start;           //!< File position of the data in the read-ahead buffer
+    fsw_u32     ra_len;             //!< Bytes of valid data in the read-ahead buffer
+
+    struct fsw_arena arena;         //!< Scratch memory for the file system driver, freed on close
 };
 
 /**
@@ -343,6 +519,15 @@ struct fsw_host_table
                                      fsw_u32 old_phys_blocksize, fsw_u32 old_log_blocksize,
                                      fsw_u32 new_phys_blocksize, fsw_u32 new_log_blocksize);
     fsw_status_t EFIAPI (*read_block)(struct fsw_volume *vol, fsw_u64 phys_bno, void *buffer);
+
+    // optional, may be NULL; the core falls back to read_block
+    fsw_status_t EFIAPI (*read_blocks)(struct fsw_volume *vol, fsw_u64 phys_bno, fsw_u32 count, void *buffer);
+    fsw_status_t EFIAPI (*read_blocks_submit)(struct fsw_volume *vol, fsw_u64 phys_bno, fsw_u32 count,
+                                              void *buffer, void **request_out);
+    fsw_status_t EFIAPI (*read_blocks_complete)(struct fsw_volume *vol, void *request, int wait);
+    // optional, may be NULL; identifies the device for the shared cache by writing a key to
+    //  buffer, returns the size of the key or 0 if there is none or it doesn't fit
+    fsw_u32      EFIAPI (*device_key)(struct fsw_volume *vol, void *buffer, fsw_u32 buffer_size);
 };
 
 /**
@@ -388,8 +573,20 @@ void         fsw_unmount(struct fsw_volume *vol);
 fsw_status_t fsw_volume_stat(struct fsw_volume *vol, struct fsw_volume_stat *sb);
 
 void         fsw_set_blocksize(struct VOLSTRUCTNAME *vol, fsw_u32 phys_blocksize, fsw_u32 log_blocksize);
+void         fsw_set_cache_budget(struct fsw_volume *vol, fsw_u32 budget, fsw_u32 meta_reserve);
+void         fsw_set_global_cache_budget(fsw_u32 budget);
+void         fsw_set_readahead(struct fsw_volume *vol, fsw_u32 readahead_max);
+fsw_u32      fsw_get_global_cache_hwm(void);
+void         fsw_shared_cache_flush(void);
 fsw_status_t fsw_block_get(struct VOLSTRUCTNAME *vol, fsw_u64 phys_bno, fsw_u32 cache_level, void **buffer_out);
 void         fsw_block_release(struct VOLSTRUCTNAME *vol, fsw_u64 phys_bno, void *buffer);
+fsw_status_t fsw_block_pin(struct VOLSTRUCTNAME *vol, fsw_u64 phys_bno, fsw_u32 count, fsw_u32 cache_level, void **buffer_out);
+fsw_status_t fsw_block_unpin(struct VOLSTRUCTNAME *vol, void *buffer);
+fsw_status_t fsw_block_read_direct(struct VOLSTRUCTNAME *vol, fsw_u64 phys_bno, fsw_u32 count, void *buffer);
+fsw_status_t fsw_block_read_submit(struct VOLSTRUCTNAME *vol, fsw_u64 phys_bno, fsw_u32 count, void *buffer,
+                                   void **request_out);
+fsw_status_t fsw_block_read_complete(struct VOLSTRUCTNAME *vol, void *request, int wait);
+fsw_status_t fsw_block_read_wait(struct VOLSTRUCTNAME *vol, void **requests, fsw_u32 *count_inout);
 
 /*@}*/
 
@@ -435,6 +632,7 @@ void fsw_store_attr_efi(struct fsw_dnode_stat *sb, fsw_u16 attr);
 fsw_status_t fsw_shandle_open(struct DNODESTRUCTNAME *dno, struct fsw_shandle *shand);
 void         fsw_shandle_close(struct fsw_shandle *shand);
 fsw_status_t fsw_shandle_read(struct fsw_shandle *shand, fsw_u32 *buffer_size_inout, void *buffer);
+fsw_status_t fsw_shandle_map(struct fsw_shandle *shand, fsw_u64 pos, fsw_u64 len);
 
 /*@}*/
 
@@ -447,6 +645,15 @@ fsw_status_t fsw_shandle_read(struct fsw_shandle *shand, fsw_u32 *buffer_size_in
 fsw_status_t fsw_alloc_zero(int len, void **ptr_out);
 fsw_status_t fsw_memdup(void **dest_out, void *src, int len);
 
+void         fsw_slab_init(struct fsw_slab *slab, fsw_u32 obj_size);
+fsw_status_t fsw_slab_alloc(struct fsw_slab *slab, void **ptr_out);
+void         fsw_slab_free(struct fsw_slab *slab, void *ptr);
+void         fsw_slab_destroy(struct fsw_slab *slab);
+
+fsw_status_t fsw_arena_alloc(struct fsw_arena *arena, fsw_u32 len, void **ptr_out);
+void         fsw_arena_reset(struct fsw_arena *arena);
+void         fsw_arena_free(struct fsw_arena *arena);
+
 /*@}*/
 
 
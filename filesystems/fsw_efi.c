@@ -44,6 +44,8 @@
 #include "edk2/DriverBinding.h"
 #include "edk2/ComponentName.h"
 #define gMyEfiSimpleFileSystemProtocolGuid FileSystemProtocol
+#define gMyEfiLoadedImageProtocolGuid LoadedImageProtocol
+#define gMyEfiDevicePathProtocolGuid DevicePathProtocol
 #else
 #define REFIND_EFI_DRIVER_BINDING_PROTOCOL EFI_DRIVER_BINDING_PROTOCOL
 #define REFIND_EFI_COMPONENT_NAME_PROTOCOL EFI_COMPONENT_NAME_PROTOCOL
@@ -53,6 +55,9 @@
 #define EFI_FILE_SYSTEM_VOLUME_LABEL_INFO_ID    \
     { 0xDB47D7D3,0xFE81, 0x11d3, {0x9A, 0x35, 0x00, 0x90, 0x27, 0x3F, 0xC1, 0x4D} }
 #define gMyEfiSimpleFileSystemProtocolGuid gEfiSimpleFileSystemProtocolGuid
+#define gMyEfiLoadedImageProtocolGuid gEfiLoadedImageProtocolGuid
+#define gMyEfiDevicePathProtocolGuid gEfiDevicePathProtocolGuid
+#define EFI_LOADED_IMAGE EFI_LOADED_IMAGE_PROTOCOL
 #endif
 
 #include "../include/version.h"
@@ -68,14 +73,21 @@ EFI_GUID gMyEfiDriverBindingProtocolGuid = REFIND_EFI_DRIVER_BINDING_PROTOCOL_GU
 EFI_GUID gMyEfiComponentNameProtocolGuid = REFIND_EFI_COMPONENT_NAME_PROTOCOL_GUID;
 EFI_GUID gMyEfiDiskIoProtocolGuid = REFIND_EFI_DISK_IO_PROTOCOL_GUID;
 EFI_GUID gMyEfiBlockIoProtocolGuid = REFIND_EFI_BLOCK_IO_PROTOCOL_GUID;
+EFI_GUID gMyEfiDiskIo2ProtocolGuid = REFIND_EFI_DISK_IO2_PROTOCOL_GUID;
 EFI_GUID gMyEfiFileInfoGuid = EFI_FILE_INFO_ID;
 EFI_GUID gMyEfiFileSystemInfoGuid = EFI_FILE_SYSTEM_INFO_ID;
 EFI_GUID gMyEfiFileSystemVolumeLabelInfoIdGuid = EFI_FILE_SYSTEM_VOLUME_LABEL_INFO_ID;
+EFI_GUID gFswVolumeStatsProtocolGuid = FSW_VOLUME_STATS_PROTOCOL_GUID;
+EFI_GUID gFswDirEntryInfoGuid = FSW_DIR_ENTRY_INFO_ID;
 
 /** Helper macro for stringification. */
 #define FSW_EFI_STRINGIFY(x) #x
 /** Expands to the EFI driver name given the file system type name. */
 #define FSW_EFI_DRIVER_NAME(t) L"rEFInd 0.14.2 " FSW_EFI_STRINGIFY(t) L" File System Driver"
+/** Expands to the file system type name as a narrow string. */
+#define FSW_EFI_FSTYPE_NAME(t) FSW_EFI_STRINGIFY(t)
+/** Name of the I/O trace file, in the root directory of the device the driver was loaded from. */
+#define FSW_EFI_TRACE_FILE(t) L"\\fsw_trace_" FSW_EFI_STRINGIFY(t) L".bin"
 
 // function prototypes
 
@@ -103,11 +115,18 @@ void EFIAPI fsw_efi_change_blocksize(struct fsw_volume *vol,
                               fsw_u32 old_phys_blocksize, fsw_u32 old_log_blocksize,
                               fsw_u32 new_phys_blocksize, fsw_u32 new_log_blocksize);
 fsw_status_t EFIAPI fsw_efi_read_block(struct fsw_volume *vol, fsw_u64 phys_bno, void *buffer);
+fsw_status_t EFIAPI fsw_efi_read_blocks(struct fsw_volume *vol, fsw_u64 phys_bno, fsw_u32 count, void *buffer);
+fsw_status_t EFIAPI fsw_efi_read_blocks_submit(struct fsw_volume *vol, fsw_u64 phys_bno, fsw_u32 count,
+                                               void *buffer, void **request_out);
+fsw_status_t EFIAPI fsw_efi_read_blocks_complete(struct fsw_volume *vol, void *request, int wait);
+fsw_u32 EFIAPI fsw_efi_device_key(struct fsw_volume *vol, void *buffer, fsw_u32 buffer_size);
 
 EFI_STATUS fsw_efi_map_status(fsw_status_t fsw_status, FSW_VOLUME_DATA *Volume);
 
 EFI_STATUS EFIAPI fsw_efi_FileSystem_OpenVolume(IN EFI_FILE_IO_INTERFACE *This,
                                                 OUT EFI_FILE_PROTOCOL **Root);
+EFI_STATUS EFIAPI fsw_efi_Stats_GetStats(IN FSW_VOLUME_STATS_PROTOCOL *This,
+                                         OUT FSW_VOLUME_STATS *Stats);
 EFI_STATUS fsw_efi_dnode_to_FileHandle(IN struct fsw_dnode *dno,
                                        OUT EFI_FILE_PROTOCOL **NewFileHandle);
 
@@ -129,6 +148,8 @@ EFI_STATUS fsw_efi_dir_read(IN FSW_FILE_DATA *File,
                             OUT VOID *Buffer);
 EFI_STATUS fsw_efi_dir_setpos(IN FSW_FILE_DATA *File,
                               IN UINT64 Position);
+VOID fsw_efi_dir_fill_batch(IN FSW_FILE_DATA *File);
+VOID fsw_efi_dir_release_batch(IN FSW_FILE_DATA *File);
 
 EFI_STATUS fsw_efi_dnode_getinfo(IN FSW_FILE_DATA *File,
                                  IN EFI_GUID *InformationType,
@@ -139,21 +160,33 @@ EFI_STATUS fsw_efi_dnode_fill_FileInfo(IN FSW_VOLUME_DATA *Volume,
                                        IN OUT UINTN *BufferSize,
                                        OUT VOID *Buffer);
 
-/**
- * Structure for holding disk cache data.
- */
+FSW_EFI_CACHE_WINDOW *fsw_efi_cache_lookup(IN FSW_VOLUME_DATA *Volume, IN UINT64 Offset, IN UINTN Length);
+FSW_EFI_CACHE_WINDOW *fsw_efi_cache_fill(IN FSW_VOLUME_DATA *Volume, IN UINT64 Offset);
+
+#if FSW_EFI_TRACE
+EFI_STATUS fsw_efi_trace_open(VOID);
+VOID fsw_efi_trace_flush(VOID);
+VOID fsw_efi_trace(IN FSW_VOLUME_DATA *Volume, IN UINT8 Type, IN UINT8 Outcome,
+                   IN UINT64 Block, IN UINT32 Count, IN UINT32 BlockSize);
+
+/** Trace records that haven't been written out yet, allocated on first use. */
+static struct fsw_trace_record *fsw_efi_trace_buffer = NULL;
+/** Number of records in fsw_efi_trace_buffer. */
+static UINTN fsw_efi_trace_count = 0;
+/** The trace file, opened by the first flush. */
+static EFI_FILE_PROTOCOL *fsw_efi_trace_file = NULL;
+/** Set when the trace can't be written; no further records are taken. */
+static BOOLEAN fsw_efi_trace_failed = FALSE;
+/** Set while the records are written out, so that any reads this causes aren't recorded. */
+static BOOLEAN fsw_efi_trace_busy = FALSE;
+/** Trace volume number for the next volume the driver tries to mount. */
+static UINT8 fsw_efi_trace_next_volume = 0;
+#endif
 
-#define CACHE_SIZE 131072 /* 128KiB */
-struct cache_data {
-   fsw_u8            *Cache;
-   fsw_u64           CacheStart;
-   BOOLEAN           CacheValid;
-   FSW_VOLUME_DATA   *Volume; // NOTE: Do not deallocate; copied here to ID volume
-};
+#define CACHE_WINDOW_SIZE ((UINT64) 1 << FSW_EFI_CACHE_WINDOW_SHIFT)
 
-#define NUM_CACHES 2 /* Don't increase without modifying fsw_efi_read_block() */
-static struct cache_data    Caches[NUM_CACHES];
-static int LastRead = -1;
+/** Size of a record in a directory handle's batch, keeping the records 8-byte aligned. */
+#define DIR_BATCH_RECORD_SIZE(n) (((n) + 7) & ~((UINTN) 7))
 
 /**
  * Interface structure for the EFI Driver Binding protocol.
@@ -186,27 +219,38 @@ struct fsw_host_table   fsw_efi_host_table = {
     FSW_STRING_TYPE_UTF16,
 
     fsw_efi_change_blocksize,
-    fsw_efi_read_block
+    fsw_efi_read_block,
+    fsw_efi_read_blocks,
+    fsw_efi_read_blocks_submit,
+    fsw_efi_read_blocks_complete,
+    fsw_efi_device_key
 };
 
 extern struct fsw_fstype_table   FSW_FSTYPE_TABLE_NAME(FSTYPE);
 
 
-VOID EFIAPI fsw_efi_clear_cache(VOID) {
-   int i;
+/**
+ * Invalidate the read cache of a volume. If FreeBuffers is TRUE, the window
+ * buffers are freed as well; otherwise they are kept for reuse.
+ */
+
+VOID fsw_efi_clear_cache(IN FSW_VOLUME_DATA *Volume, IN BOOLEAN FreeBuffers) {
+   UINTN i;
 
-   // clear the cache
-   for (i = 0; i < NUM_CACHES; i++) {
-      if (Caches[i].Cache != NULL) {
-         FreePool(Caches[i].Cache);
-         Caches[i].Cache = NULL;
-      } // if
-            Caches[i].CacheStart = 0;
-            Caches[i].CacheValid = FALSE;
-            Caches[i].Volume = NULL;
+   for (i = 0; i < FSW_EFI_CACHE_SETS * FSW_EFI_CACHE_WAYS; i++) {
+      if (FreeBuffers && Volume->Cache[i].Data != NULL) {
+         FreePool(Volume->Cache[i].Data);
+         Volume->Cache[i].Data = NULL;
+      }
+      Volume->Cache[i].Start = 0;
+      Volume->Cache[i].Size = 0;
+      Volume->Cache[i].LastUse = 0;
    }
-   LastRead = -1;
-} // VOID EFIAPI fsw_efi_clear_cache();
+   Volume->CacheClock = 0;
+#if FSW_EFI_TRACE
+   fsw_efi_trace(Volume, FSW_TRACE_CLEAR, FSW_TRACE_UNCACHED, 0, 0, 1);
+#endif
+} // VOID fsw_efi_clear_cache()
 
 /**
  * Image entry point. Installs the Driver Binding and Component Name protocols
@@ -311,6 +355,7 @@ EFI_STATUS EFIAPI fsw_efi_DriverBinding_Supported(IN REFIND_EFI_DRIVER_BINDING_P
  * This function allocates memory for a per-volume structure, opens the
  * required protocols (just Disk I/O in our case, Block I/O is only looked
  * at to get the MediaId field), and lets the FSW core mount the file system.
+ * If the firmware also provides Disk I/O 2, it is used for asynchronous reads.
  * If successful, an EFI Simple File System protocol is exported on the
  * device handle.
  */
@@ -322,6 +367,7 @@ EFI_STATUS EFIAPI fsw_efi_DriverBinding_Start(IN REFIND_EFI_DRIVER_BINDING_PROTO
     EFI_STATUS          Status;
     EFI_BLOCK_IO        *BlockIo;
     EFI_DISK_IO         *DiskIo;
+    REFIND_EFI_DISK_IO2_PROTOCOL *DiskIo2;
     FSW_VOLUME_DATA     *Volume;
 
 #if DEBUG_LEVEL
@@ -351,13 +397,29 @@ EFI_STATUS EFIAPI fsw_efi_DriverBinding_Start(IN REFIND_EFI_DRIVER_BINDING_PROTO
         return Status;
     }
 
+    // DiskIo2 is optional; it's installed together with DiskIo, so our hold on that covers it
+    Status = refit_call6_wrapper(BS->OpenProtocol, ControllerHandle,
+                              &gMyEfiDiskIo2ProtocolGuid,
+                              (VOID **) &DiskIo2,
+                              This->DriverBindingHandle,
+                              ControllerHandle,
+                              EFI_OPEN_PROTOCOL_GET_PROTOCOL);
+    if (EFI_ERROR(Status))
+        DiskIo2 = NULL;
+
     // allocate volume structure
     Volume = AllocateZeroPool(sizeof(FSW_VOLUME_DATA));
     Volume->Signature       = FSW_VOLUME_DATA_SIGNATURE;
     Volume->Handle          = ControllerHandle;
     Volume->DiskIo          = DiskIo;
+    Volume->DiskIo2         = DiskIo2;
     Volume->MediaId         = BlockIo->Media->MediaId;
     Volume->LastIOStatus    = EFI_SUCCESS;
+    Volume->DiskSize        = MultU64x32(BlockIo->Media->LastBlock + 1, BlockIo->Media->BlockSize);
+#if FSW_EFI_TRACE
+    Volume->TraceVolume     = fsw_efi_trace_next_volume++;
+    fsw_efi_trace(Volume, FSW_TRACE_MOUNT, FSW_TRACE_UNCACHED, Volume->DiskSize, 0, 1);
+#endif
 
     // mount the filesystem
     Status = fsw_efi_map_status(fsw_mount(Volume, &fsw_efi_host_table,
@@ -367,9 +429,14 @@ EFI_STATUS EFIAPI fsw_efi_DriverBinding_Start(IN REFIND_EFI_DRIVER_BINDING_PROTO
         // register the SimpleFileSystem protocol
         Volume->FileSystem.Revision     = EFI_FILE_IO_INTERFACE_REVISION;
         Volume->FileSystem.OpenVolume   = fsw_efi_FileSystem_OpenVolume;
-        Status = refit_call4_wrapper(BS->InstallMultipleProtocolInterfaces, &ControllerHandle,
+        Volume->Stats.Revision          = FSW_VOLUME_STATS_PROTOCOL_REVISION;
+        Volume->Stats.DriverName        = FSW_EFI_DRIVER_NAME(FSTYPE);
+        Volume->Stats.GetStats          = fsw_efi_Stats_GetStats;
+        Status = refit_call6_wrapper(BS->InstallMultipleProtocolInterfaces, &ControllerHandle,
                                                        &gMyEfiSimpleFileSystemProtocolGuid,
                                                        &Volume->FileSystem,
+                                                       &gFswVolumeStatsProtocolGuid,
+                                                       &Volume->Stats,
                                                        NULL);
         if (EFI_ERROR(Status)) {
 //            Print(L"Fsw ERROR: InstallMultipleProtocolInterfaces returned %x\n", Status);
@@ -380,6 +447,8 @@ EFI_STATUS EFIAPI fsw_efi_DriverBinding_Start(IN REFIND_EFI_DRIVER_BINDING_PROTO
     if (EFI_ERROR(Status)) {
         if (Volume->vol != NULL)
             fsw_unmount(Volume->vol);
+        fsw_efi_clear_cache(Volume, TRUE);
+        fsw_efi_close_async_reads(Volume);
         FreePool(Volume);
 
         refit_call4_wrapper(BS->CloseProtocol, ControllerHandle,
@@ -427,8 +496,9 @@ EFI_STATUS EFIAPI fsw_efi_DriverBinding_Stop(IN  REFIND_EFI_DRIVER_BINDING_PROTO
     Volume = FSW_VOLUME_FROM_FILE_SYSTEM(FileSystem);
 
     // uninstall Simple File System protocol
-    Status = refit_call4_wrapper(BS->UninstallMultipleProtocolInterfaces, ControllerHandle,
+    Status = refit_call6_wrapper(BS->UninstallMultipleProtocolInterfaces, ControllerHandle,
                                                      &gMyEfiSimpleFileSystemProtocolGuid, &Volume->FileSystem,
+                                                     &gFswVolumeStatsProtocolGuid, &Volume->Stats,
                                                      NULL);
     if (EFI_ERROR(Status)) {
  //       Print(L"Fsw ERROR: UninstallMultipleProtocolInterfaces returned %x\n", Status);
@@ -438,10 +508,25 @@ EFI_STATUS EFIAPI fsw_efi_DriverBinding_Stop(IN  REFIND_EFI_DRIVER_BINDING_PROTO
     Print(L"fsw_efi_DriverBinding_Stop: protocol uninstalled successfully\n");
 #endif
 
-    // release private data structure
+#if DEBUG_LEVEL
+    if (Volume->vol != NULL)
+        Print(L"fsw_efi_DriverBinding_Stop: block cache high-water mark %d bytes (all volumes %d bytes)\n",
+              Volume->vol->bcache_bytes_hwm, fsw_get_global_cache_hwm());
+    if (Volume->vol != NULL)
+        Print(L"fsw_efi_DriverBinding_Stop: %d dnodes in %d chunks, %d extent maps in %d chunks\n",
+              Volume->vol->dnode_slab.alloc_count, Volume->vol->dnode_slab.chunk_count,
+              Volume->vol->extent_slab.alloc_count, Volume->vol->extent_slab.chunk_count);
+#endif
+
+    // release private data structure and the read cache
     if (Volume->vol != NULL)
         fsw_unmount(Volume->vol);
+    fsw_efi_clear_cache(Volume, TRUE);
+    fsw_efi_close_async_reads(Volume);
     FreePool(Volume);
+#if FSW_EFI_TRACE
+    fsw_efi_trace_flush();
+#endif
 
     // close the consumed protocols
     Status = refit_call4_wrapper(BS->CloseProtocol, ControllerHandle,
@@ -449,9 +534,6 @@ EFI_STATUS EFIAPI fsw_efi_DriverBinding_Stop(IN  REFIND_EFI_DRIVER_BINDING_PROTO
                                This->DriverBindingHandle,
                                ControllerHandle);
 
-    // clear the cache
-    fsw_efi_clear_cache();
-
     return Status;
 }
 
@@ -498,92 +580,259 @@ void EFIAPI fsw_efi_change_blocksize(struct fsw_volume *vol,
                               fsw_u32 old_phys_blocksize, fsw_u32 old_log_blocksize,
                               fsw_u32 new_phys_blocksize, fsw_u32 new_log_blocksize)
 {
-    // nothing to do
+    // the core drops its block cache; drop the read cache along with it
+    fsw_efi_clear_cache((FSW_VOLUME_DATA *)vol->host_data, FALSE);
 }
 
+/**
+ * Find the read cache window holding a range of the disk. Returns NULL if the range
+ * isn't cached.
+ */
+
+FSW_EFI_CACHE_WINDOW *fsw_efi_cache_lookup(IN FSW_VOLUME_DATA *Volume, IN UINT64 Offset, IN UINTN Length) {
+   UINT64                WindowStart = Offset & ~(CACHE_WINDOW_SIZE - 1);
+   FSW_EFI_CACHE_WINDOW  *Set;
+   UINTN                 i;
+
+   Set = &Volume->Cache[((UINTN) RShiftU64(Offset, FSW_EFI_CACHE_WINDOW_SHIFT) & (FSW_EFI_CACHE_SETS - 1))
+                        * FSW_EFI_CACHE_WAYS];
+   for (i = 0; i < FSW_EFI_CACHE_WAYS; i++) {
+      if (Set[i].Size > 0 && Set[i].Start == WindowStart && Offset + Length <= WindowStart + Set[i].Size) {
+         Set[i].LastUse = ++Volume->CacheClock;
+         return &Set[i];
+      }
+   }
+   return NULL;
+} // FSW_EFI_CACHE_WINDOW *fsw_efi_cache_lookup()
+
+/**
+ * Load the window around a disk offset into the read cache, replacing the least
+ * recently used window of its set. Windows are aligned to their size, and a window
+ * at the end of the disk only covers the part up to the end. Returns NULL if the
+ * window couldn't be loaded.
+ */
+
+FSW_EFI_CACHE_WINDOW *fsw_efi_cache_fill(IN FSW_VOLUME_DATA *Volume, IN UINT64 Offset) {
+   UINT64                WindowStart = Offset & ~(CACHE_WINDOW_SIZE - 1);
+   FSW_EFI_CACHE_WINDOW  *Set, *Window;
+   EFI_STATUS            Status;
+   UINTN                 i, Size;
+
+   Set = &Volume->Cache[((UINTN) RShiftU64(Offset, FSW_EFI_CACHE_WINDOW_SHIFT) & (FSW_EFI_CACHE_SETS - 1))
+                        * FSW_EFI_CACHE_WAYS];
+   Window = &Set[0];
+   for (i = 1; i < FSW_EFI_CACHE_WAYS; i++) {
+      if (Set[i].LastUse < Window->LastUse)
+         Window = &Set[i];
+   }
+
+   Size = (UINTN) CACHE_WINDOW_SIZE;
+   if (Volume->DiskSize > WindowStart && Volume->DiskSize - WindowStart < CACHE_WINDOW_SIZE)
+      Size = (UINTN) (Volume->DiskSize - WindowStart);
+
+   Window->Size = 0;
+   if (Window->Data == NULL)
+      Window->Data = AllocatePool((UINTN) CACHE_WINDOW_SIZE);
+   if (Window->Data == NULL)
+      return NULL;
+
+   // TODO: Below call hangs on my 32-bit Mac Mini when compiled with GNU-EFI.
+   // The same binary is fine under VirtualBox, and the same call is fine when
+   // compiled with Tianocore. Further clue: Omitting "Status =" avoids the
+   // hang but produces a failure to mount the filesystem, even when the same
+   // change is made to later similar call. Calling Volume->DiskIo->ReadDisk()
+   // directly (without refit_call5_wrapper()) changes nothing. Placing Print()
+   // statements at the start and end of the function, and before and after the
+   // ReadDisk() call, suggests that when it fails, the program is executing
+   // code starting mid-function, so there seems to be something messed up in
+   // the way the function is being called. FIGURE THIS OUT!
+   Status = refit_call5_wrapper(Volume->DiskIo->ReadDisk, Volume->DiskIo, Volume->MediaId,
+                                WindowStart, Size, (VOID*) Window->Data);
+   if (EFI_ERROR(Status))
+      return NULL;
+
+   Window->Start = WindowStart;
+   Window->Size = Size;
+   Window->LastUse = ++Volume->CacheClock;
+   return Window;
+} // FSW_EFI_CACHE_WINDOW *fsw_efi_cache_fill()
+
+#if FSW_EFI_TRACE
+
+/**
+ * Create the trace file in the root directory of the device the driver was loaded
+ * from (normally the ESP), replacing the trace of an earlier boot, and write the
+ * trace header.
+ */
+
+EFI_STATUS fsw_efi_trace_open(VOID) {
+   EFI_LOADED_IMAGE        *LoadedImage;
+   EFI_FILE_IO_INTERFACE   *FileSystem;
+   EFI_FILE_PROTOCOL       *Root, *File;
+   struct fsw_trace_header Header;
+   const char              *FsType = FSW_EFI_FSTYPE_NAME(FSTYPE);
+   EFI_STATUS              Status;
+   UINTN                   i, Size;
+
+   Status = refit_call3_wrapper(BS->HandleProtocol, fsw_efi_DriverBinding_table.ImageHandle,
+                                &gMyEfiLoadedImageProtocolGuid, (VOID **) &LoadedImage);
+   if (EFI_ERROR(Status))
+      return Status;
+   Status = refit_call3_wrapper(BS->HandleProtocol, LoadedImage->DeviceHandle,
+                                &gMyEfiSimpleFileSystemProtocolGuid, (VOID **) &FileSystem);
+   if (EFI_ERROR(Status))
+      return Status;
+   Status = refit_call2_wrapper(FileSystem->OpenVolume, FileSystem, &Root);
+   if (EFI_ERROR(Status))
+      return Status;
+
+   Status = refit_call5_wrapper(Root->Open, Root, &File, FSW_EFI_TRACE_FILE(FSTYPE),
+                                EFI_FILE_MODE_READ | EFI_FILE_MODE_WRITE, 0);
+   if (!EFI_ERROR(Status))
+      refit_call1_wrapper(File->Delete, File);
+   Status = refit_call5_wrapper(Root->Open, Root, &File, FSW_EFI_TRACE_FILE(FSTYPE),
+                                EFI_FILE_MODE_READ | EFI_FILE_MODE_WRITE | EFI_FILE_MODE_CREATE, 0);
+   refit_call1_wrapper(Root->Close, Root);
+   if (EFI_ERROR(Status))
+      return Status;
+
+   ZeroMem(&Header, sizeof(Header));
+   for (i = 0; i < sizeof(Header.magic); i++)
+      Header.magic[i] = FSW_TRACE_MAGIC[i];
+   Header.version       = FSW_TRACE_VERSION;
+   Header.record_size   = sizeof(struct fsw_trace_record);
+   Header.window_shift  = FSW_EFI_CACHE_WINDOW_SHIFT;
+   Header.cache_sets    = FSW_EFI_CACHE_SETS;
+   Header.cache_ways    = FSW_EFI_CACHE_WAYS;
+   for (i = 0; FsType[i] != 0 && i < sizeof(Header.fstype); i++)
+      Header.fstype[i] = FsType[i];
+   Size = sizeof(Header);
+   Status = refit_call3_wrapper(File->Write, File, &Size, &Header);
+   if (EFI_ERROR(Status)) {
+      refit_call1_wrapper(File->Close, File);
+      return Status;
+   }
+
+   fsw_efi_trace_file = File;
+   return EFI_SUCCESS;
+} // EFI_STATUS fsw_efi_trace_open()
+
+/**
+ * Append the buffered trace records to the trace file and flush it, so that the
+ * trace survives a boot that never returns to the driver. If the file can't be
+ * created or written, tracing stops.
+ */
+
+VOID fsw_efi_trace_flush(VOID) {
+   EFI_STATUS  Status = EFI_SUCCESS;
+   UINTN       Size;
+
+   if (fsw_efi_trace_count == 0 || fsw_efi_trace_busy || fsw_efi_trace_failed)
+      return;
+
+   fsw_efi_trace_busy = TRUE;
+   if (fsw_efi_trace_file == NULL)
+      Status = fsw_efi_trace_open();
+   if (!EFI_ERROR(Status)) {
+      Size = fsw_efi_trace_count * sizeof(struct fsw_trace_record);
+      Status = refit_call3_wrapper(fsw_efi_trace_file->Write, fsw_efi_trace_file, &Size,
+                                   (VOID *) fsw_efi_trace_buffer);
+      if (!EFI_ERROR(Status))
+         Status = refit_call1_wrapper(fsw_efi_trace_file->Flush, fsw_efi_trace_file);
+      if (EFI_ERROR(Status)) {
+         refit_call1_wrapper(fsw_efi_trace_file->Close, fsw_efi_trace_file);
+         fsw_efi_trace_file = NULL;
+      }
+   }
+   if (EFI_ERROR(Status))
+      fsw_efi_trace_failed = TRUE;
+   fsw_efi_trace_count = 0;
+   fsw_efi_trace_busy = FALSE;
+} // VOID fsw_efi_trace_flush()
+
+/**
+ * Add a record to the I/O trace, writing out the buffered records when the buffer
+ * is full. Block and Count are in units of BlockSize bytes, a power of 2.
+ */
+
+VOID fsw_efi_trace(IN FSW_VOLUME_DATA *Volume, IN UINT8 Type, IN UINT8 Outcome,
+                   IN UINT64 Block, IN UINT32 Count, IN UINT32 BlockSize) {
+   struct fsw_trace_record *Record;
+   UINT8                   Shift = 0;
+
+   if (fsw_efi_trace_busy || fsw_efi_trace_failed)
+      return;
+   if (fsw_efi_trace_buffer == NULL) {
+      fsw_efi_trace_buffer = AllocatePool(FSW_EFI_TRACE_RECORDS * sizeof(struct fsw_trace_record));
+      if (fsw_efi_trace_buffer == NULL) {
+         fsw_efi_trace_failed = TRUE;
+         return;
+      }
+   }
+   if (fsw_efi_trace_count == FSW_EFI_TRACE_RECORDS) {
+      fsw_efi_trace_flush();
+      if (fsw_efi_trace_failed)
+         return;
+   }
+
+   while (Shift < 31 && ((UINT32) 1 << Shift) < BlockSize)
+      Shift++;
+   Record = &fsw_efi_trace_buffer[fsw_efi_trace_count++];
+   Record->ticks       = FSW_TICKS();
+   Record->block       = Block;
+   Record->count       = Count;
+   Record->volume      = Volume->TraceVolume;
+   Record->type        = Type;
+   Record->outcome     = Outcome;
+   Record->block_shift = Shift;
+} // VOID fsw_efi_trace()
+
+#endif
+
 /**
  * FSW interface function to read data blocks. This function is called by the FSW core
  * to read a block of data from the device. The buffer is allocated by the core code.
- * Two caches are maintained, so as to improve performance on some systems. (VirtualBox
- * is particularly susceptible to performance problems with an uncached driver -- the
- * ext2 driver can take 200 seconds to load a Linux kernel under VirtualBox, whereas
- * the time is more like 3 seconds with a cache!) Two independent caches are maintained
- * because the ext2fs driver tends to alternate between accessing two parts of the
- * disk.
+ * Reads go through a small per-volume read cache of large windows, so as to improve
+ * performance on some systems. (VirtualBox is particularly susceptible to performance
+ * problems with an uncached driver -- the ext2 driver can take 200 seconds to load a
+ * Linux kernel under VirtualBox, whereas the time is more like 3 seconds with a cache!)
+ * The cache is set-associative with several windows per set, because drivers tend to
+ * alternate between a few parts of the disk (e.g. inode table, extent tree and data).
  */
 
 fsw_status_t EFIAPI fsw_efi_read_block(struct fsw_volume *vol, fsw_u64 phys_bno, void *buffer) {
-   int              i, ReadCache = -1;
-   FSW_VOLUME_DATA  *Volume = (FSW_VOLUME_DATA *)vol->host_data;
-   EFI_STATUS       Status = EFI_SUCCESS;
-   BOOLEAN          ReadOneBlock = FALSE;
-   UINT64           StartRead = (UINT64) phys_bno * (UINT64) vol->phys_blocksize;
+   FSW_VOLUME_DATA      *Volume = (FSW_VOLUME_DATA *)vol->host_data;
+   FSW_EFI_CACHE_WINDOW *Window;
+   EFI_STATUS           Status = EFI_SUCCESS;
+   UINT64               StartRead = (UINT64) phys_bno * (UINT64) vol->phys_blocksize;
 
-   if (buffer == NULL)
+   if (buffer == NULL || vol->phys_blocksize == 0)
       return (fsw_status_t) EFI_BAD_BUFFER_SIZE;
 
-   // Initialize static data structures, if necessary....
-   if (LastRead < 0) {
-      fsw_efi_clear_cache();
-   } // if
-
-   // Look for a cache hit on the current query....
-   i = 0;
-   do {
-      if ((Caches[i].Volume == Volume) &&
-          (Caches[i].CacheValid == TRUE) &&
-          (StartRead >= Caches[i].CacheStart) &&
-          ((StartRead + vol->phys_blocksize) <= (Caches[i].CacheStart + CACHE_SIZE))) {
-         ReadCache = i;
-      }
-      i++;
-   } while ((i < NUM_CACHES) && (ReadCache < 0));
-
-   // No cache hit found; load new cache and pass it on....
-   if (ReadCache < 0) {
-      if (LastRead == -1)
-         LastRead = 1;
-      ReadCache = 1 - LastRead; // NOTE: If NUM_CACHES > 2, this must become more complex
-      Caches[ReadCache].CacheValid = FALSE;
-      if (Caches[ReadCache].Cache == NULL)
-         Caches[ReadCache].Cache = AllocatePool(CACHE_SIZE);
-      if (Caches[ReadCache].Cache != NULL) {
-         // TODO: Below call hangs on my 32-bit Mac Mini when compiled with GNU-EFI.
-         // The same binary is fine under VirtualBox, and the same call is fine when
-         // compiled with Tianocore. Further clue: Omitting "Status =" avoids the
-         // hang but produces a failure to mount the filesystem, even when the same
-         // change is made to later similar call. Calling Volume->DiskIo->ReadDisk()
-         // directly (without refit_call5_wrapper()) changes nothing. Placing Print()
-         // statements at the start and end of the function, and before and after the
-         // ReadDisk() call, suggests that when it fails, the program is executing
-         // code starting mid-function, so there seems to be something messed up in
-         // the way the function is being called. FIGURE THIS OUT!
-         Status = refit_call5_wrapper(Volume->DiskIo->ReadDisk, Volume->DiskIo, Volume->MediaId,
-                                      StartRead, (UINTN) CACHE_SIZE, (VOID*) Caches[ReadCache].Cache);
-         if (!EFI_ERROR(Status)) {
-            Caches[ReadCache].CacheStart = StartRead;
-            Caches[ReadCache].CacheValid = TRUE;
-            Caches[ReadCache].Volume = Volume;
-            LastRead = ReadCache;
-         } else {
-            ReadOneBlock = TRUE;
-         }
-      } else {
-         ReadOneBlock = TRUE;
-      } // if cache memory allocated
-   } // if (ReadCache < 0)
-
-   if (Caches[ReadCache].Cache != NULL && Caches[ReadCache].CacheValid == TRUE && vol->phys_blocksize > 0) {
-      refit_call3_wrapper(gBS->CopyMem, buffer,
-                          &Caches[ReadCache].Cache[StartRead - Caches[ReadCache].CacheStart],
-                          vol->phys_blocksize);
+   // Look for a cache hit on the current query, else load the window around it....
+   Window = fsw_efi_cache_lookup(Volume, StartRead, vol->phys_blocksize);
+   if (Window != NULL) {
+      vol->stats.host_cache_hits++;
+#if FSW_EFI_TRACE
+      fsw_efi_trace(Volume, FSW_TRACE_BLOCK, FSW_TRACE_HIT, phys_bno, 1, vol->phys_blocksize);
+#endif
    } else {
-      ReadOneBlock = TRUE;
+      vol->stats.host_cache_misses++;
+#if FSW_EFI_TRACE
+      fsw_efi_trace(Volume, FSW_TRACE_BLOCK, FSW_TRACE_MISS, phys_bno, 1, vol->phys_blocksize);
+#endif
+      Window = fsw_efi_cache_fill(Volume, StartRead);
+      if (Window != NULL && StartRead + vol->phys_blocksize > Window->Start + Window->Size)
+         Window = NULL;
    }
 
-   if (ReadOneBlock) { // Something's failed, so try a simple disk read of one block....
+   if (Window != NULL) {
+      refit_call3_wrapper(gBS->CopyMem, buffer,
+                          &Window->Data[StartRead - Window->Start],
+                          vol->phys_blocksize);
+   } else { // Something's failed, so try a simple disk read of one block....
       Status = refit_call5_wrapper(Volume->DiskIo->ReadDisk, Volume->DiskIo, Volume->MediaId,
-                                   phys_bno * vol->phys_blocksize,
+                                   StartRead,
                                    (UINTN) vol->phys_blocksize,
                                    (VOID*) buffer);
    }
@@ -592,6 +841,172 @@ fsw_status_t EFIAPI fsw_efi_read_block(struct fsw_volume *vol, fsw_u64 phys_bno,
    return Status;
 } // fsw_status_t *fsw_efi_read_block()
 
+/**
+ * FSW interface function to read a run of consecutive data blocks. This function is
+ * called by the FSW core for block-aligned file data that goes straight into the caller's
+ * buffer. Such runs are usually larger than the read cache, so they are passed to the
+ * Disk I/O protocol as a single request instead of being split up into cache windows.
+ */
+
+fsw_status_t EFIAPI fsw_efi_read_blocks(struct fsw_volume *vol, fsw_u64 phys_bno, fsw_u32 count, void *buffer) {
+   FSW_VOLUME_DATA  *Volume = (FSW_VOLUME_DATA *)vol->host_data;
+   EFI_STATUS       Status;
+
+   if (buffer == NULL)
+      return (fsw_status_t) EFI_BAD_BUFFER_SIZE;
+
+#if FSW_EFI_TRACE
+   fsw_efi_trace(Volume, FSW_TRACE_BLOCKS, FSW_TRACE_UNCACHED, phys_bno, count, vol->phys_blocksize);
+#endif
+   Status = refit_call5_wrapper(Volume->DiskIo->ReadDisk, Volume->DiskIo, Volume->MediaId,
+                                (UINT64) phys_bno * (UINT64) vol->phys_blocksize,
+                                (UINTN) count * vol->phys_blocksize,
+                                (VOID*) buffer);
+   Volume->LastIOStatus = Status;
+
+   return Status;
+} // fsw_status_t *fsw_efi_read_blocks()
+
+/**
+ * FSW interface function to start an asynchronous read of consecutive data blocks.
+ * If the disk provides Disk I/O 2, the read is passed to ReadDiskEx with a token from
+ * one of the volume's request slots, and the slot is returned as the request handle.
+ * Otherwise, or if all slots are busy or the TPL is too high for the disk driver to
+ * signal completion, the read is done synchronously and no request is returned.
+ */
+
+fsw_status_t EFIAPI fsw_efi_read_blocks_submit(struct fsw_volume *vol, fsw_u64 phys_bno, fsw_u32 count,
+                                               void *buffer, void **request_out) {
+   FSW_VOLUME_DATA      *Volume = (FSW_VOLUME_DATA *)vol->host_data;
+   FSW_EFI_ASYNC_READ   *Request = NULL;
+   EFI_STATUS           Status;
+   EFI_TPL              CurrentTpl;
+   UINTN                i;
+
+   *request_out = NULL;
+   if (buffer == NULL)
+      return (fsw_status_t) EFI_BAD_BUFFER_SIZE;
+
+   if (Volume->DiskIo2 != NULL) {
+      // disk drivers finish requests from timer callbacks, which can't interrupt us above TPL_CALLBACK
+      CurrentTpl = refit_call1_wrapper(BS->RaiseTPL, TPL_HIGH_LEVEL);
+      refit_call1_wrapper(BS->RestoreTPL, CurrentTpl);
+      if (CurrentTpl <= TPL_CALLBACK) {
+         for (i = 0; i < FSW_EFI_ASYNC_READS; i++) {
+            if (!Volume->AsyncReads[i].InUse) {
+               Request = &Volume->AsyncReads[i];
+               break;
+            }
+         }
+      }
+   }
+   if (Request != NULL && Request->Token.Event == NULL) {
+      Status = refit_call5_wrapper(BS->CreateEvent, 0, 0, NULL, NULL, &Request->Token.Event);
+      if (EFI_ERROR(Status)) {
+         Request->Token.Event = NULL;
+         Request = NULL;
+      }
+   }
+   if (Request == NULL)
+      return fsw_efi_read_blocks(vol, phys_bno, count, buffer);
+
+   Request->Token.TransactionStatus = EFI_SUCCESS;
+   Status = refit_call6_wrapper(Volume->DiskIo2->ReadDiskEx, Volume->DiskIo2, Volume->MediaId,
+                                (UINT64) phys_bno * (UINT64) vol->phys_blocksize,
+                                &Request->Token,
+                                (UINTN) count * vol->phys_blocksize,
+                                (VOID*) buffer);
+   if (EFI_ERROR(Status)) {
+      // the request wasn't queued, so the event won't be signalled; try the plain way
+      return fsw_efi_read_blocks(vol, phys_bno, count, buffer);
+   }
+
+#if FSW_EFI_TRACE
+   fsw_efi_trace(Volume, FSW_TRACE_ASYNC, FSW_TRACE_UNCACHED, phys_bno, count, vol->phys_blocksize);
+#endif
+
+   Request->InUse = TRUE;
+   *request_out = Request;
+   return FSW_SUCCESS;
+} // fsw_status_t fsw_efi_read_blocks_submit()
+
+/**
+ * FSW interface function to finish an asynchronous read. CheckEvent resets the event
+ * when it reports it as signalled, so the slot can be reused right away.
+ */
+
+fsw_status_t EFIAPI fsw_efi_read_blocks_complete(struct fsw_volume *vol, void *request, int wait) {
+   FSW_VOLUME_DATA      *Volume = (FSW_VOLUME_DATA *)vol->host_data;
+   FSW_EFI_ASYNC_READ   *Request = (FSW_EFI_ASYNC_READ *)request;
+   EFI_STATUS           Status;
+
+   do {
+      Status = refit_call1_wrapper(BS->CheckEvent, Request->Token.Event);
+   } while (wait && Status == EFI_NOT_READY);
+   if (Status == EFI_NOT_READY)
+      return FSW_NOT_READY;
+
+   Request->InUse = FALSE;
+   if (!EFI_ERROR(Status))
+      Status = Request->Token.TransactionStatus;
+   Volume->LastIOStatus = Status;
+
+   return EFI_ERROR(Status) ? FSW_IO_ERROR : FSW_SUCCESS;
+} // fsw_status_t fsw_efi_read_blocks_complete()
+
+/**
+ * Close the events of the volume's asynchronous read slots. All reads must have been
+ * completed.
+ */
+
+VOID fsw_efi_close_async_reads(IN FSW_VOLUME_DATA *Volume) {
+   UINTN i;
+
+   for (i = 0; i < FSW_EFI_ASYNC_READS; i++) {
+      if (Volume->AsyncReads[i].Token.Event != NULL) {
+         refit_call1_wrapper(BS->CloseEvent, Volume->AsyncReads[i].Token.Event);
+         Volume->AsyncReads[i].Token.Event = NULL;
+      }
+      Volume->AsyncReads[i].InUse = FALSE;
+   }
+} // VOID fsw_efi_close_async_reads()
+
+/**
+ * FSW interface function to identify the device of a volume for the shared cache.
+ * The key is the media ID followed by the device path of the handle, which for a
+ * partition ends in a hard drive node with its start, size and signature. Keys stay
+ * the same when the driver is stopped and started again on the handle, or when the
+ * partition gets a new handle, while a media change gets a new key.
+ */
+
+fsw_u32 EFIAPI fsw_efi_device_key(struct fsw_volume *vol, void *buffer, fsw_u32 buffer_size) {
+   EFI_STATUS       Status;
+   FSW_VOLUME_DATA  *Volume = (FSW_VOLUME_DATA *)vol->host_data;
+   UINT8            *DevicePath, *Node;
+   UINTN            NodeLength, PathLength;
+
+   if (Volume->Handle == NULL)
+      return 0;
+   Status = refit_call3_wrapper(BS->HandleProtocol, Volume->Handle, &gMyEfiDevicePathProtocolGuid,
+                                (VOID **) &DevicePath);
+   if (EFI_ERROR(Status) || DevicePath == NULL)
+      return 0;
+
+   // walk the nodes up to the end-of-path node (type 0x7F, sub-type 0xFF)
+   for (Node = DevicePath; Node[0] != 0x7F || Node[1] != 0xFF; Node += NodeLength) {
+      NodeLength = Node[2] | (Node[3] << 8);
+      if (NodeLength < 4 || (UINTN)(Node - DevicePath) + NodeLength + sizeof(UINT32) > buffer_size)
+         return 0;
+   }
+   PathLength = Node - DevicePath;
+   if (PathLength == 0)
+      return 0;
+
+   CopyMem(buffer, &Volume->MediaId, sizeof(UINT32));
+   CopyMem((UINT8 *)buffer + sizeof(UINT32), DevicePath, PathLength);
+   return (fsw_u32)(sizeof(UINT32) + PathLength);
+} // fsw_u32 fsw_efi_device_key()
+
 /**
  * Map FSW status codes to EFI status codes. The FSW_IO_ERROR code is only produced
  * by fsw_efi_read_block, so we map it back to the EFI status code remembered from
@@ -613,6 +1028,8 @@ EFI_STATUS fsw_efi_map_status(fsw_status_t fsw_status, FSW_VOLUME_DATA *Volume)
             return EFI_NOT_FOUND;
         case FSW_VOLUME_CORRUPTED:
             return EFI_VOLUME_CORRUPTED;
+        case FSW_NOT_READY:
+            return EFI_NOT_READY;
         default:
             return EFI_DEVICE_ERROR;
     }
@@ -635,12 +1052,45 @@ EFI_STATUS EFIAPI fsw_efi_FileSystem_OpenVolume(IN EFI_FILE_IO_INTERFACE *This,
     Print(L"fsw_efi_FileSystem_OpenVolume\n");
 #endif
 
-    fsw_efi_clear_cache();
+    fsw_efi_clear_cache(Volume, FALSE);
     Status = fsw_efi_dnode_to_FileHandle(Volume->vol->root, Root);
 
     return Status;
 }
 
+/**
+ * Volume statistics protocol, GetStats function. Copies the cache and I/O
+ * counters of the volume into the caller's structure.
+ */
+
+EFI_STATUS EFIAPI fsw_efi_Stats_GetStats(IN FSW_VOLUME_STATS_PROTOCOL *This,
+                                         OUT FSW_VOLUME_STATS *Stats)
+{
+    FSW_VOLUME_DATA     *Volume = FSW_VOLUME_FROM_STATS(This);
+    struct fsw_volume_stats *vs;
+    UINTN               i;
+
+    if (Stats == NULL)
+        return EFI_INVALID_PARAMETER;
+
+    vs = &Volume->vol->stats;
+    ZeroMem(Stats, sizeof(FSW_VOLUME_STATS));
+    Stats->BcacheLookups     = vs->bcache_lookups;
+    Stats->BcacheHits        = vs->bcache_hits;
+    Stats->BcacheMisses      = vs->bcache_misses;
+    for (i = 0; i < FSW_VOLUME_STATS_LEVELS && i <= FSW_MAX_CACHE_LEVEL; i++)
+        Stats->BcacheEvictions[i] = vs->bcache_evictions[i];
+    Stats->DeviceCalls       = vs->device_calls;
+    Stats->BytesRead         = vs->bytes_read;
+    Stats->ReadTicks         = vs->read_ticks;
+    Stats->HostCacheHits     = vs->host_cache_hits;
+    Stats->HostCacheMisses   = vs->host_cache_misses;
+    Stats->DriverCacheHits   = vs->drv_cache_hits;
+    Stats->DriverCacheMisses = vs->drv_cache_misses;
+
+    return EFI_SUCCESS;
+}
+
 /**
  * File Handle EFI protocol, Open function. Dispatches the call
  * based on the kind of file handle.
@@ -673,7 +1123,16 @@ EFI_STATUS EFIAPI fsw_efi_FileHandle_Close(IN EFI_FILE_PROTOCOL *This)
     Print(L"fsw_efi_FileHandle_Close\n");
 #endif
 
+#if FSW_EFI_TRACE
+    // loaders close a file when they have read it, so this is a good time to save the trace
+    if (File->Type == FSW_EFI_FILE_TYPE_FILE)
+        fsw_efi_trace_flush();
+#endif
+
+    fsw_efi_dir_release_batch(File);
     fsw_shandle_close(&File->shand);
+    if (File->DirBatch != NULL)
+        FreePool(File->DirBatch);
     FreePool(File);
 
     return EFI_SUCCESS;
@@ -777,8 +1236,10 @@ EFI_STATUS EFIAPI fsw_efi_FileHandle_GetInfo(IN EFI_FILE_PROTOCOL *This,
 }
 
 /**
- * File Handle EFI protocol, SetInfo function. Returns unsupported status
- * because this driver is read-only.
+ * File Handle EFI protocol, SetInfo function. Returns write-protected status
+ * because this driver is read-only. The only exception is the vendor type
+ * FSW_DIR_ENTRY_INFO_ID, which switches a directory handle between full
+ * and names-only directory reads.
  */
 
 EFI_STATUS EFIAPI fsw_efi_FileHandle_SetInfo(IN EFI_FILE_PROTOCOL *This,
@@ -786,6 +1247,15 @@ EFI_STATUS EFIAPI fsw_efi_FileHandle_SetInfo(IN EFI_FILE_PROTOCOL *This,
                                              IN UINTN BufferSize,
                                              IN VOID *Buffer)
 {
+    FSW_FILE_DATA      *File = FSW_FILE_FROM_FILE_HANDLE(This);
+
+    if (File->Type == FSW_EFI_FILE_TYPE_DIR && CompareGuid(InformationType, &gFswDirEntryInfoGuid)) {
+        if (BufferSize < sizeof(BOOLEAN) || Buffer == NULL)
+            return EFI_BAD_BUFFER_SIZE;
+        File->DirLazyInfo = *(BOOLEAN *)Buffer ? TRUE : FALSE;
+        return EFI_SUCCESS;
+    }
+
     // this driver is read-only
     return EFI_WRITE_PROTECTED;
 }
@@ -865,14 +1335,24 @@ EFI_STATUS fsw_efi_file_read(IN FSW_FILE_DATA *File,
 {
     EFI_STATUS          Status;
     fsw_u32             buffer_size;
+    struct fsw_dnode    *dno;
 
 #if DEBUG_LEVEL
     Print(L"fsw_efi_file_read %d bytes\n", *BufferSize);
 #endif
 
     buffer_size = (fsw_u32)*BufferSize;
+
+    // A read that covers most of a large file, like LoadImage pulling in a kernel,
+    // gets all of its extents mapped first so it is streamed in as few device
+    // reads as possible. Mapping errors show up again in the read itself.
+    dno = File->shand.dnode;
+    if (dno->size >= FSW_EFI_WHOLE_FILE_MIN && File->shand.pos < dno->size &&
+        buffer_size >= dno->size / 2)
+        fsw_shandle_map(&File->shand, File->shand.pos, buffer_size);
+
     Status = fsw_efi_map_status(fsw_shandle_read(&File->shand, &buffer_size, Buffer),
-                                (FSW_VOLUME_DATA *)File->shand.dnode->vol->host_data);
+                                (FSW_VOLUME_DATA *)dno->vol->host_data);
     *BufferSize = buffer_size;
 
     return Status;
@@ -955,7 +1435,11 @@ EFI_STATUS fsw_efi_dir_open(IN FSW_FILE_DATA *File,
 
 /**
  * Read function for directories. A file handle read on a directory retrieves
- * the next directory entry.
+ * the next directory entry. Entries are decoded a batch at a time by
+ * fsw_efi_dir_fill_batch and handed out from the batch. An entry that doesn't
+ * fit into the caller's buffer stays in the batch, so the caller can retry
+ * with a larger buffer. An entry that couldn't be decoded is reported as an
+ * error in its turn, and the next read goes on with the entry after it.
  */
 
 EFI_STATUS fsw_efi_dir_read(IN FSW_FILE_DATA *File,
@@ -963,30 +1447,167 @@ EFI_STATUS fsw_efi_dir_read(IN FSW_FILE_DATA *File,
                             OUT VOID *Buffer)
 {
     EFI_STATUS          Status;
-    FSW_VOLUME_DATA     *Volume = (FSW_VOLUME_DATA *)File->shand.dnode->vol->host_data;
-    struct fsw_dnode    *dno;
+    EFI_FILE_INFO       *FileInfo;
 
 #if DEBUG_LEVEL
     Print(L"fsw_efi_dir_read...\n");
 #endif
 
-    // read the next entry
-    Status = fsw_efi_map_status(fsw_dnode_dir_read(&File->shand, &dno), Volume);
-    if (Status == EFI_NOT_FOUND) {
-        // end of directory
-        *BufferSize = 0;
+    if (File->DirBatchNext >= File->DirBatchCount) {
+        // decode the next entries, unless an error or the end is still to be reported
+        if (File->DirBatchStatus == EFI_SUCCESS)
+            fsw_efi_dir_fill_batch(File);
+        if (File->DirBatchNext >= File->DirBatchCount) {
+            Status = File->DirBatchStatus;
+            File->DirBatchStatus = EFI_SUCCESS;
+            if (Status == EFI_NOT_FOUND) {
+                // end of directory
+                *BufferSize = 0;
 #if DEBUG_LEVEL
-        Print(L"...no more entries\n");
+                Print(L"...no more entries\n");
 #endif
-        return EFI_SUCCESS;
+                return EFI_SUCCESS;
+            }
+            return Status;
+        }
     }
-    if (EFI_ERROR(Status))
+
+    // report an entry that couldn't be decoded and skip it
+    Status = File->DirBatchRecordStatus[File->DirBatchNext];
+    if (EFI_ERROR(Status)) {
+        File->DirBatchNext++;
         return Status;
+    }
 
-    // get info into buffer
-    Status = fsw_efi_dnode_fill_FileInfo(Volume, dno, BufferSize, Buffer);
-    fsw_dnode_release(dno);
-    return Status;
+    // copy the next record into the caller's buffer
+    FileInfo = (EFI_FILE_INFO *)(File->DirBatch + File->DirBatchPos);
+    if (*BufferSize < FileInfo->Size) {
+#if DEBUG_LEVEL
+        Print(L"...BUFFER TOO SMALL\n");
+#endif
+        *BufferSize = (UINTN) FileInfo->Size;
+        return EFI_BUFFER_TOO_SMALL;
+    }
+    *BufferSize = (UINTN) FileInfo->Size;
+    CopyMem(Buffer, FileInfo, *BufferSize);
+    File->DirBatchPos += DIR_BATCH_RECORD_SIZE(*BufferSize);
+    File->DirBatchNext++;
+#if DEBUG_LEVEL
+    Print(L"...returning '%s'\n", FileInfo->FileName);
+#endif
+    return EFI_SUCCESS;
+}
+
+/**
+ * Decode the next batch of directory entries into EFI_FILE_INFO records on the
+ * directory handle. The entries are read first, then their dnodes are filled in
+ * order of dnode ID, which is the order of the inodes on disk for most file
+ * systems, so the inode reads run through the disk in one direction and share
+ * blocks instead of jumping back and forth. The records stay in directory order.
+ *
+ * In names-only mode (File->DirLazyInfo), entries whose type is known from the
+ * directory itself get a short record without reading their inode at all.
+ *
+ * The end of the directory or a read error is remembered in DirBatchStatus and
+ * reported after the records decoded before it. An entry whose dnode can't be
+ * decoded gets its error in DirBatchRecordStatus instead of a record, and the
+ * following entries are decoded as usual. The dnodes stay on the handle until
+ * the next batch so that FSW_DIR_ENTRY_INFO_ID can fill in the rest of a record
+ * later.
+ */
+
+VOID fsw_efi_dir_fill_batch(IN FSW_FILE_DATA *File)
+{
+    EFI_STATUS          Status;
+    FSW_VOLUME_DATA     *Volume = (FSW_VOLUME_DATA *)File->shand.dnode->vol->host_data;
+    struct fsw_dnode    **Entries;
+    struct fsw_dnode    *Order[FSW_EFI_DIR_BATCH];
+    struct fsw_dnode    *dno;
+    EFI_FILE_INFO       *FileInfo;
+    UINTN               Count, FillCount, i, j, Needed, RecordSize;
+
+    fsw_efi_dir_release_batch(File);
+    Entries = File->DirBatchDnodes;
+
+    // read the next entries
+    for (Count = 0; Count < FSW_EFI_DIR_BATCH; Count++) {
+        Status = fsw_efi_map_status(fsw_dnode_dir_read(&File->shand, &Entries[Count]), Volume);
+        if (EFI_ERROR(Status)) {
+            File->DirBatchStatus = Status;
+            break;
+        }
+    }
+    File->DirBatchCount = Count;
+
+    // fill the dnodes in order of their IDs; errors show up again below
+    Needed = 0;
+    FillCount = 0;
+    for (i = 0; i < Count; i++) {
+        dno = Entries[i];
+        Needed += DIR_BATCH_RECORD_SIZE(SIZE_OF_EFI_FILE_INFO + fsw_efi_strsize(&dno->name));
+        if (File->DirLazyInfo && dno->type != FSW_DNODE_TYPE_UNKNOWN)
+            continue;
+        for (j = FillCount; j > 0 && Order[j - 1]->dnode_id > dno->dnode_id; j--)
+            Order[j] = Order[j - 1];
+        Order[j] = dno;
+        FillCount++;
+    }
+    for (i = 0; i < FillCount; i++)
+        fsw_dnode_fill(Order[i]);
+
+    // make room for the records
+    if (Needed > File->DirBatchAlloc) {
+        if (File->DirBatch != NULL)
+            FreePool(File->DirBatch);
+        File->DirBatchAlloc = 0;
+        File->DirBatch = AllocatePool(Needed);
+        if (File->DirBatch == NULL) {
+            File->DirBatchStatus = EFI_OUT_OF_RESOURCES;
+            fsw_efi_dir_release_batch(File);
+            return;
+        }
+        File->DirBatchAlloc = Needed;
+    }
+
+    // build the records in directory order
+    for (i = 0; i < Count; i++) {
+        dno = Entries[i];
+        File->DirBatchRecordStatus[i] = EFI_SUCCESS;
+        if (File->DirLazyInfo && dno->type != FSW_DNODE_TYPE_UNKNOWN) {
+            // names-only record
+            FileInfo = (EFI_FILE_INFO *)(File->DirBatch + File->DirBatchSize);
+            RecordSize = SIZE_OF_EFI_FILE_INFO + fsw_efi_strsize(&dno->name);
+            ZeroMem(FileInfo, RecordSize);
+            FileInfo->Size = RecordSize;
+            if (dno->type == FSW_DNODE_TYPE_DIR)
+                FileInfo->Attribute = EFI_FILE_DIRECTORY;
+            fsw_efi_strcpy(FileInfo->FileName, &dno->name);
+        } else {
+            RecordSize = File->DirBatchAlloc - File->DirBatchSize;
+            Status = fsw_efi_dnode_fill_FileInfo(Volume, dno, &RecordSize, File->DirBatch + File->DirBatchSize);
+            if (EFI_ERROR(Status)) {
+                File->DirBatchRecordStatus[i] = Status;
+                continue;
+            }
+        }
+        File->DirBatchSize += DIR_BATCH_RECORD_SIZE(RecordSize);
+    }
+}
+
+/**
+ * Release the dnodes of the current directory batch and forget its records.
+ */
+
+VOID fsw_efi_dir_release_batch(IN FSW_FILE_DATA *File)
+{
+    UINTN               i;
+
+    for (i = 0; i < File->DirBatchCount; i++)
+        fsw_dnode_release(File->DirBatchDnodes[i]);
+    File->DirBatchCount = 0;
+    File->DirBatchNext = 0;
+    File->DirBatchSize = 0;
+    File->DirBatchPos = 0;
 }
 
 /**
@@ -999,6 +1620,8 @@ EFI_STATUS fsw_efi_dir_setpos(IN FSW_FILE_DATA *File, IN UINT64 Position)
 {
     if (Position == 0) {
         File->shand.pos = 0;
+        fsw_efi_dir_release_batch(File);
+        File->DirBatchStatus = EFI_SUCCESS;
         return EFI_SUCCESS;
     } else {
         // directories can only rewind to the start
@@ -1081,6 +1704,16 @@ EFI_STATUS fsw_efi_dnode_getinfo(IN FSW_FILE_DATA *File,
         *BufferSize = RequiredSize;
         Status = EFI_SUCCESS;
 
+    } else if (CompareGuid(InformationType, &gFswDirEntryInfoGuid)) {
+#if DEBUG_LEVEL
+        Print(L"fsw_efi_dnode_getinfo: DIR_ENTRY_INFO\n");
+#endif
+
+        // full information on the entry last returned by Read()
+        if (File->Type != FSW_EFI_FILE_TYPE_DIR || File->DirBatchNext == 0)
+            return EFI_NOT_FOUND;
+        Status = fsw_efi_dnode_fill_FileInfo(Volume, File->DirBatchDnodes[File->DirBatchNext - 1], BufferSize, Buffer);
+
     } else {
         Status = EFI_UNSUPPORTED;
     }
@@ -1151,8 +1784,6 @@ EFI_STATUS fsw_efi_dnode_fill_FileInfo(IN FSW_VOLUME_DATA *Volume,
     // check buffer size
     RequiredSize = SIZE_OF_EFI_FILE_INFO + fsw_efi_strsize(&dno->name);
     if (*BufferSize < RequiredSize) {
-        // TODO: wind back the directory in this case
-
 #if DEBUG_LEVEL
         Print(L"...BUFFER TOO SMALL\n");
 #endif
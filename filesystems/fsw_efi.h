@@ -40,6 +40,9 @@
 
 #include "fsw_core.h"
 #include "../include/refit_call_wrapper.h"
+#include "../include/fsw_stats.h"
+#include "../include/fsw_dir_info.h"
+#include "fsw_trace.h"
 
 #ifdef __MAKEWITH_GNUEFI
 #define CompareGuid(a, b) CompareGuid(a, b)==0
@@ -55,6 +58,106 @@
     0x964e5b21, 0x6459, 0x11d2, {0x8e, 0x39, 0x0, 0xa0, 0xc9, 0x69, 0x72, 0x3b } \
   }
 
+#define REFIND_EFI_DISK_IO2_PROTOCOL_GUID \
+  { \
+    0x151c8eae, 0x7f2c, 0x472c, {0x9e, 0x54, 0x98, 0x28, 0x19, 0x4f, 0x6a, 0x88 } \
+  }
+
+/**
+ * EFI Host: Disk I/O 2 protocol (UEFI 2.4), declared here because not all toolkits
+ * provide it. Only asynchronous reads are used.
+ */
+
+typedef struct {
+    EFI_EVENT                   Event;              //!< Signalled when the request is done; NULL for a blocking request
+    EFI_STATUS                  TransactionStatus;  //!< Result of the request
+} REFIND_EFI_DISK_IO2_TOKEN;
+
+typedef struct _REFIND_EFI_DISK_IO2_PROTOCOL REFIND_EFI_DISK_IO2_PROTOCOL;
+
+typedef
+EFI_STATUS
+(EFIAPI *REFIND_EFI_DISK_CANCEL_EX) (
+    IN REFIND_EFI_DISK_IO2_PROTOCOL     *This
+);
+
+typedef
+EFI_STATUS
+(EFIAPI *REFIND_EFI_DISK_READ_EX) (
+    IN REFIND_EFI_DISK_IO2_PROTOCOL     *This,
+    IN UINT32                           MediaId,
+    IN UINT64                           Offset,
+    IN OUT REFIND_EFI_DISK_IO2_TOKEN    *Token,
+    IN UINTN                            BufferSize,
+    OUT VOID                            *Buffer
+);
+
+struct _REFIND_EFI_DISK_IO2_PROTOCOL {
+    UINT64                      Revision;
+    REFIND_EFI_DISK_CANCEL_EX   Cancel;
+    REFIND_EFI_DISK_READ_EX     ReadDiskEx;
+    VOID                        *WriteDiskEx;   // not used
+    VOID                        *FlushDiskEx;   // not used
+};
+
+#ifndef FSW_EFI_ASYNC_READS
+/** Number of asynchronous reads a volume can have in flight; further reads are done synchronously. */
+#define FSW_EFI_ASYNC_READS (2*FSW_READ_REQUESTS)
+#endif
+
+/**
+ * EFI Host: One slot for an asynchronous read. The slot address is the request handle
+ * passed to the FSW core.
+ */
+
+typedef struct {
+    REFIND_EFI_DISK_IO2_TOKEN   Token;          //!< Token passed to ReadDiskEx; the event is created on first use
+    BOOLEAN                     InUse;          //!< Set while the read is in flight
+} FSW_EFI_ASYNC_READ;
+
+#ifndef FSW_EFI_DIR_BATCH
+/** Number of directory entries decoded at a time by a directory handle. */
+#define FSW_EFI_DIR_BATCH (32)
+#endif
+
+#ifndef FSW_EFI_WHOLE_FILE_MIN
+/** Minimum file size in bytes for mapping all extents up front when a read covers most of the file. */
+#define FSW_EFI_WHOLE_FILE_MIN (256*1024)
+#endif
+
+#ifndef FSW_EFI_TRACE
+/** Set to 1 to record the read requests of all volumes into a trace file (see fsw_trace.h). */
+#define FSW_EFI_TRACE (0)
+#endif
+#ifndef FSW_EFI_TRACE_RECORDS
+/** Number of trace records buffered in memory before they are written out. */
+#define FSW_EFI_TRACE_RECORDS (4096)
+#endif
+
+#ifndef FSW_EFI_CACHE_WINDOW_SHIFT
+/** Size of a read cache window as a power of 2 (default 128 KiB). */
+#define FSW_EFI_CACHE_WINDOW_SHIFT (17)
+#endif
+#ifndef FSW_EFI_CACHE_SETS
+/** Number of sets in the per-volume read cache (power of 2). */
+#define FSW_EFI_CACHE_SETS (4)
+#endif
+#ifndef FSW_EFI_CACHE_WAYS
+/** Number of windows per set in the per-volume read cache. */
+#define FSW_EFI_CACHE_WAYS (2)
+#endif
+
+/**
+ * EFI Host: One window of the per-volume read cache.
+ */
+
+typedef struct {
+    UINT8                       *Data;          //!< Window buffer, allocated on first use
+    UINT64                      Start;          //!< Disk offset of the window, aligned to the window size
+    UINTN                       Size;           //!< Valid bytes in the window, 0 if unused
+    UINT64                      LastUse;        //!< Value of the volume's cache clock at the last hit
+} FSW_EFI_CACHE_WINDOW;
+
 /**
  * EFI Host: Private per-volume structure.
  */
@@ -63,11 +166,22 @@ typedef struct {
     UINT64                      Signature;      //!< Used to identify this structure
 
     EFI_FILE_IO_INTERFACE       FileSystem;     //!< Published EFI protocol interface structure
+    FSW_VOLUME_STATS_PROTOCOL   Stats;          //!< Published statistics protocol interface structure
 
     EFI_HANDLE                  Handle;         //!< The device handle the protocol is attached to
     EFI_DISK_IO                 *DiskIo;        //!< The Disk I/O protocol we use for disk access
+    REFIND_EFI_DISK_IO2_PROTOCOL *DiskIo2;      //!< The Disk I/O 2 protocol for asynchronous reads, NULL if not available
     UINT32                      MediaId;        //!< The media ID from the Block I/O protocol
     EFI_STATUS                  LastIOStatus;   //!< Last status from Disk I/O
+    UINT64                      DiskSize;       //!< Size of the device in bytes
+
+    FSW_EFI_CACHE_WINDOW        Cache[FSW_EFI_CACHE_SETS * FSW_EFI_CACHE_WAYS];    //!< Read cache, one row of ways per set
+    UINT64                      CacheClock;     //!< Use counter for LRU replacement in the read cache
+    FSW_EFI_ASYNC_READ          AsyncReads[FSW_EFI_ASYNC_READS];    //!< Slots for reads through DiskIo2
+
+#if FSW_EFI_TRACE
+    UINT8                       TraceVolume;    //!< Volume number used in the trace records
+#endif
 
     struct fsw_volume           *vol;           //!< FSW volume structure
 
@@ -77,6 +191,8 @@ typedef struct {
 #define FSW_VOLUME_DATA_SIGNATURE  EFI_SIGNATURE_32 ('f', 's', 'w', 'V')
 /** Access macro for the volume structure. */
 #define FSW_VOLUME_FROM_FILE_SYSTEM(a)  CR (a, FSW_VOLUME_DATA, FileSystem, FSW_VOLUME_DATA_SIGNATURE)
+/** Access macro for the volume structure from the statistics protocol. */
+#define FSW_VOLUME_FROM_STATS(a)  CR (a, FSW_VOLUME_DATA, Stats, FSW_VOLUME_DATA_SIGNATURE)
 
 /**
  * EFI Host: Private structure for a EFI_FILE_PROTOCOL interface.
@@ -90,6 +206,17 @@ typedef struct {
     UINT64                       Type;           //!< File type used for dispatching
     struct fsw_shandle          shand;          //!< FSW handle for this file
 
+    UINT8                       *DirBatch;      //!< Directories: EFI_FILE_INFO records decoded ahead, NULL if none yet
+    UINTN                       DirBatchAlloc;  //!< Allocated size of DirBatch
+    UINTN                       DirBatchSize;   //!< Bytes of records in DirBatch
+    UINTN                       DirBatchPos;    //!< Offset of the next record to return
+    EFI_STATUS                  DirBatchStatus; //!< Status to return once the records are used up
+    struct fsw_dnode            *DirBatchDnodes[FSW_EFI_DIR_BATCH]; //!< Dnodes of the records in DirBatch, kept for FSW_DIR_ENTRY_INFO_ID
+    UINTN                       DirBatchCount;  //!< Number of dnodes in DirBatchDnodes
+    UINTN                       DirBatchNext;   //!< Index of the next record to return
+    EFI_STATUS                  DirBatchRecordStatus[FSW_EFI_DIR_BATCH];   //!< Error for each entry that couldn't be decoded; such entries have no record in DirBatch
+    BOOLEAN                     DirLazyInfo;    //!< Set when Read() returns names only (see fsw_dir_info.h)
+
 } FSW_FILE_DATA;
 
 /** File type: regular file. */
@@ -111,6 +238,7 @@ VOID fsw_efi_decode_time(OUT EFI_TIME *EfiTime, IN UINT32 UnixTime);
 
 UINTN fsw_efi_strsize(struct fsw_string *s);
 VOID fsw_efi_strcpy(CHAR16 *Dest, struct fsw_string *src);
-VOID EFIAPI fsw_efi_clear_cache(VOID);
+VOID fsw_efi_clear_cache(IN FSW_VOLUME_DATA *Volume, IN BOOLEAN FreeBuffers);
+VOID fsw_efi_close_async_reads(IN FSW_VOLUME_DATA *Volume);
 
 #endif
@@ -84,6 +84,12 @@ typedef UINT64  fsw_u64;
 #define FSW_MSGSTR(s) L##s
 #define FSW_MSGFUNC Print
 
+// time stamps for I/O statistics, in CPU cycles where the compiler can read them
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FSW_TICKS() __builtin_ia32_rdtsc()
+#endif
+
 // 64-bit hooks
 
 #define FSW_U64_SHR(val,shiftbits) RShiftU64((val), (shiftbits))
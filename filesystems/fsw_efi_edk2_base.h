@@ -44,6 +44,7 @@
 # include <Library/DebugLib.h>
 # include <Library/BaseLib.h>
 # include <Protocol/DriverBinding.h>
+# include <Protocol/LoadedImage.h>
 # include <Library/BaseMemoryLib.h>
 # include <Library/UefiRuntimeServicesTableLib.h>
 # include <Library/UefiDriverEntryPoint.h>
@@ -42,6 +42,7 @@ static fsw_status_t fsw_ext2_dir_lookup(struct fsw_ext2_volume *vol, struct fsw_
 static fsw_status_t fsw_ext2_dir_read(struct fsw_ext2_volume *vol, struct fsw_ext2_dnode *dno,
                                       struct fsw_shandle *shand, struct fsw_ext2_dnode **child_dno);
 static fsw_status_t fsw_ext2_read_dentry(struct fsw_shandle *shand, struct ext2_dir_entry *entry);
+static int          fsw_ext2_dentry_type(struct fsw_ext2_volume *vol, struct ext2_dir_entry *entry);
 
 static fsw_status_t fsw_ext2_readlink(struct fsw_ext2_volume *vol, struct fsw_ext2_dnode *dno,
                                       struct fsw_string *link);
@@ -242,8 +243,13 @@ static fsw_status_t fsw_ext2_dnode_fill(struct fsw_ext2_volume *vol, struct fsw_
 
 static void fsw_ext2_dnode_free(struct fsw_ext2_volume *vol, struct fsw_ext2_dnode *dno)
 {
+    int             i;
+
     if (dno->raw)
         fsw_free(dno->raw);
+    for (i = 0; i < 3; i++)
+        if (dno->ind_block[i])
+            fsw_free(dno->ind_block[i]);
 }
 
 /**
@@ -266,33 +272,45 @@ static fsw_status_t fsw_ext2_dnode_stat(struct fsw_ext2_volume *vol, struct fsw_
 }
 
 /**
- * Retrieve file data mapping information. This function is called by the core when
- * fsw_shandle_read needs to know where on the disk the required piece of the file's
- * data can be found. The core makes sure that fsw_ext2_dnode_fill has been called
- * on the dnode before. Our task here is to get the physical disk block number for
- * the requested logical block number.
- *
- * The ext2 file system does not use extents, but stores a list of block numbers
- * using the usual direct, indirect, double-indirect, triple-indirect scheme. To
- * optimize access, this function checks if the following file blocks are mapped
- * to consecutive disk blocks and returns a combined extent if possible.
+ * Get an indirect block for the mapping path. step is the position in the path. The
+ * dnode keeps a copy of the block used last at each step, so mapping neighbouring
+ * blocks doesn't go back to the block cache.
  */
 
-static fsw_status_t fsw_ext2_get_extent(struct fsw_ext2_volume *vol, struct fsw_ext2_dnode *dno,
-                                        struct fsw_extent *extent)
+static fsw_status_t fsw_ext2_ind_block_get(struct fsw_ext2_volume *vol, struct fsw_ext2_dnode *dno,
+                                           int step, fsw_u32 bno, fsw_u32 **buffer_out)
 {
     fsw_status_t    status;
-    fsw_u32         bno, release_bno, buf_bcnt, file_bcnt;
-    fsw_u32         *buffer;
-    int             path[5], i;
+    void            *buffer;
 
-    // Preconditions: The caller has checked that the requested logical block
-    //  is within the file's size. The dnode has complete information, i.e.
-    //  fsw_ext2_dnode_read_info was called successfully on it.
+    if (dno->ind_bno[step] != bno) {
+        if (dno->ind_block[step] == NULL) {
+            status = fsw_alloc(vol->g.phys_blocksize, &dno->ind_block[step]);
+            if (status)
+                return status;
+        }
+        status = fsw_block_get(vol, bno, 1, &buffer);
+        if (status)
+            return status;
+        fsw_memcpy(dno->ind_block[step], buffer, vol->g.phys_blocksize);
+        fsw_block_release(vol, bno, buffer);
+        dno->ind_bno[step] = bno;
+    }
+    *buffer_out = dno->ind_block[step];
+    return FSW_SUCCESS;
+}
 
-    extent->type = FSW_EXTENT_TYPE_PHYSBLOCK;
-    extent->log_count = 1;
-    bno = extent->log_start;
+/**
+ * Map one logical block through the direct, indirect, double-indirect and
+ * triple-indirect block pointers. *phys_bno_out is set to 0 if the block is in a hole.
+ */
+
+static fsw_status_t fsw_ext2_map_block(struct fsw_ext2_volume *vol, struct fsw_ext2_dnode *dno,
+                                       fsw_u32 bno, fsw_u32 *phys_bno_out)
+{
+    fsw_status_t    status;
+    fsw_u32         *buffer;
+    int             path[5], i;
 
     // try direct block pointers in the inode
     if (bno < EXT2_NDIR_BLOCKS) {
@@ -330,41 +348,62 @@ static fsw_status_t fsw_ext2_get_extent(struct fsw_ext2_volume *vol, struct fsw_
 
     // follow the indirection path
     buffer = dno->raw->i_block;
-    buf_bcnt = EXT2_NDIR_BLOCKS;
-    release_bno = 0;
     for (i = 0; ; i++) {
         bno = buffer[path[i]];
-        if (bno == 0) {
-            extent->type = FSW_EXTENT_TYPE_SPARSE;
-            if (release_bno)
-                fsw_block_release(vol, release_bno, buffer);
-            return FSW_SUCCESS;
-        }
-        if (path[i+1] < 0)
+        if (bno == 0 || path[i+1] < 0)
             break;
-
-        if (release_bno)
-            fsw_block_release(vol, release_bno, buffer);
-        status = fsw_block_get(vol, bno, 1, (void **)&buffer);
+        status = fsw_ext2_ind_block_get(vol, dno, i, bno, &buffer);
         if (status)
             return status;
-        release_bno = bno;
-        buf_bcnt = vol->ind_bcnt;
     }
-    extent->phys_start = bno;
-
-    // check if the following blocks can be aggregated into one extent
-    file_bcnt = (fsw_u32)((dno->g.size + vol->g.log_blocksize - 1) & (vol->g.log_blocksize - 1));
-    while (path[i]           + extent->log_count < buf_bcnt &&    // indirect block has more block pointers
-           extent->log_start + extent->log_count < file_bcnt) {   // file has more blocks
-        if (buffer[path[i] + extent->log_count] == buffer[path[i] + extent->log_count - 1] + 1)
-            extent->log_count++;
-        else
+    *phys_bno_out = bno;
+    return FSW_SUCCESS;
+}
+
+/**
+ * Retrieve file data mapping information. This function is called by the core when
+ * fsw_shandle_read needs to know where on the disk the required piece of the file's
+ * data can be found. The core makes sure that fsw_ext2_dnode_fill has been called
+ * on the dnode before. Our task here is to get the physical disk block number for
+ * the requested logical block number.
+ *
+ * The ext2 file system does not use extents, but stores a list of block numbers
+ * using the usual direct, indirect, double-indirect, triple-indirect scheme. To
+ * optimize access, this function checks if the following file blocks are mapped
+ * to consecutive disk blocks and returns a combined extent if possible.
+ */
+
+static fsw_status_t fsw_ext2_get_extent(struct fsw_ext2_volume *vol, struct fsw_ext2_dnode *dno,
+                                        struct fsw_extent *extent)
+{
+    fsw_status_t    status;
+    fsw_u32         bno, phys_bno, next_bno, file_bcnt;
+
+    // Preconditions: The caller has checked that the requested logical block
+    //  is within the file's size. The dnode has complete information, i.e.
+    //  fsw_ext2_dnode_read_info was called successfully on it.
+
+    extent->type = FSW_EXTENT_TYPE_PHYSBLOCK;
+    extent->log_count = 1;
+    bno = extent->log_start;
+    status = fsw_ext2_map_block(vol, dno, bno, &phys_bno);
+    if (status)
+        return status;
+    if (phys_bno == 0)
+        extent->type = FSW_EXTENT_TYPE_SPARSE;
+    extent->phys_start = phys_bno;
+
+    // aggregate the following blocks as long as they continue the extent on disk, or
+    //  the hole, also across indirect block boundaries
+    file_bcnt = (fsw_u32)FSW_U64_DIV(dno->g.size + vol->g.log_blocksize - 1, vol->g.log_blocksize);
+    while (bno + extent->log_count < file_bcnt) {
+        if (fsw_ext2_map_block(vol, dno, bno + extent->log_count, &next_bno) != FSW_SUCCESS)
+            break;
+        if (phys_bno == 0 ? next_bno != 0 : next_bno != phys_bno + extent->log_count)
             break;
+        extent->log_count++;
     }
 
-    if (release_bno)
-        fsw_block_release(vol, release_bno, buffer);
     return FSW_SUCCESS;
 }
 
@@ -463,11 +502,39 @@ static fsw_status_t fsw_ext2_dir_read(struct fsw_ext2_volume *vol, struct fsw_ex
     entry_name.data = entry.name;
 
     // setup a dnode for the child item
-    status = fsw_dnode_create(dno, entry.inode, FSW_DNODE_TYPE_UNKNOWN, &entry_name, child_dno_out);
+    status = fsw_dnode_create(dno, entry.inode, fsw_ext2_dentry_type(vol, &entry), &entry_name, child_dno_out);
 
     return status;
 }
 
+/**
+ * Get the dnode type recorded in a directory entry. This lets the host tell files from
+ * directories without reading the inode. Returns FSW_DNODE_TYPE_UNKNOWN if the file
+ * system doesn't store types in directory entries.
+ */
+
+static int fsw_ext2_dentry_type(struct fsw_ext2_volume *vol, struct ext2_dir_entry *entry)
+{
+    if ((vol->sb->s_feature_incompat & EXT2_FEATURE_INCOMPAT_FILETYPE) == 0)
+        return FSW_DNODE_TYPE_UNKNOWN;
+
+    switch (entry->file_type) {
+        case EXT2_FT_REG_FILE:
+            return FSW_DNODE_TYPE_FILE;
+        case EXT2_FT_DIR:
+            return FSW_DNODE_TYPE_DIR;
+        case EXT2_FT_SYMLINK:
+            return FSW_DNODE_TYPE_SYMLINK;
+        case EXT2_FT_CHRDEV:
+        case EXT2_FT_BLKDEV:
+        case EXT2_FT_FIFO:
+        case EXT2_FT_SOCK:
+            return FSW_DNODE_TYPE_SPECIAL;
+        default:
+            return FSW_DNODE_TYPE_UNKNOWN;
+    }
+}
+
 /**
  * Read a directory entry from the directory's raw data. This internal function is used
  * to read a raw ext2 directory entry into memory. The shandle's position pointer is adjusted
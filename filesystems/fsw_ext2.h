@@ -59,6 +59,8 @@ struct fsw_ext2_dnode {
     struct fsw_dnode g;             //!< Generic dnode structure
     
     struct ext2_inode *raw;         //!< Full raw inode structure
+    fsw_u32     *ind_block[3];      //!< Copy of the indirect block read last at each step of the mapping path
+    fsw_u32     ind_bno[3];         //!< Block number of each copy in ind_block, 0 if none
 };
 
 
@@ -23,6 +23,7 @@
  */
 
 #include "fsw_ext4.h"
+#include "crc32c.c"
 
 
 // functions
@@ -47,6 +48,10 @@ static fsw_status_t fsw_ext4_dir_lookup(struct fsw_ext4_volume *vol, struct fsw_
 static fsw_status_t fsw_ext4_dir_read(struct fsw_ext4_volume *vol, struct fsw_ext4_dnode *dno,
                                       struct fsw_shandle *shand, struct fsw_ext4_dnode **child_dno);
 static fsw_status_t fsw_ext4_read_dentry(struct fsw_shandle *shand, struct ext4_dir_entry *entry);
+static fsw_status_t fsw_ext4_dx_lookup(struct fsw_ext4_volume *vol, struct fsw_ext4_dnode *dno,
+                                       struct fsw_string *lookup_name, struct ext4_dir_entry *entry);
+static int          fsw_ext4_dentry_type(struct fsw_ext4_volume *vol, struct ext4_dir_entry *entry);
+static void         fsw_ext4_inode_prefetch(struct fsw_ext4_volume *vol, struct fsw_ext4_dnode *dir, fsw_u32 lblock);
 
 static fsw_status_t fsw_ext4_readlink(struct fsw_ext4_volume *vol, struct fsw_ext4_dnode *dno,
                                       struct fsw_string *link);
@@ -100,6 +105,156 @@ fsw_ext4_group_first_block_no(struct ext4_super_block *sb, fsw_u32 group_no)
                 sb->s_first_data_block;
 }
 
+//
+// Metadata checksums (metadata_csum feature)
+//
+
+//! Byte offset of a field in an on-disk structure.
+#define EXT4_CSUM_OFFSET(base, field) ((fsw_u32)((fsw_u8 *)&(base)->field - (fsw_u8 *)(base)))
+
+/**
+ * Continue a metadata checksum over a 32-bit value, e.g. a group or inode number.
+ */
+
+static fsw_u32 fsw_ext4_csum_u32(fsw_u32 crc, fsw_u32 value)
+{
+    return crc32c_update(crc, &value, sizeof(value));
+}
+
+/**
+ * Check the superblock's checksum. The checksum covers everything before it.
+ */
+
+static int fsw_ext4_superblock_csum_valid(struct ext4_super_block *sb)
+{
+    return crc32c_update(0xFFFFFFFF, sb, EXT4_CSUM_OFFSET(sb, s_checksum)) == sb->s_checksum;
+}
+
+/**
+ * Check a block group descriptor's checksum. It covers the group number and the
+ * descriptor with the checksum field taken as zero, and only its low 16 bits are stored.
+ */
+
+static int fsw_ext4_gdesc_csum_valid(struct fsw_ext4_volume *vol, fsw_u32 groupno,
+                                     struct ext4_group_desc *gdesc)
+{
+    fsw_u32         crc, offset;
+    fsw_u16         zero = 0;
+
+    offset = EXT4_CSUM_OFFSET(gdesc, bg_checksum);
+    crc = fsw_ext4_csum_u32(vol->csum_seed, groupno);
+    crc = crc32c_update(crc, gdesc, offset);
+    crc = crc32c_update(crc, &zero, sizeof(zero));
+    offset += sizeof(zero);
+    if (offset < vol->sb->s_desc_size)
+        crc = crc32c_update(crc, (fsw_u8 *)gdesc + offset, vol->sb->s_desc_size - offset);
+    return (crc & 0xFFFF) == gdesc->bg_checksum;
+}
+
+/**
+ * Check an inode's checksum. The checksum is split into a low half in the base inode
+ * and a high half in the extra fields, if they are large enough to hold it. Both
+ * halves are taken as zero while computing it.
+ */
+
+static int fsw_ext4_inode_csum_valid(struct fsw_ext4_volume *vol, struct fsw_ext4_dnode *dno)
+{
+    struct ext4_inode *raw = dno->raw;
+    fsw_u32         crc, offset, provided;
+    fsw_u16         zero = 0;
+    int             has_hi;
+
+    has_hi = vol->inode_size > EXT4_GOOD_OLD_INODE_SIZE &&
+        EXT4_GOOD_OLD_INODE_SIZE + raw->i_extra_isize >= EXT4_CSUM_OFFSET(raw, i_checksum_hi) + sizeof(zero);
+
+    offset = EXT4_CSUM_OFFSET(raw, osd2.linux2.l_i_checksum_lo);
+    crc = crc32c_update(dno->csum_seed, raw, offset);
+    crc = crc32c_update(crc, &zero, sizeof(zero));
+    offset += sizeof(zero);
+    crc = crc32c_update(crc, (fsw_u8 *)raw + offset, EXT4_GOOD_OLD_INODE_SIZE - offset);
+    if (vol->inode_size > EXT4_GOOD_OLD_INODE_SIZE) {
+        offset = EXT4_CSUM_OFFSET(raw, i_checksum_hi);
+        crc = crc32c_update(crc, (fsw_u8 *)raw + EXT4_GOOD_OLD_INODE_SIZE, offset - EXT4_GOOD_OLD_INODE_SIZE);
+        if (has_hi) {
+            crc = crc32c_update(crc, &zero, sizeof(zero));
+            offset += sizeof(zero);
+        }
+        crc = crc32c_update(crc, (fsw_u8 *)raw + offset, vol->inode_size - offset);
+    }
+
+    provided = raw->osd2.linux2.l_i_checksum_lo;
+    if (has_hi)
+        provided |= (fsw_u32)raw->i_checksum_hi << 16;
+    else
+        crc &= 0xFFFF;
+    return crc == provided;
+}
+
+/**
+ * Check the checksum of an extent tree block. It follows the last possible entry of
+ * the node.
+ */
+
+static int fsw_ext4_extent_block_csum_valid(struct fsw_ext4_volume *vol, struct fsw_ext4_dnode *dno,
+                                            struct ext4_extent_header *header)
+{
+    fsw_u32         offset;
+    struct ext4_extent_tail *tail;
+
+    offset = sizeof(struct ext4_extent_header) + header->eh_max * sizeof(struct ext4_extent);
+    if (offset + sizeof(struct ext4_extent_tail) > vol->g.phys_blocksize)
+        return 0;
+    tail = (struct ext4_extent_tail *)((fsw_u8 *)header + offset);
+    return crc32c_update(dno->csum_seed, header, offset) == tail->et_checksum;
+}
+
+/**
+ * Check the checksum of a directory block. Blocks of entries end in a fake entry
+ * holding the checksum of the block. Index blocks, i.e. the root of a hash-indexed
+ * directory and the nodes below it, instead have it after their last possible index
+ * entry. It covers the entries in use and the tail, with the checksum taken as zero.
+ */
+
+static int fsw_ext4_dir_block_csum_valid(struct fsw_ext4_volume *vol, struct fsw_ext4_dnode *dno,
+                                         fsw_u8 *buffer)
+{
+    fsw_u32         blocksize = vol->g.phys_blocksize;
+    fsw_u32         count_offset, crc, zero = 0;
+    struct ext4_dir_entry_tail *tail;
+    struct ext4_dir_entry *de;
+    struct ext4_dx_countlimit *countlimit;
+    struct ext4_dx_tail *dx_tail;
+
+    tail = (struct ext4_dir_entry_tail *)(buffer + blocksize - sizeof(struct ext4_dir_entry_tail));
+    if (tail->det_reserved_zero1 == 0 && tail->det_rec_len == sizeof(struct ext4_dir_entry_tail) &&
+        tail->det_reserved_zero2 == 0 && tail->det_reserved_ft == EXT4_DIR_TAIL_FT)
+        return crc32c_update(dno->csum_seed, buffer, blocksize - sizeof(struct ext4_dir_entry_tail)) ==
+            tail->det_checksum;
+
+    de = (struct ext4_dir_entry *)buffer;
+    if (de->inode == 0 && de->rec_len == blocksize) {
+        // dx_node, an empty entry spanning the block
+        count_offset = 8;
+    } else if (de->rec_len == 12 &&
+               ((struct ext4_dir_entry *)(buffer + 12))->rec_len == blocksize - 12 &&
+               ((struct ext4_dx_root_info *)(buffer + 24))->info_length == sizeof(struct ext4_dx_root_info)) {
+        // dx_root, the info follows the "." and ".." entries
+        count_offset = 24 + sizeof(struct ext4_dx_root_info);
+    } else {
+        return 0;
+    }
+
+    countlimit = (struct ext4_dx_countlimit *)(buffer + count_offset);
+    if (countlimit->count > countlimit->limit ||
+        count_offset + countlimit->limit * sizeof(struct ext4_dx_entry) + sizeof(struct ext4_dx_tail) > blocksize)
+        return 0;
+    dx_tail = (struct ext4_dx_tail *)(buffer + count_offset + countlimit->limit * sizeof(struct ext4_dx_entry));
+    crc = crc32c_update(dno->csum_seed, buffer, count_offset + countlimit->count * sizeof(struct ext4_dx_entry));
+    crc = crc32c_update(crc, dx_tail, sizeof(dx_tail->dt_reserved));
+    crc = crc32c_update(crc, &zero, sizeof(zero));
+    return crc == dx_tail->dt_checksum;
+}
+
 /**
  * Mount an ext4 volume. Reads the superblock and constructs the
  * root directory dnode.
@@ -152,6 +307,23 @@ static fsw_status_t fsw_ext4_volume_mount(struct fsw_ext4_volume *vol)
         // Print(L"Ext4 WARNING: This file system needs recovery, trying to use it anyway.\n");
     }
 
+    // metadata checksums, seeded from the UUID unless the seed is stored
+    vol->csum = FSW_EXT4_VERIFY_CSUM && vol->sb->s_rev_level == EXT4_DYNAMIC_REV &&
+        (vol->sb->s_feature_ro_compat & EXT4_FEATURE_RO_COMPAT_METADATA_CSUM);
+    if (vol->csum) {
+        if (vol->sb->s_checksum_type != EXT4_CRC32C_CHKSUM)
+            return FSW_UNSUPPORTED;
+        init_crc32c_table();
+        if (!fsw_ext4_superblock_csum_valid(vol->sb)) {
+            FSW_MSG_DEBUG((FSW_MSGSTR("fsw_ext4_volume_mount: superblock checksum mismatch\n")));
+            return FSW_VOLUME_CORRUPTED;
+        }
+        if (vol->sb->s_feature_incompat & EXT4_FEATURE_INCOMPAT_CSUM_SEED)
+            vol->csum_seed = vol->sb->s_checksum_seed;
+        else
+            vol->csum_seed = crc32c_update(0xFFFFFFFF, vol->sb->s_uuid, sizeof(vol->sb->s_uuid));
+    }
+
     blocksize = EXT4_BLOCK_SIZE(vol->sb);
     if (blocksize < EXT4_MIN_BLOCK_SIZE || blocksize > EXT4_MAX_BLOCK_SIZE)
         return FSW_UNSUPPORTED;
@@ -164,6 +336,14 @@ static fsw_status_t fsw_ext4_volume_mount(struct fsw_ext4_volume *vol)
     vol->dind_bcnt = vol->ind_bcnt * vol->ind_bcnt;
     vol->inode_size = vol->sb->s_inode_size;//EXT4_INODE_SIZE(vol->sb);
 
+    // allocate the inode cache
+    status = fsw_alloc(vol->inode_size * FSW_EXT4_INODE_CACHE_SIZE, &vol->icache);
+    if (status)
+        return status;
+    status = fsw_alloc_zero(sizeof(fsw_u32) * FSW_EXT4_INODE_CACHE_SIZE, (void **)&vol->icache_ino);
+    if (status)
+        return status;
+
     for (i = 0; i < 16; i++)
         if (vol->sb->s_volume_name[i] == 0)
             break;
@@ -183,6 +363,7 @@ static fsw_status_t fsw_ext4_volume_mount(struct fsw_ext4_volume *vol)
     // Calculate group descriptor count the way the kernel does it...
     groupcnt = (vol->sb->s_blocks_count_lo - vol->sb->s_first_data_block +
                 vol->sb->s_blocks_per_group - 1) / vol->sb->s_blocks_per_group;
+    vol->groupcnt = groupcnt;
 
     // Descriptors in one block... s_desc_size needs to be set! (Usually 128 since normal block
     // descriptors are 32 byte and block size is 4096)
@@ -225,6 +406,12 @@ static fsw_status_t fsw_ext4_volume_mount(struct fsw_ext4_volume *vol)
         if (vol->sb->s_desc_size >= EXT4_MIN_DESC_SIZE_64BIT)
             vol->inotab_bno[groupno] |= (fsw_u64)gdesc->bg_inode_table_hi << 32;
 
+        // a bad descriptor only makes the inodes of its group unavailable
+        if (vol->csum && !fsw_ext4_gdesc_csum_valid(vol, groupno, gdesc)) {
+            FSW_MSG_DEBUG((FSW_MSGSTR("fsw_ext4_volume_mount: checksum mismatch for group %d\n"), groupno));
+            vol->inotab_bno[groupno] = 0;
+        }
+
         fsw_block_release(vol, gdesc_bno, buffer);
     }
 
@@ -250,6 +437,10 @@ static void fsw_ext4_volume_free(struct fsw_ext4_volume *vol)
         fsw_free(vol->sb);
     if (vol->inotab_bno)
         fsw_free(vol->inotab_bno);
+    if (vol->icache)
+        fsw_free(vol->icache);
+    if (vol->icache_ino)
+        fsw_free(vol->icache_ino);
 }
 
 /**
@@ -273,41 +464,121 @@ static fsw_status_t fsw_ext4_volume_stat(struct fsw_ext4_volume *vol, struct fsw
     return FSW_SUCCESS;
 }
 
+/**
+ * Find an inode on disk: the inode table block holding it and its index in that block.
+ */
+
+static fsw_status_t fsw_ext4_inode_locate(struct fsw_ext4_volume *vol, fsw_u32 ino,
+                                          fsw_u64 *bno_out, fsw_u32 *index_out)
+{
+    fsw_u32         groupno, ino_in_group, inodes_per_block;
+
+    if (ino == 0)
+        return FSW_VOLUME_CORRUPTED;
+    groupno = (ino - 1) / vol->sb->s_inodes_per_group;
+    ino_in_group = (ino - 1) % vol->sb->s_inodes_per_group;
+    if (groupno >= vol->groupcnt || vol->inotab_bno[groupno] == 0)
+        return FSW_VOLUME_CORRUPTED;
+    inodes_per_block = vol->g.phys_blocksize / vol->inode_size;
+    *bno_out = vol->inotab_bno[groupno] + ino_in_group / inodes_per_block;
+    *index_out = ino_in_group % inodes_per_block;
+    return FSW_SUCCESS;
+}
+
+/**
+ * Get a raw inode from the inode cache, or NULL if it isn't there.
+ */
+
+static fsw_u8 *fsw_ext4_icache_lookup(struct fsw_ext4_volume *vol, fsw_u32 ino)
+{
+    fsw_u32         slot = ino % FSW_EXT4_INODE_CACHE_SIZE;
+
+    if (vol->icache_ino[slot] != ino)
+        return NULL;
+    return vol->icache + slot * vol->inode_size;
+}
+
+/**
+ * Put a raw inode into the inode cache, replacing the one in its slot.
+ */
+
+static void fsw_ext4_icache_store(struct fsw_ext4_volume *vol, fsw_u32 ino, fsw_u8 *raw)
+{
+    fsw_u32         slot = ino % FSW_EXT4_INODE_CACHE_SIZE;
+
+    fsw_memcpy(vol->icache + slot * vol->inode_size, raw, vol->inode_size);
+    vol->icache_ino[slot] = ino;
+}
+
 /**
  * Get full information on a dnode from disk. This function is called by the core
  * whenever it needs to access fields in the dnode structure that may not
  * be filled immediately upon creation of the dnode. In the case of ext4, we
  * delay fetching of the inode structure until dnode_fill is called. The size and
  * type fields are invalid until this function has been called.
+ *
+ * Inodes come from the inode cache if possible. For a dnode found by reading a
+ * directory, a miss first prefetches the inodes of all entries in the same directory
+ * block, since their siblings are usually filled right after.
  */
 
 static fsw_status_t fsw_ext4_dnode_fill(struct fsw_ext4_volume *vol, struct fsw_ext4_dnode *dno)
 {
     fsw_status_t    status;
-    fsw_u32         groupno, ino_in_group, ino_index;
+    fsw_u32         ino, ino_index;
     fsw_u64         ino_bno;
-    fsw_u8          *buffer;
+    fsw_u8          *buffer, *raw;
+    struct fsw_ext4_dnode *parent;
 
     if (dno->raw)
         return FSW_SUCCESS;
 
+    ino = (fsw_u32)dno->g.dnode_id;
+    raw = fsw_ext4_icache_lookup(vol, ino);
+    parent = (struct fsw_ext4_dnode *)dno->g.parent;
+    if (raw == NULL && dno->dir_lblock != 0 && parent != NULL && parent->raw != NULL &&
+        (parent->g.dnode_id != vol->prefetch_dir || dno->dir_lblock - 1 != vol->prefetch_lblock)) {
+        // once per directory block, in case the cache couldn't hold all of its inodes
+        vol->prefetch_dir = parent->g.dnode_id;
+        vol->prefetch_lblock = dno->dir_lblock - 1;
+        fsw_ext4_inode_prefetch(vol, parent, dno->dir_lblock - 1);
+        raw = fsw_ext4_icache_lookup(vol, ino);
+    }
 
-    // read the inode block
-    groupno = (fsw_u32) (dno->g.dnode_id - 1) / vol->sb->s_inodes_per_group;
-    ino_in_group = (fsw_u32) (dno->g.dnode_id - 1) % vol->sb->s_inodes_per_group;
-    ino_bno = vol->inotab_bno[groupno] +
-        ino_in_group / (vol->g.phys_blocksize / vol->inode_size);
-    ino_index = ino_in_group % (vol->g.phys_blocksize / vol->inode_size);
-    status = fsw_block_get(vol, ino_bno, 2, (void **)&buffer);
+    if (raw != NULL) {
+        // keep our inode around
+        status = fsw_memdup((void **)&dno->raw, raw, vol->inode_size);
+        if (status)
+            return status;
+    } else {
+        // read the inode block
+        status = fsw_ext4_inode_locate(vol, ino, &ino_bno, &ino_index);
+        if (status)
+            return status;
+        status = fsw_block_get(vol, ino_bno, 2, (void **)&buffer);
+        if (status)
+            return status;
 
-    if (status)
-        return status;
+        // keep our inode around
+        raw = buffer + ino_index * vol->inode_size;
+        fsw_ext4_icache_store(vol, ino, raw);
+        status = fsw_memdup((void **)&dno->raw, raw, vol->inode_size);
+        fsw_block_release(vol, ino_bno, buffer);
+        if (status)
+            return status;
+    }
 
-    // keep our inode around
-    status = fsw_memdup((void **)&dno->raw, buffer + ino_index * vol->inode_size, vol->inode_size);
-    fsw_block_release(vol, ino_bno, buffer);
-    if (status)
-        return status;
+    // the inode's blocks are checksummed with its number and generation; the inode
+    //  itself only if Linux created the file system
+    if (vol->csum) {
+        dno->csum_seed = fsw_ext4_csum_u32(fsw_ext4_csum_u32(vol->csum_seed, ino), dno->raw->i_generation);
+        if (vol->sb->s_creator_os == EXT4_OS_LINUX && !fsw_ext4_inode_csum_valid(vol, dno)) {
+            FSW_MSG_DEBUG((FSW_MSGSTR("fsw_ext4_dnode_fill: checksum mismatch for inode %d\n"), ino));
+            fsw_free(dno->raw);
+            dno->raw = NULL;
+            return FSW_VOLUME_CORRUPTED;
+        }
+    }
 
     // get info from the inode
     dno->g.size = dno->raw->i_size_lo; // TODO: check docs for 64-bit sized files
@@ -334,8 +605,15 @@ static fsw_status_t fsw_ext4_dnode_fill(struct fsw_ext4_volume *vol, struct fsw_
 
 static void fsw_ext4_dnode_free(struct fsw_ext4_volume *vol, struct fsw_ext4_dnode *dno)
 {
+    int             i;
+
     if (dno->raw)
         fsw_free(dno->raw);
+    for (i = 0; i < 3; i++)
+        if (dno->ind_block[i])
+            fsw_free(dno->ind_block[i]);
+    if (dno->ext_leaf)
+        fsw_free(dno->ext_leaf);
 }
 
 /**
@@ -393,14 +671,32 @@ static fsw_status_t fsw_ext4_get_extent(struct fsw_ext4_volume *vol, struct fsw_
 }
 
 /**
- * New ext4 extents...
+ * Check an extent tree node header. size is the number of bytes available for the
+ * node, i.e. the size of i_block for the root and the block size for the others.
+ */
+
+static int fsw_ext4_extent_header_valid(struct ext4_extent_header *header, fsw_u32 size)
+{
+    return header->eh_magic == EXT4_EXT_MAGIC && header->eh_entries <= header->eh_max &&
+        sizeof(struct ext4_extent_header) + header->eh_max * sizeof(struct ext4_extent) <= size &&
+        header->eh_depth <= EXT_MAX_EXTENT_DEPTH && (header->eh_depth == 0 || header->eh_entries > 0);
+}
+
+/**
+ * Map a logical block through the extent tree. Each level is searched by binary search.
+ * The leaf block found last is kept with the dnode together with the range of logical
+ * blocks it covers, so that sequential reads of a file only walk the tree once per
+ * leaf. The returned extent spans all following extents of the leaf that continue it
+ * on disk. Blocks that no extent covers and unwritten extents are returned as sparse.
  */
+
 static fsw_status_t fsw_ext4_get_by_extent(struct fsw_ext4_volume *vol, struct fsw_ext4_dnode *dno,
                                         struct fsw_extent *extent)
 {
     fsw_status_t  status;
-    fsw_u32       bno, buf_offset;
-    int           ext_cnt;
+    fsw_u32       bno, start, end, lo, hi, mid, ee_block, ee_len, len;
+    fsw_u64       phys_bno, buf_bno;
+    int           depth, unwritten;
     void          *buffer;
 
     struct ext4_extent_header  *ext4_extent_header;
@@ -410,75 +706,176 @@ static fsw_status_t fsw_ext4_get_by_extent(struct fsw_ext4_volume *vol, struct f
     // Logical block requested by core...
     bno = extent->log_start;
 
-    // First buffer is the i_block field from inode...
-    buffer = (void *)dno->raw->i_block;
-    buf_offset = 0;
-    while(1) {
-        ext4_extent_header = (struct ext4_extent_header *)((char *)buffer + buf_offset);
-        buf_offset += sizeof(struct ext4_extent_header);
-        FSW_MSG_DEBUG((FSW_MSGSTR("fsw_ext4_get_by_extent: extent header with %d entries\n"),
-                      ext4_extent_header->eh_entries));
-        if(ext4_extent_header->eh_magic != EXT4_EXT_MAGIC)
+    if (dno->ext_leaf != NULL && bno >= dno->ext_leaf_start && bno < dno->ext_leaf_end) {
+        ext4_extent_header = dno->ext_leaf;
+        start = dno->ext_leaf_start;
+        end = dno->ext_leaf_end;
+    } else {
+        // Walk down from the root in the inode's i_block field
+        ext4_extent_header = (struct ext4_extent_header *)dno->raw->i_block;
+        if (!fsw_ext4_extent_header_valid(ext4_extent_header, sizeof(dno->raw->i_block)))
             return FSW_VOLUME_CORRUPTED;
+        start = 0;
+        end = 0xFFFFFFFF;
+        buffer = NULL;
+        buf_bno = 0;
+        while (ext4_extent_header->eh_depth > 0) {
+            FSW_MSG_DEBUG((FSW_MSGSTR("fsw_ext4_get_by_extent: index with %d entries, depth %d\n"),
+                          ext4_extent_header->eh_entries, ext4_extent_header->eh_depth));
+            ext4_extent_idx = (struct ext4_extent_idx *)(ext4_extent_header + 1);
+
+            // Last index starting at or before the block; blocks before the first index
+            //  belong to the first one, like in the kernel
+            lo = 1;
+            hi = ext4_extent_header->eh_entries;
+            while (lo < hi) {
+                mid = lo + (hi - lo) / 2;
+                if (ext4_extent_idx[mid].ei_block <= bno)
+                    lo = mid + 1;
+                else
+                    hi = mid;
+            }
+            ext4_extent_idx += lo - 1;
+            if (lo > 1)
+                start = ext4_extent_idx->ei_block;
+            if (lo < ext4_extent_header->eh_entries && ext4_extent_idx[1].ei_block < end)
+                end = ext4_extent_idx[1].ei_block;
+            phys_bno = ((fsw_u64)ext4_extent_idx->ei_leaf_hi << 32) | ext4_extent_idx->ei_leaf_lo;
+            depth = ext4_extent_header->eh_depth;
+
+            if (buffer != NULL)
+                fsw_block_release(vol, buf_bno, buffer);
+            status = fsw_block_get(vol, phys_bno, 1, &buffer);
+            if (status)
+                return status;
+            buf_bno = phys_bno;
+            ext4_extent_header = (struct ext4_extent_header *)buffer;
+            if (!fsw_ext4_extent_header_valid(ext4_extent_header, vol->g.phys_blocksize) ||
+                ext4_extent_header->eh_depth != depth - 1 ||
+                (vol->csum && !fsw_ext4_extent_block_csum_valid(vol, dno, ext4_extent_header))) {
+                fsw_block_release(vol, buf_bno, buffer);
+                return FSW_VOLUME_CORRUPTED;
+            }
+        }
 
-        for(ext_cnt = 0;ext_cnt < ext4_extent_header->eh_entries;ext_cnt++)
-        {
-            if(ext4_extent_header->eh_depth == 0)
-            {
-                // Leaf node, the header follows actual extents
-                ext4_extent = (struct ext4_extent *)((char *)buffer + buf_offset);
-                buf_offset += sizeof(struct ext4_extent);
-                FSW_MSG_DEBUG((FSW_MSGSTR("fsw_ext4_get_by_extent: extent node cover %d...\n"), ext4_extent->ee_block));
-
-                // Is the requested block in this extent?
-                if(bno >= ext4_extent->ee_block && bno < ext4_extent->ee_block + ext4_extent->ee_len)
-                {
-                    extent->phys_start = ((fsw_u64)ext4_extent->ee_start_hi << 32) | ext4_extent->ee_start_lo;
-                    extent->phys_start += (bno - ext4_extent->ee_block);
-                    extent->log_count = ext4_extent->ee_len - (bno - ext4_extent->ee_block);
-                    return FSW_SUCCESS;
+        if (buffer != NULL) {
+            // Keep the leaf for the next blocks it covers
+            if (dno->ext_leaf == NULL) {
+                status = fsw_alloc(vol->g.phys_blocksize, &dno->ext_leaf);
+                if (status) {
+                    fsw_block_release(vol, buf_bno, buffer);
+                    return status;
                 }
             }
-            else
-            {
-                FSW_MSG_DEBUG((FSW_MSGSTR("fsw_ext4_get_by_extent: index extents, depth %d\n"),
-                          ext4_extent_header->eh_depth));
-                ext4_extent_idx = (struct ext4_extent_idx *)((char *)buffer + buf_offset);
-                buf_offset += sizeof(struct ext4_extent_idx);
-
-                FSW_MSG_DEBUG((FSW_MSGSTR("fsw_ext4_get_by_extent: index node covers block %d...\n"),
-                          ext4_extent_idx->ei_block));
-                if(bno >= ext4_extent_idx->ei_block)
-                {
-                    // Follow extent tree...
-                    fsw_u64 phys_bno = ((fsw_u64)ext4_extent_idx->ei_leaf_hi << 32) | ext4_extent_idx->ei_leaf_lo;
-                    status = fsw_block_get(vol, phys_bno, 1, (void **)&buffer);
-                    if (status)
-                        return status;
-                    buf_offset = 0;
+            fsw_memcpy(dno->ext_leaf, buffer, vol->g.phys_blocksize);
+            fsw_block_release(vol, buf_bno, buffer);
+            dno->ext_leaf_start = start;
+            dno->ext_leaf_end = end;
+            ext4_extent_header = dno->ext_leaf;
+        }
+    }
+
+    // Leaf node, the header is followed by the extents; find the last one starting
+    //  at or before the block
+    ext4_extent = (struct ext4_extent *)(ext4_extent_header + 1);
+    lo = 0;
+    hi = ext4_extent_header->eh_entries;
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (ext4_extent[mid].ee_block <= bno)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if (lo > 0) {
+        ext4_extent += lo - 1;
+        ee_block = ext4_extent->ee_block;
+        ee_len = ext4_extent->ee_len;
+        unwritten = ee_len > EXT_INIT_MAX_LEN;
+        if (unwritten)
+            ee_len -= EXT_INIT_MAX_LEN;
+        FSW_MSG_DEBUG((FSW_MSGSTR("fsw_ext4_get_by_extent: extent covers %d+%d\n"), ee_block, ee_len));
+
+        // Is the requested block in this extent?
+        if (bno - ee_block < ee_len) {
+            phys_bno = ((fsw_u64)ext4_extent->ee_start_hi << 32) | ext4_extent->ee_start_lo;
+            extent->type = unwritten ? FSW_EXTENT_TYPE_SPARSE : FSW_EXTENT_TYPE_PHYSBLOCK;
+            extent->phys_start = phys_bno + (bno - ee_block);
+            extent->log_count = ee_len - (bno - ee_block);
+
+            // Add the following extents as long as they continue this one
+            for (lo++; lo < ext4_extent_header->eh_entries; lo++) {
+                ext4_extent++;
+                len = ext4_extent->ee_len;
+                if ((len > EXT_INIT_MAX_LEN) != unwritten)
                     break;
-                }
+                if (unwritten)
+                    len -= EXT_INIT_MAX_LEN;
+                if (ext4_extent->ee_block != ee_block + ee_len ||
+                    (!unwritten && (((fsw_u64)ext4_extent->ee_start_hi << 32) | ext4_extent->ee_start_lo) !=
+                                   phys_bno + ee_len))
+                    break;
+                extent->log_count += len;
+                ee_block += ee_len;
+                phys_bno += ee_len;
+                ee_len = len;
             }
+            return FSW_SUCCESS;
         }
+        ext4_extent++;
     }
 
-    return FSW_NOT_FOUND;
+    // No extent covers the block, it's in a hole up to the next extent or the end of the file
+    if (lo < ext4_extent_header->eh_entries)
+        end = ext4_extent->ee_block;
+    if (end == 0xFFFFFFFF)
+        end = (fsw_u32)FSW_U64_DIV(dno->g.size + vol->g.log_blocksize - 1, vol->g.log_blocksize);
+    extent->type = FSW_EXTENT_TYPE_SPARSE;
+    extent->log_count = end > bno ? end - bno : 1;
+    return FSW_SUCCESS;
 }
 
 /**
- * The ext2/ext3 file system does not use extents, but stores a list of block numbers
- * using the usual direct, indirect, double-indirect, triple-indirect scheme. To
- * optimize access, this function checks if the following file blocks are mapped
- * to consecutive disk blocks and returns a combined extent if possible.
+ * Get an indirect block for the mapping path. step is the position in the path. The
+ * dnode keeps a copy of the block used last at each step, so mapping neighbouring
+ * blocks doesn't go back to the block cache.
  */
-static fsw_status_t fsw_ext4_get_by_blkaddr(struct fsw_ext4_volume *vol, struct fsw_ext4_dnode *dno,
-                                        struct fsw_extent *extent)
+
+static fsw_status_t fsw_ext4_ind_block_get(struct fsw_ext4_volume *vol, struct fsw_ext4_dnode *dno,
+                                           int step, fsw_u32 bno, fsw_u32 **buffer_out)
+{
+    fsw_status_t    status;
+    void            *buffer;
+
+    if (dno->ind_bno[step] != bno) {
+        if (dno->ind_block[step] == NULL) {
+            status = fsw_alloc(vol->g.phys_blocksize, &dno->ind_block[step]);
+            if (status)
+                return status;
+        }
+        status = fsw_block_get(vol, bno, 1, &buffer);
+        if (status)
+            return status;
+        fsw_memcpy(dno->ind_block[step], buffer, vol->g.phys_blocksize);
+        fsw_block_release(vol, bno, buffer);
+        dno->ind_bno[step] = bno;
+    }
+    *buffer_out = dno->ind_block[step];
+    return FSW_SUCCESS;
+}
+
+/**
+ * Map one logical block through the direct, indirect, double-indirect and
+ * triple-indirect block pointers. *phys_bno_out is set to 0 if the block is in a hole.
+ */
+
+static fsw_status_t fsw_ext4_map_block(struct fsw_ext4_volume *vol, struct fsw_ext4_dnode *dno,
+                                       fsw_u32 bno, fsw_u32 *phys_bno_out)
 {
     fsw_status_t    status;
-    fsw_u32         bno, release_bno, buf_bcnt, file_bcnt;
-    int             path[5], i;
     fsw_u32         *buffer;
-    bno = extent->log_start;
+    int             path[5], i;
 
     // try direct block pointers in the inode
     if (bno < EXT4_NDIR_BLOCKS) {
@@ -513,44 +910,52 @@ static fsw_status_t fsw_ext4_get_by_blkaddr(struct fsw_ext4_volume *vol, struct
             }
         }
     }
-    
+
     // follow the indirection path
     buffer = dno->raw->i_block;
-    buf_bcnt = EXT4_NDIR_BLOCKS;
-    release_bno = 0;
     for (i = 0; ; i++) {
         bno = buffer[path[i]];
-        if (bno == 0) {
-            extent->type = FSW_EXTENT_TYPE_SPARSE;
-            if (release_bno)
-                fsw_block_release(vol, release_bno, buffer);
-            return FSW_SUCCESS;
-        }
-        if (path[i+1] < 0)
+        if (bno == 0 || path[i+1] < 0)
             break;
-
-        if (release_bno)
-            fsw_block_release(vol, release_bno, buffer);
-        status = fsw_block_get(vol, bno, 1, (void **)&buffer);
+        status = fsw_ext4_ind_block_get(vol, dno, i, bno, &buffer);
         if (status)
             return status;
-        release_bno = bno;
-        buf_bcnt = vol->ind_bcnt;
     }
-    extent->phys_start = bno;
+    *phys_bno_out = bno;
+    return FSW_SUCCESS;
+}
 
-    // check if the following blocks can be aggregated into one extent
-    file_bcnt = (fsw_u32)((dno->g.size + vol->g.log_blocksize - 1) & (vol->g.log_blocksize - 1));
-    while (path[i]           + extent->log_count < buf_bcnt &&    // indirect block has more block pointers
-           extent->log_start + extent->log_count < file_bcnt) {   // file has more blocks
-        if (buffer[path[i] + extent->log_count] == buffer[path[i] + extent->log_count - 1] + 1)
-            extent->log_count++;
-        else
+/**
+ * The ext2/ext3 file system does not use extents, but stores a list of block numbers
+ * using the usual direct, indirect, double-indirect, triple-indirect scheme. To
+ * optimize access, this function checks if the following file blocks are mapped
+ * to consecutive disk blocks and returns a combined extent if possible.
+ */
+static fsw_status_t fsw_ext4_get_by_blkaddr(struct fsw_ext4_volume *vol, struct fsw_ext4_dnode *dno,
+                                        struct fsw_extent *extent)
+{
+    fsw_status_t    status;
+    fsw_u32         bno, phys_bno, next_bno, file_bcnt;
+
+    bno = extent->log_start;
+    status = fsw_ext4_map_block(vol, dno, bno, &phys_bno);
+    if (status)
+        return status;
+    if (phys_bno == 0)
+        extent->type = FSW_EXTENT_TYPE_SPARSE;
+    extent->phys_start = phys_bno;
+
+    // aggregate the following blocks as long as they continue the extent on disk, or
+    //  the hole, also across indirect block boundaries
+    file_bcnt = (fsw_u32)FSW_U64_DIV(dno->g.size + vol->g.log_blocksize - 1, vol->g.log_blocksize);
+    while (bno + extent->log_count < file_bcnt) {
+        if (fsw_ext4_map_block(vol, dno, bno + extent->log_count, &next_bno) != FSW_SUCCESS)
+            break;
+        if (phys_bno == 0 ? next_bno != 0 : next_bno != phys_bno + extent->log_count)
             break;
+        extent->log_count++;
     }
 
-    if (release_bno)
-        fsw_block_release(vol, release_bno, buffer);
     return FSW_SUCCESS;
 }
 
@@ -574,6 +979,19 @@ static fsw_status_t fsw_ext4_dir_lookup(struct fsw_ext4_volume *vol, struct fsw_
 
     entry_name.type = FSW_STRING_TYPE_ISO88591;
 
+    // a hash-indexed directory leads straight to the block holding the name
+    if ((vol->sb->s_feature_compat & EXT4_FEATURE_COMPAT_DIR_INDEX) && (dno->raw->i_flags & EXT4_INDEX_FL)) {
+        status = fsw_ext4_dx_lookup(vol, dno, lookup_name, &entry);
+        if (status == FSW_SUCCESS) {
+            entry_name.len = entry_name.size = entry.name_len;
+            entry_name.data = entry.name;
+            return fsw_dnode_create(dno, entry.inode, FSW_DNODE_TYPE_UNKNOWN, &entry_name, child_dno_out);
+        }
+        // like the kernel, fall back to a linear scan if the index can't be used
+        if (status != FSW_UNSUPPORTED)
+            return status;
+    }
+
     // setup handle to read the directory
     status = fsw_shandle_open(dno, &shand);
     if (status)
@@ -609,6 +1027,445 @@ errorexit:
     return status;
 }
 
+/**
+ * Hash functions for hash-indexed directories, as in the Linux kernel's fs/ext4/hash.c.
+ * The signed variants treat name bytes as signed chars, which is what kernels on
+ * x86 did before the superblock recorded the choice.
+ */
+
+#define EXT4_DX_ROL32(x, s) (((x) << (s)) | ((x) >> (32 - (s))))
+#define EXT4_DX_F(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define EXT4_DX_G(x, y, z) (((x) & (y)) + (((x) ^ (y)) & (z)))
+#define EXT4_DX_H(x, y, z) ((x) ^ (y) ^ (z))
+#define EXT4_DX_ROUND(f, a, b, c, d, x, s) (a += f(b, c, d) + (x), a = EXT4_DX_ROL32(a, s))
+#define EXT4_DX_K2 0x5A827999
+#define EXT4_DX_K3 0x6ED9EBA1
+
+static void fsw_ext4_dx_half_md4(fsw_u32 buf[4], const fsw_u32 in[8])
+{
+    fsw_u32 a = buf[0], b = buf[1], c = buf[2], d = buf[3];
+
+    EXT4_DX_ROUND(EXT4_DX_F, a, b, c, d, in[0],  3);
+    EXT4_DX_ROUND(EXT4_DX_F, d, a, b, c, in[1],  7);
+    EXT4_DX_ROUND(EXT4_DX_F, c, d, a, b, in[2], 11);
+    EXT4_DX_ROUND(EXT4_DX_F, b, c, d, a, in[3], 19);
+    EXT4_DX_ROUND(EXT4_DX_F, a, b, c, d, in[4],  3);
+    EXT4_DX_ROUND(EXT4_DX_F, d, a, b, c, in[5],  7);
+    EXT4_DX_ROUND(EXT4_DX_F, c, d, a, b, in[6], 11);
+    EXT4_DX_ROUND(EXT4_DX_F, b, c, d, a, in[7], 19);
+
+    EXT4_DX_ROUND(EXT4_DX_G, a, b, c, d, in[1] + EXT4_DX_K2,  3);
+    EXT4_DX_ROUND(EXT4_DX_G, d, a, b, c, in[3] + EXT4_DX_K2,  5);
+    EXT4_DX_ROUND(EXT4_DX_G, c, d, a, b, in[5] + EXT4_DX_K2,  9);
+    EXT4_DX_ROUND(EXT4_DX_G, b, c, d, a, in[7] + EXT4_DX_K2, 13);
+    EXT4_DX_ROUND(EXT4_DX_G, a, b, c, d, in[0] + EXT4_DX_K2,  3);
+    EXT4_DX_ROUND(EXT4_DX_G, d, a, b, c, in[2] + EXT4_DX_K2,  5);
+    EXT4_DX_ROUND(EXT4_DX_G, c, d, a, b, in[4] + EXT4_DX_K2,  9);
+    EXT4_DX_ROUND(EXT4_DX_G, b, c, d, a, in[6] + EXT4_DX_K2, 13);
+
+    EXT4_DX_ROUND(EXT4_DX_H, a, b, c, d, in[3] + EXT4_DX_K3,  3);
+    EXT4_DX_ROUND(EXT4_DX_H, d, a, b, c, in[7] + EXT4_DX_K3,  9);
+    EXT4_DX_ROUND(EXT4_DX_H, c, d, a, b, in[2] + EXT4_DX_K3, 11);
+    EXT4_DX_ROUND(EXT4_DX_H, b, c, d, a, in[6] + EXT4_DX_K3, 15);
+    EXT4_DX_ROUND(EXT4_DX_H, a, b, c, d, in[1] + EXT4_DX_K3,  3);
+    EXT4_DX_ROUND(EXT4_DX_H, d, a, b, c, in[5] + EXT4_DX_K3,  9);
+    EXT4_DX_ROUND(EXT4_DX_H, c, d, a, b, in[0] + EXT4_DX_K3, 11);
+    EXT4_DX_ROUND(EXT4_DX_H, b, c, d, a, in[4] + EXT4_DX_K3, 15);
+
+    buf[0] += a;
+    buf[1] += b;
+    buf[2] += c;
+    buf[3] += d;
+}
+
+static void fsw_ext4_dx_tea(fsw_u32 buf[4], const fsw_u32 in[4])
+{
+    fsw_u32 sum = 0, b0 = buf[0], b1 = buf[1];
+    int     n;
+
+    for (n = 0; n < 16; n++) {
+        sum += 0x9E3779B9;
+        b0 += ((b1 << 4) + in[0]) ^ (b1 + sum) ^ ((b1 >> 5) + in[1]);
+        b1 += ((b0 << 4) + in[2]) ^ (b0 + sum) ^ ((b0 >> 5) + in[3]);
+    }
+    buf[0] += b0;
+    buf[1] += b1;
+}
+
+/**
+ * Pack up to num * 4 bytes of a name into words for the half MD4 and TEA hashes,
+ * padding with a pattern derived from the full length.
+ */
+
+static void fsw_ext4_dx_str2hashbuf(const fsw_u8 *msg, int len, fsw_u32 *buf, int num, int is_unsigned)
+{
+    fsw_u32 pad, val;
+    int     i, c;
+
+    pad = (fsw_u32)len | ((fsw_u32)len << 8);
+    pad |= pad << 16;
+
+    val = pad;
+    if (len > num * 4)
+        len = num * 4;
+    for (i = 0; i < len; i++) {
+        c = is_unsigned ? (int)msg[i] : (int)(signed char)msg[i];
+        val = (fsw_u32)c + (val << 8);
+        if ((i % 4) == 3) {
+            *buf++ = val;
+            val = pad;
+            num--;
+        }
+    }
+    if (--num >= 0)
+        *buf++ = val;
+    while (--num >= 0)
+        *buf++ = pad;
+}
+
+/**
+ * Compute the major hash of a name for looking it up in the directory index. Bit 0 is
+ * cleared; in index entries it marks hash collisions continued from the previous block.
+ */
+
+static fsw_u32 fsw_ext4_dx_hash(struct fsw_ext4_volume *vol, const fsw_u8 *name, int len, int hash_version)
+{
+    fsw_u32         buf[4], in[8], hash, hash0, hash1;
+    int             i, c, is_unsigned;
+
+    buf[0] = 0x67452301;
+    buf[1] = 0xefcdab89;
+    buf[2] = 0x98badcfe;
+    buf[3] = 0x10325476;
+    for (i = 0; i < 4; i++) {
+        if (vol->sb->s_hash_seed[i] != 0) {
+            fsw_memcpy(buf, vol->sb->s_hash_seed, sizeof(buf));
+            break;
+        }
+    }
+
+    is_unsigned = (hash_version >= EXT4_HASH_LEGACY_UNSIGNED);
+    switch (hash_version) {
+        case EXT4_HASH_LEGACY:
+        case EXT4_HASH_LEGACY_UNSIGNED:
+            hash0 = 0x12a3fe2d;
+            hash1 = 0x37abe8f9;
+            for (i = 0; i < len; i++) {
+                c = is_unsigned ? (int)name[i] : (int)(signed char)name[i];
+                hash = hash1 + (hash0 ^ (fsw_u32)(c * 7152373));
+                if (hash & 0x80000000)
+                    hash -= 0x7fffffff;
+                hash1 = hash0;
+                hash0 = hash;
+            }
+            hash = hash0 << 1;
+            break;
+
+        case EXT4_HASH_HALF_MD4:
+        case EXT4_HASH_HALF_MD4_UNSIGNED:
+            for (i = 0; i < len; i += 32) {
+                fsw_ext4_dx_str2hashbuf(name + i, len - i, in, 8, is_unsigned);
+                fsw_ext4_dx_half_md4(buf, in);
+            }
+            hash = buf[1];
+            break;
+
+        default:    // EXT4_HASH_TEA, EXT4_HASH_TEA_UNSIGNED
+            for (i = 0; i < len; i += 16) {
+                fsw_ext4_dx_str2hashbuf(name + i, len - i, in, 4, is_unsigned);
+                fsw_ext4_dx_tea(buf, in);
+            }
+            hash = buf[0];
+            break;
+    }
+
+    hash &= ~1;
+    if (hash == 0x7fffffff << 1)    // reserved for the end of a directory read
+        hash = (0x7fffffff - 1) << 1;
+    return hash;
+}
+
+/**
+ * Get a directory block by its logical block number. The caller must release it with
+ * fsw_block_release on *phys_bno_out. With metadata checksums, a block that doesn't
+ * match its checksum is reported as FSW_VOLUME_CORRUPTED.
+ */
+
+static fsw_status_t fsw_ext4_dir_block_get(struct fsw_ext4_volume *vol, struct fsw_ext4_dnode *dno,
+                                           fsw_u32 lblock, fsw_u32 cache_level,
+                                           fsw_u64 *phys_bno_out, fsw_u8 **buffer_out)
+{
+    fsw_status_t    status;
+    struct fsw_extent extent;
+
+    if ((fsw_u64)lblock * vol->g.log_blocksize >= dno->g.size)
+        return FSW_UNSUPPORTED;
+    extent.log_start = lblock;
+    status = fsw_ext4_get_extent(vol, dno, &extent);
+    if (status)
+        return status;
+    if (extent.type != FSW_EXTENT_TYPE_PHYSBLOCK)
+        return FSW_UNSUPPORTED;
+    *phys_bno_out = extent.phys_start;
+    status = fsw_block_get(vol, extent.phys_start, cache_level, (void **)buffer_out);
+    if (status)
+        return status;
+    if (vol->csum && !fsw_ext4_dir_block_csum_valid(vol, dno, *buffer_out)) {
+        FSW_MSG_DEBUG((FSW_MSGSTR("fsw_ext4_dir_block_get: checksum mismatch for block %d of inode %d\n"),
+                      lblock, dno->g.dnode_id));
+        fsw_block_release(vol, extent.phys_start, *buffer_out);
+        return FSW_VOLUME_CORRUPTED;
+    }
+    return FSW_SUCCESS;
+}
+
+/**
+ * Get the index entries of a dx_root (level 0) or dx_node block. The entries start at
+ * offset bytes into the block. Returns FSW_UNSUPPORTED if the count doesn't make sense.
+ */
+
+static fsw_status_t fsw_ext4_dx_entries_get(struct fsw_ext4_volume *vol, struct fsw_ext4_dnode *dno,
+                                            fsw_u32 lblock, fsw_u32 offset, fsw_u64 *phys_bno_out,
+                                            fsw_u8 **buffer_out, struct ext4_dx_entry **entries_out,
+                                            fsw_u32 *count_out)
+{
+    fsw_status_t    status;
+    struct ext4_dx_countlimit *countlimit;
+
+    status = fsw_ext4_dir_block_get(vol, dno, lblock, 2, phys_bno_out, buffer_out);
+    if (status)
+        return status;
+    countlimit = (struct ext4_dx_countlimit *)(*buffer_out + offset);
+    if (countlimit->count == 0 || countlimit->count > countlimit->limit ||
+        offset + countlimit->limit * sizeof(struct ext4_dx_entry) > vol->g.phys_blocksize) {
+        fsw_block_release(vol, *phys_bno_out, *buffer_out);
+        return FSW_UNSUPPORTED;
+    }
+    *entries_out = (struct ext4_dx_entry *)countlimit;
+    *count_out = countlimit->count;
+    return FSW_SUCCESS;
+}
+
+/**
+ * Search a leaf block of a hash-indexed directory for a name. The block is an ordinary
+ * block of directory entries. Returns FSW_NOT_FOUND if the name isn't in it.
+ */
+
+static fsw_status_t fsw_ext4_dx_leaf_find(struct fsw_ext4_volume *vol, fsw_u8 *buffer,
+                                          struct fsw_string *lookup_name, struct ext4_dir_entry *entry)
+{
+    struct ext4_dir_entry *de;
+    struct fsw_string entry_name;
+    fsw_u32         pos;
+
+    entry_name.type = FSW_STRING_TYPE_ISO88591;
+    for (pos = 0; pos + 8 <= vol->g.phys_blocksize; pos += de->rec_len) {
+        de = (struct ext4_dir_entry *)(buffer + pos);
+        if (de->rec_len < 8 || pos + de->rec_len > vol->g.phys_blocksize ||
+            (de->inode != 0 && de->rec_len < 8 + de->name_len))
+            return FSW_VOLUME_CORRUPTED;
+        if (de->inode == 0)
+            continue;
+
+        entry_name.len = entry_name.size = de->name_len;
+        entry_name.data = de->name;
+        if (fsw_streq(lookup_name, &entry_name)) {
+            fsw_memcpy(entry, de, 8 + de->name_len);
+            return FSW_SUCCESS;
+        }
+    }
+    return FSW_NOT_FOUND;
+}
+
+/**
+ * Look up a name in a hash-indexed directory. The index is walked from the root down to
+ * the leaf block for the name's hash, and only that block is searched, plus the next
+ * ones as long as the index marks them as continuing the same hash. Returns
+ * FSW_UNSUPPORTED if the index has a format we don't know or doesn't make sense, so
+ * that the caller can fall back to a linear scan.
+ */
+
+static fsw_status_t fsw_ext4_dx_lookup(struct fsw_ext4_volume *vol, struct fsw_ext4_dnode *dno,
+                                       struct fsw_string *lookup_name, struct ext4_dir_entry *entry)
+{
+    fsw_status_t    status;
+    struct fsw_string name;
+    struct ext4_dx_root_info *info;
+    struct ext4_dx_entry *entries;
+    fsw_u32         hash, levels, level, count, lo, hi, mid, lblock, offset;
+    fsw_u32         frame_block[EXT4_HTREE_LEVEL], frame_at[EXT4_HTREE_LEVEL], frame_count[EXT4_HTREE_LEVEL];
+    int             hash_version;
+    fsw_u64         phys_bno;
+    fsw_u8          *buffer;
+
+    // the hash is computed over the name as stored on disk
+    name.type = FSW_STRING_TYPE_EMPTY;
+    if (lookup_name->type == FSW_STRING_TYPE_ISO88591) {
+        name = *lookup_name;
+    } else if (lookup_name->type != FSW_STRING_TYPE_EMPTY) {
+        status = fsw_strdup_coerce(&name, FSW_STRING_TYPE_ISO88591, lookup_name);
+        if (status)
+            return status;
+    }
+    if (name.type == FSW_STRING_TYPE_EMPTY || name.len == 0 || name.len > EXT4_NAME_LEN) {
+        status = FSW_UNSUPPORTED;
+        goto done;
+    }
+
+    // the root info follows the "." and ".." entries
+    status = fsw_ext4_dir_block_get(vol, dno, 0, 2, &phys_bno, &buffer);
+    if (status)
+        goto done;
+    info = (struct ext4_dx_root_info *)(buffer + 24);
+    hash_version = info->hash_version;
+    levels = info->indirect_levels;
+    offset = 24 + info->info_length;
+    if (info->reserved_zero != 0 || info->info_length != 8)
+        hash_version = -1;
+    fsw_block_release(vol, phys_bno, buffer);
+    if (hash_version < 0 || hash_version > EXT4_HASH_TEA || levels >= EXT4_HTREE_LEVEL) {
+        status = FSW_UNSUPPORTED;
+        goto done;
+    }
+    if (vol->sb->s_flags & EXT4_FLAGS_UNSIGNED_HASH)
+        hash_version += EXT4_HASH_LEGACY_UNSIGNED;
+    hash = fsw_ext4_dx_hash(vol, (fsw_u8 *)name.data, name.len, hash_version);
+
+    // walk down the index, remembering the path for hash collisions
+    lblock = 0;
+    for (level = 0; ; level++) {
+        status = fsw_ext4_dx_entries_get(vol, dno, lblock, offset, &phys_bno, &buffer, &entries, &count);
+        if (status)
+            goto done;
+
+        // find the last entry with a hash not above ours; the first one covers all below
+        lo = 1;
+        hi = count - 1;
+        while (lo <= hi) {
+            mid = lo + (hi - lo) / 2;
+            if (entries[mid].hash > hash)
+                hi = mid - 1;
+            else
+                lo = mid + 1;
+        }
+        frame_block[level] = lblock;
+        frame_at[level] = lo - 1;
+        frame_count[level] = count;
+        lblock = entries[lo - 1].block;
+        fsw_block_release(vol, phys_bno, buffer);
+
+        if (level == levels)
+            break;
+        offset = 8;     // dx_node blocks start with an empty entry spanning the block
+    }
+
+    while (1) {
+        // search the leaf block
+        status = fsw_ext4_dir_block_get(vol, dno, lblock, 1, &phys_bno, &buffer);
+        if (status)
+            goto done;
+        status = fsw_ext4_dx_leaf_find(vol, buffer, lookup_name, entry);
+        fsw_block_release(vol, phys_bno, buffer);
+        if (status != FSW_NOT_FOUND)
+            goto done;
+
+        // go on only if the next leaf continues the same hash
+        for (level = levels + 1; level > 0 && frame_at[level - 1] + 1 >= frame_count[level - 1]; level--)
+            ;
+        if (level == 0)
+            goto done;
+        level--;
+        frame_at[level]++;
+        status = fsw_ext4_dx_entries_get(vol, dno, frame_block[level], level == 0 ? 24 + sizeof(struct ext4_dx_root_info) : 8,
+                                         &phys_bno, &buffer, &entries, &count);
+        if (status)
+            goto done;
+        lblock = entries[frame_at[level]].block;
+        if ((entries[frame_at[level]].hash & ~1) != hash) {
+            fsw_block_release(vol, phys_bno, buffer);
+            status = FSW_NOT_FOUND;
+            goto done;
+        }
+        fsw_block_release(vol, phys_bno, buffer);
+
+        // and down the leftmost path of the subtree below it
+        for (level++; level <= levels; level++) {
+            status = fsw_ext4_dx_entries_get(vol, dno, lblock, 8, &phys_bno, &buffer, &entries, &count);
+            if (status)
+                goto done;
+            frame_block[level] = lblock;
+            frame_at[level] = 0;
+            frame_count[level] = count;
+            lblock = entries[0].block;
+            fsw_block_release(vol, phys_bno, buffer);
+        }
+    }
+
+done:
+    if (name.type != FSW_STRING_TYPE_EMPTY && name.data != lookup_name->data)
+        fsw_strfree(&name);
+    return status;
+}
+
+/**
+ * Read the inodes of all entries in a directory block into the inode cache. The
+ * inode table blocks holding them are sorted and read in runs, one request per run.
+ * With flex_bg, the inode tables of neighbouring groups are next to each other on
+ * disk, so a run can span several groups. Errors are ignored; the inodes are then
+ * read one by one as usual.
+ */
+
+static void fsw_ext4_inode_prefetch(struct fsw_ext4_volume *vol, struct fsw_ext4_dnode *dir, fsw_u32 lblock)
+{
+    fsw_u32         inos[FSW_EXT4_PREFETCH_MAX], ino_count, i, j, pos, index;
+    fsw_u64         bnos[FSW_EXT4_PREFETCH_MAX], bno, start, dir_bno;
+    fsw_u32         blocksize = vol->g.phys_blocksize;
+    struct ext4_dir_entry *de;
+    fsw_u8          *buffer, *run;
+
+    if (fsw_ext4_dir_block_get(vol, dir, lblock, 1, &dir_bno, &buffer))
+        return;
+
+    // collect the inodes that aren't cached yet, sorted by inode table block
+    ino_count = 0;
+    for (pos = 0; pos + 8 <= blocksize && ino_count < FSW_EXT4_PREFETCH_MAX; pos += de->rec_len) {
+        de = (struct ext4_dir_entry *)(buffer + pos);
+        if (de->rec_len < 8 || pos + de->rec_len > blocksize)
+            break;
+        if (de->inode == 0 || (de->name_len <= 2 && de->name[0] == '.' && (de->name_len == 1 || de->name[1] == '.')))
+            continue;
+        if (fsw_ext4_icache_lookup(vol, de->inode) != NULL || fsw_ext4_inode_locate(vol, de->inode, &bno, &index))
+            continue;
+        for (i = ino_count; i > 0 && bnos[i - 1] > bno; i--) {
+            bnos[i] = bnos[i - 1];
+            inos[i] = inos[i - 1];
+        }
+        bnos[i] = bno;
+        inos[i] = de->inode;
+        ino_count++;
+    }
+    fsw_block_release(vol, dir_bno, buffer);
+    if (ino_count == 0)
+        return;
+
+    if (fsw_alloc(FSW_EXT4_PREFETCH_RUN * blocksize, &run))
+        return;
+    for (i = 0; i < ino_count; i = j) {
+        // extend the run over close blocks
+        start = bnos[i];
+        for (j = i + 1; j < ino_count && bnos[j] - bnos[j - 1] <= FSW_EXT4_PREFETCH_GAP + 1 &&
+                        bnos[j] - start < FSW_EXT4_PREFETCH_RUN; j++)
+            ;
+        if (fsw_block_read_direct(vol, start, (fsw_u32)(bnos[j - 1] - start) + 1, run))
+            break;
+        for (; i < j; i++) {
+            fsw_ext4_inode_locate(vol, inos[i], &bno, &index);
+            fsw_ext4_icache_store(vol, inos[i], run + (fsw_u32)(bno - start) * blocksize + index * vol->inode_size);
+        }
+    }
+    fsw_free(run);
+}
+
 /**
  * Get the next directory entry when reading a directory. This function is called during
  * directory iteration to retrieve the next directory entry. A dnode is constructed for
@@ -649,24 +1506,68 @@ static fsw_status_t fsw_ext4_dir_read(struct fsw_ext4_volume *vol, struct fsw_ex
     entry_name.len = entry_name.size = entry.name_len;
     entry_name.data = entry.name;
 
-    // setup a dnode for the child item
-    status = fsw_dnode_create(dno, entry.inode, FSW_DNODE_TYPE_UNKNOWN, &entry_name, child_dno_out);
+    // setup a dnode for the child item, remembering where its entry is for prefetching
+    status = fsw_dnode_create(dno, entry.inode, fsw_ext4_dentry_type(vol, &entry), &entry_name, child_dno_out);
+    if (status == FSW_SUCCESS && (*child_dno_out)->raw == NULL)
+        (*child_dno_out)->dir_lblock = (fsw_u32)FSW_U64_DIV(shand->pos - 1, vol->g.log_blocksize) + 1;
 
     return status;
 }
 
+/**
+ * Get the dnode type recorded in a directory entry. This lets the host tell files from
+ * directories without reading the inode. Returns FSW_DNODE_TYPE_UNKNOWN if the file
+ * system doesn't store types in directory entries.
+ */
+
+static int fsw_ext4_dentry_type(struct fsw_ext4_volume *vol, struct ext4_dir_entry *entry)
+{
+    if ((vol->sb->s_feature_incompat & EXT4_FEATURE_INCOMPAT_FILETYPE) == 0)
+        return FSW_DNODE_TYPE_UNKNOWN;
+
+    switch (entry->file_type) {
+        case EXT4_FT_REG_FILE:
+            return FSW_DNODE_TYPE_FILE;
+        case EXT4_FT_DIR:
+            return FSW_DNODE_TYPE_DIR;
+        case EXT4_FT_SYMLINK:
+            return FSW_DNODE_TYPE_SYMLINK;
+        case EXT4_FT_CHRDEV:
+        case EXT4_FT_BLKDEV:
+        case EXT4_FT_FIFO:
+        case EXT4_FT_SOCK:
+            return FSW_DNODE_TYPE_SPECIAL;
+        default:
+            return FSW_DNODE_TYPE_UNKNOWN;
+    }
+}
+
 /**
  * Read a directory entry from the directory's raw data. This internal function is used
  * to read a raw ext2 directory entry into memory. The shandle's position pointer is adjusted
- * to point to the next entry.
+ * to point to the next entry. With metadata checksums, each directory block is checked
+ * when the position enters it.
  */
 
 static fsw_status_t fsw_ext4_read_dentry(struct fsw_shandle *shand, struct ext4_dir_entry *entry)
 {
     fsw_status_t    status;
     fsw_u32         buffer_size;
+    struct fsw_ext4_volume *vol = (struct fsw_ext4_volume *)shand->dnode->vol;
+    struct fsw_ext4_dnode *dno = (struct fsw_ext4_dnode *)shand->dnode;
+    fsw_u64         phys_bno;
+    fsw_u8          *buffer;
 
     while (1) {
+        if (vol->csum && ((fsw_u32)shand->pos & (vol->g.log_blocksize - 1)) == 0) {
+            status = fsw_ext4_dir_block_get(vol, dno, (fsw_u32)FSW_U64_DIV(shand->pos, vol->g.log_blocksize), 1,
+                                            &phys_bno, &buffer);
+            if (status == FSW_SUCCESS)
+                fsw_block_release(vol, phys_bno, buffer);
+            else if (status != FSW_UNSUPPORTED)     // past the end or a hole
+                return status;
+        }
+
         // read dir_entry header (fixed length)
         buffer_size = 8;
         status = fsw_shandle_read(shand, &buffer_size, entry);
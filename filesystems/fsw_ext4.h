@@ -37,6 +37,27 @@
 //! Block number where the (master copy of the) ext4 superblock resides.
 #define EXT4_SUPERBLOCK_BLOCKNO       1
 
+#ifndef FSW_EXT4_VERIFY_CSUM
+//! Verify metadata checksums on file systems with the metadata_csum feature.
+#define FSW_EXT4_VERIFY_CSUM        (1)
+#endif
+#ifndef FSW_EXT4_INODE_CACHE_SIZE
+//! Number of raw inodes kept per volume, direct-mapped by inode number.
+#define FSW_EXT4_INODE_CACHE_SIZE   (512)
+#endif
+#ifndef FSW_EXT4_PREFETCH_MAX
+//! Maximum number of inodes prefetched for one directory block.
+#define FSW_EXT4_PREFETCH_MAX       (128)
+#endif
+#ifndef FSW_EXT4_PREFETCH_RUN
+//! Maximum number of inode table blocks read in one request when prefetching.
+#define FSW_EXT4_PREFETCH_RUN       (32)
+#endif
+#ifndef FSW_EXT4_PREFETCH_GAP
+//! Number of unneeded inode table blocks read along rather than starting a new request.
+#define FSW_EXT4_PREFETCH_GAP       (4)
+#endif
+
 
 /**
  * ext4: Volume structure with ext2-specific data.
@@ -50,6 +71,13 @@ struct fsw_ext4_volume {
     fsw_u32     ind_bcnt;           //!< Number of blocks addressable through an indirect block
     fsw_u32     dind_bcnt;          //!< Number of blocks addressable through a double-indirect block
     fsw_u32     inode_size;         //!< Size of inode structure in bytes
+    fsw_u32     groupcnt;           //!< Number of block groups
+    int         csum;               //!< Whether metadata checksums are verified
+    fsw_u32     csum_seed;          //!< Checksum seed for the file system, from its UUID
+    fsw_u8      *icache;            //!< Inode cache, FSW_EXT4_INODE_CACHE_SIZE raw inodes
+    fsw_u32     *icache_ino;        //!< Inode number in each slot of the inode cache, 0 if empty
+    fsw_u64     prefetch_dir;       //!< Inode number of the directory prefetched for last
+    fsw_u32     prefetch_lblock;    //!< Logical block of that directory prefetched for last
 };
 
 /**
@@ -60,6 +88,13 @@ struct fsw_ext4_dnode {
     struct fsw_dnode g;             //!< Generic dnode structure
     
     struct ext4_inode *raw;         //!< Full raw inode structure
+    fsw_u32     csum_seed;          //!< Checksum seed for the inode's metadata blocks
+    fsw_u32     *ind_block[3];      //!< Copy of the indirect block read last at each step of the mapping path
+    fsw_u32     ind_bno[3];         //!< Block number of each copy in ind_block, 0 if none
+    struct ext4_extent_header *ext_leaf;    //!< Copy of the extent tree leaf block used last, or NULL
+    fsw_u32     ext_leaf_start;     //!< First logical block covered by ext_leaf
+    fsw_u32     ext_leaf_end;       //!< First logical block after the ones covered by ext_leaf
+    fsw_u32     dir_lblock;         //!< 1 + logical block of the parent's directory entry, 0 if unknown
 };
 
 
@@ -366,7 +366,13 @@ struct ext4_super_block {
 	__le32	s_usr_quota_inum;	/* inode for tracking user quota */
 	__le32	s_grp_quota_inum;	/* inode for tracking group quota */
 	__le32	s_overhead_clusters;	/* overhead blocks/clusters in fs */
-	__le32	s_reserved[108];	/* Padding to the end of the block */
+	__le32	s_backup_bgs[2];	/* groups with sparse_super2 SBs */
+	__u8	s_encrypt_algos[4];	/* Encryption algorithms in use  */
+	__u8	s_encrypt_pw_salt[16];	/* Salt used for string2key algorithm */
+	__le32	s_lpf_ino;		/* Location of the lost+found inode */
+	__le32	s_prj_quota_inum;	/* inode for tracking project quota */
+	__le32	s_checksum_seed;	/* crc32c(uuid) if csum_seed set */
+	__le32	s_reserved[98];		/* Padding to the end of the block */
 	__le32	s_checksum;		/* crc32c(superblock) */
 };
 
@@ -381,10 +387,19 @@ struct ext4_super_block {
 
 #define EXT4_GOOD_OLD_INODE_SIZE 128
 
+/* s_creator_os */
+#define EXT4_OS_LINUX           0
+
+/* s_checksum_type */
+#define EXT4_CRC32C_CHKSUM      1
+
 /*
  * Feature set definitions (only the once we need for read support)
  */
+#define EXT4_FEATURE_COMPAT_DIR_INDEX           0x0020
+
 #define EXT4_FEATURE_RO_COMPAT_SPARSE_SUPER     0x0001
+#define EXT4_FEATURE_RO_COMPAT_METADATA_CSUM    0x0400
 
 #define EXT4_FEATURE_INCOMPAT_COMPRESSION	0x0001
 #define EXT4_FEATURE_INCOMPAT_FILETYPE		0x0002
@@ -398,6 +413,7 @@ struct ext4_super_block {
 #define EXT4_FEATURE_INCOMPAT_EA_INODE		0x0400 /* EA in inode */
 #define EXT4_FEATURE_INCOMPAT_DIRDATA		0x1000 /* data in dirent */
 #define EXT4_FEATURE_INCOMPAT_BG_USE_META_CSUM	0x2000 /* use crc32c for bg */
+#define EXT4_FEATURE_INCOMPAT_CSUM_SEED		0x2000 /* s_checksum_seed is set */
 #define EXT4_FEATURE_INCOMPAT_LARGEDIR		0x4000 /* >2GB or 3-lvl htree */
 #define EXT4_FEATURE_INCOMPAT_INLINEDATA	0x8000 /* data in inode */
 #define EXT4_FEATURE_INCOMPAT_ENCRYPT		0x10000 /* BK ext4 fscrypt encryption */
@@ -425,6 +441,20 @@ struct ext4_dir_entry {
 // NOTE: The original Linux kernel header defines ext4_dir_entry with the original
 //  layout and ext4_dir_entry_2 with the revised layout. We simply use the revised one.
 
+/*
+ * With metadata_csum, directory leaf blocks end in a fake entry holding the
+ * checksum of the block, crc32c(uuid+inum+igeneration+block).
+ */
+struct ext4_dir_entry_tail {
+    __le32  det_reserved_zero1;     /* Pretend to be unused */
+    __le16  det_rec_len;            /* 12 */
+    __u8    det_reserved_zero2;     /* Zero name length */
+    __u8    det_reserved_ft;        /* 0xDE, fake file type */
+    __le32  det_checksum;           /* crc32c(uuid+inum+dirblock) */
+};
+
+#define EXT4_DIR_TAIL_FT                0xDE
+
 /*
  * Ext2 directory file types.  Only the low 3 bits are used.  The
  * other bits are reserved for now.
@@ -441,6 +471,53 @@ enum {
     EXT4_FT_MAX
 };
 
+/*
+ * Hash-indexed (dir_index, "htree") directories. Block 0 of the directory holds the
+ * dx_root: a "." entry, a ".." entry spanning the rest of the block, the root info,
+ * and the index entries. Lower index levels are dx_node blocks, a single empty entry
+ * spanning the block followed by the index entries. Both look like blocks without
+ * entries to code that doesn't know about the index. The first index entry of a block
+ * holds the limit and count instead of a hash; its block covers all hashes below
+ * that of the second entry.
+ */
+#define EXT4_HASH_LEGACY                0
+#define EXT4_HASH_HALF_MD4              1
+#define EXT4_HASH_TEA                   2
+#define EXT4_HASH_LEGACY_UNSIGNED       3
+#define EXT4_HASH_HALF_MD4_UNSIGNED     4
+#define EXT4_HASH_TEA_UNSIGNED          5
+
+/* s_flags: how the hash was computed for names with bytes of 0x80 and up */
+#define EXT4_FLAGS_SIGNED_HASH          0x0001
+#define EXT4_FLAGS_UNSIGNED_HASH        0x0002
+
+/* Maximum number of index levels below the root, with the largedir feature */
+#define EXT4_HTREE_LEVEL                3
+
+struct ext4_dx_root_info {
+    __le32  reserved_zero;
+    __u8    hash_version;
+    __u8    info_length;            /* 8 */
+    __u8    indirect_levels;
+    __u8    unused_flags;
+};
+
+struct ext4_dx_countlimit {
+    __le16  limit;
+    __le16  count;
+};
+
+struct ext4_dx_entry {
+    __le32  hash;
+    __le32  block;                  /* logical block in the directory */
+};
+
+/* With metadata_csum, follows the last possible entry (limit) of index blocks */
+struct ext4_dx_tail {
+    __le32  dt_reserved;
+    __le32  dt_checksum;            /* crc32c(uuid+inum+dirblock) */
+};
+
 /*
  * ext4_inode has i_block array (60 bytes total).
  * The first 12 bytes store ext4_extent_header;
@@ -497,5 +574,12 @@ struct ext4_extent_header {
 
 #define EXT4_EXT_MAGIC		(0xf30a)
 
+/*
+ * ee_len above EXT_INIT_MAX_LEN marks an unwritten extent of
+ * ee_len - EXT_INIT_MAX_LEN blocks, which reads as zeros.
+ */
+#define EXT_INIT_MAX_LEN	(1UL << 15)
+#define EXT_MAX_EXTENT_DEPTH	5
+
 
 #endif
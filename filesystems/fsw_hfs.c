@@ -77,7 +77,7 @@ static fsw_status_t fsw_hfs_readlink(struct fsw_hfs_volume *vol, struct fsw_hfs_
 //
 
 struct fsw_fstype_table   FSW_FSTYPE_TABLE_NAME(hfs) = {
-    { FSW_STRING_TYPE_ISO88591, 4, 4, "hfs" },
+    { FSW_STRING_TYPE_ISO88591, 3, 3, "hfs" },
     sizeof(struct fsw_hfs_volume),
     sizeof(struct fsw_hfs_dnode),
 
@@ -591,6 +591,73 @@ fsw_hfs_btree_rec (struct fsw_hfs_btree   * btree,
 }
 
 
+/*
+ * Get a B-tree node for parsing in place. If the node lies in consecutive disk blocks
+ * it is pinned in the core's block cache, otherwise it is copied into a new buffer.
+ * Either way it must be given back with fsw_hfs_btree_put_node.
+ */
+static fsw_status_t
+fsw_hfs_btree_get_node (struct fsw_hfs_btree * btree,
+                        fsw_u32                nodenum,
+                        BTNodeDescriptor    ** node_out)
+{
+    struct fsw_hfs_dnode  *dno = btree->file;
+    struct fsw_hfs_volume *vol = (struct fsw_hfs_volume *)dno->g.vol;
+    fsw_u32               block_size_bits = vol->block_size_shift;
+    fsw_u32               block_size = (1 << block_size_bits);
+    fsw_u64               pos = (fsw_u64)nodenum * btree->node_size;
+    fsw_u32               log_bno = (fsw_u32)RShiftU64(pos, block_size_bits);
+    fsw_u32               off = (fsw_u32)pos & (block_size - 1);
+    fsw_u32               count = (off + btree->node_size + block_size - 1) >> block_size_bits;
+    fsw_u64               phys_bno = 0;
+    struct fsw_extent     extent;
+    fsw_status_t          status;
+    fsw_u8                *buffer;
+    fsw_u32               i;
+
+    /* Check that the node's blocks follow each other on disk */
+    for (i = 0; i < count; i++)
+    {
+        extent.log_start = log_bno + i;
+        status = fsw_hfs_get_extent(vol, dno, &extent);
+        if (status)
+            return status;
+        if (i == 0)
+            phys_bno = extent.phys_start;
+        else if (extent.phys_start != phys_bno + i)
+            break;
+    }
+
+    if (i == count)
+    {
+        status = fsw_block_pin(vol, phys_bno, count, 3, (void **)&buffer);
+        if (status)
+            return status;
+        *node_out = (BTNodeDescriptor*)(buffer + off);
+        return FSW_SUCCESS;
+    }
+
+    status = fsw_alloc(btree->node_size, &buffer);
+    if (status)
+        return status;
+    if (fsw_hfs_read_file (dno, pos, btree->node_size, buffer) <= 0)
+    {
+        fsw_free(buffer);
+        return FSW_VOLUME_CORRUPTED;
+    }
+    *node_out = (BTNodeDescriptor*)buffer;
+    return FSW_SUCCESS;
+}
+
+/* Give back a node from fsw_hfs_btree_get_node */
+static void
+fsw_hfs_btree_put_node (struct fsw_hfs_btree * btree,
+                        BTNodeDescriptor     * node)
+{
+    if (fsw_block_unpin(btree->file->g.vol, node))
+        fsw_free(node);
+}
+
 static fsw_status_t
 fsw_hfs_btree_search (struct fsw_hfs_btree * btree,
                       BTreeKey             * key,
@@ -598,17 +665,13 @@ fsw_hfs_btree_search (struct fsw_hfs_btree * btree,
                       BTNodeDescriptor    ** result,
                       fsw_u32              * key_offset)
 {
-    BTNodeDescriptor* node;
+    BTNodeDescriptor* node = NULL;
     fsw_u32 currnode;
     fsw_u32 rec;
     fsw_status_t status;
-    fsw_u8* buffer = NULL;
+    fsw_u8* buffer;
 
     currnode = btree->root_node;
-    status = fsw_alloc(btree->node_size, &buffer);
-    if (status)
-        return status;
-    node = (BTNodeDescriptor*)buffer;
 
     while (1)
     {
@@ -618,14 +681,16 @@ fsw_hfs_btree_search (struct fsw_hfs_btree * btree,
 
     readnode:
         match = 0;
-        /* Read a node.  */
-        if (fsw_hfs_read_file (btree->file,
-                               (fsw_u64)currnode * btree->node_size,
-                               btree->node_size, buffer) <= 0)
+        /* Get the node, parsed in place.  */
+        if (node != NULL)
+            fsw_hfs_btree_put_node (btree, node);
+        status = fsw_hfs_btree_get_node (btree, currnode, &node);
+        if (status)
         {
-            status = FSW_VOLUME_CORRUPTED;
+            node = NULL;
             break;
         }
+        buffer = (fsw_u8*)node;
 
         if (be16_to_cpu(*(fsw_u16*)(buffer + btree->node_size - 2)) != sizeof(BTNodeDescriptor))
             BP("corrupted node\n");
@@ -734,8 +799,8 @@ fsw_hfs_btree_search (struct fsw_hfs_btree * btree,
 
 
   done:
-    if (buffer != NULL && status != FSW_SUCCESS)
-        fsw_free(buffer);
+    if (node != NULL && status != FSW_SUCCESS)
+        fsw_hfs_btree_put_node (btree, node);
 
     return status;
 }
@@ -846,13 +911,8 @@ fsw_hfs_btree_iterate_node (struct fsw_hfs_btree * btree,
                             void                  * param)
 {
   fsw_status_t status;
-  /* We modify node, so make a copy */
+  /* first_node stays with the caller, later nodes are ours */
   BTNodeDescriptor*     node = first_node;
-  fsw_u8* buffer = NULL;
-
-  status = fsw_alloc(btree->node_size, &buffer);
-  if (status)
-      return status;
 
   while (1)
   {
@@ -885,20 +945,17 @@ fsw_hfs_btree_iterate_node (struct fsw_hfs_btree * btree,
           break;
       }
 
-      if (fsw_hfs_read_file (btree->file,
-                             next_node * btree->node_size,
-                             btree->node_size, buffer) <= 0)
-      {
-          status = FSW_VOLUME_CORRUPTED;
-          return 1;
-      }
+      if (node != first_node)
+          fsw_hfs_btree_put_node (btree, node);
+      status = fsw_hfs_btree_get_node (btree, next_node, &node);
+      if (status)
+          return status;
 
-      node = (BTNodeDescriptor*)buffer;
       first_rec = 0;
   }
  done:
-  if (buffer)
-      fsw_free(buffer);
+  if (node != first_node)
+      fsw_hfs_btree_put_node (btree, node);
 
   return status;
 }
@@ -1079,7 +1136,7 @@ static fsw_status_t fsw_hfs_get_extent(struct fsw_hfs_volume * vol,
 
         if (node != NULL)
         {
-            fsw_free(node);
+            fsw_hfs_btree_put_node (&vol->extents_tree, node);
             node = NULL;
         }
 
@@ -1096,7 +1153,7 @@ static fsw_status_t fsw_hfs_get_extent(struct fsw_hfs_volume * vol,
     }
 
     if (node != NULL)
-        fsw_free(node);
+        fsw_hfs_btree_put_node (&vol->extents_tree, node);
 
     return status;
 }
@@ -1209,7 +1266,11 @@ static fsw_status_t fsw_hfs_dir_lookup(struct fsw_hfs_volume * vol,
     {
         if (fsw_memeq(g_blacklist[i], catkey.nodeName.unicode, catkey.nodeName.length*2))
         {
+#ifdef HOST_POSIX
+            DPRINT2("Blacklisted entry %d\n", i);   // the names are UTF-16
+#else
             DPRINT2("Blacklisted %s\n", g_blacklist[i]);
+#endif
             status = FSW_NOT_FOUND;
             goto done;
         }
@@ -1288,7 +1349,7 @@ create:
 done:
 
     if (node != NULL)
-        fsw_free(node);
+        fsw_hfs_btree_put_node (&vol->catalog_tree, node);
 
     if (free_data)
         fsw_strfree(&rec_name);
@@ -1352,6 +1413,8 @@ static fsw_status_t fsw_hfs_dir_read(struct fsw_hfs_volume *vol,
         goto done;
 
  done:
+    if (node != NULL)
+        fsw_hfs_btree_put_node (&vol->catalog_tree, node);
     fsw_strfree(&rec_name);
 
     return status;
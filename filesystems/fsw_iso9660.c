@@ -109,7 +109,7 @@ static fsw_status_t rr_read_ce(struct fsw_iso9660_volume *vol, union fsw_rock_ri
 //
 
 struct fsw_fstype_table   FSW_FSTYPE_TABLE_NAME(iso9660) = {
-    { FSW_STRING_TYPE_ISO88591, 4, 4, "iso9660" },
+    { FSW_STRING_TYPE_ISO88591, 7, 7, "iso9660" },
     sizeof(struct fsw_iso9660_volume),
     sizeof(struct fsw_iso9660_dnode),
 
@@ -618,12 +618,10 @@ static fsw_status_t fsw_iso9660_read_dirrec(struct fsw_iso9660_volume *vol, stru
 
     if (buffer_size < 33 || dirrec->dirrec_length == 0) {
         // end of directory reached
-        fsw_u8 *r;
-        r = (fsw_u8 *)dirrec;
  //       DEBUG((DEBUG_INFO, "%a:%d bs:%d dl:%d\n", __FILE__, __LINE__, buffer_size, dirrec->dirrec_length));
         for(i = 0; i < buffer_size; ++i)
         {
-            DEBUG((DEBUG_INFO, "r[%d]:%c", i, r[i]));
+            DEBUG((DEBUG_INFO, "r[%d]:%c", i, ((fsw_u8 *)dirrec)[i]));
         }
         dirrec->dirrec_length = 0;
         return FSW_SUCCESS;
@@ -71,6 +71,180 @@ fsw_status_t fsw_memdup(void **dest_out, void *src, int len)
     return FSW_SUCCESS;
 }
 
+/** Alignment of objects handed out by slabs and arenas. */
+#define FSW_ALLOC_ALIGN (8)
+#define FSW_ALLOC_ROUND(len) (((len) + FSW_ALLOC_ALIGN - 1) & ~(fsw_u32)(FSW_ALLOC_ALIGN - 1))
+
+/** Number of objects carved out of one slab chunk. */
+#define FSW_SLAB_CHUNK_OBJS (32)
+/** Minimum size of an arena chunk. Larger allocations get a chunk of their own. */
+#define FSW_ARENA_CHUNK_SIZE (4096)
+
+/**
+ * Header of an arena chunk. The usable memory follows directly after it.
+ */
+
+struct fsw_arena_chunk {
+    struct fsw_arena_chunk *next;   //!< Next (older) chunk
+    fsw_u32     size;               //!< Usable size of this chunk
+    fsw_u32     used;               //!< Bytes handed out from this chunk
+};
+
+#define FSW_ARENA_HEADER_SIZE FSW_ALLOC_ROUND(sizeof(struct fsw_arena_chunk))
+
+/**
+ * Set up a slab for objects of the given size. No memory is allocated until the
+ * first call to fsw_slab_alloc.
+ */
+
+void fsw_slab_init(struct fsw_slab *slab, fsw_u32 obj_size)
+{
+    if (obj_size < sizeof(void *))
+        obj_size = sizeof(void *);
+    slab->obj_size = FSW_ALLOC_ROUND(obj_size);
+    slab->chunk_objs = FSW_SLAB_CHUNK_OBJS;
+    slab->free_list = NULL;
+    slab->chunks = NULL;
+    slab->alloc_count = 0;
+    slab->chunk_count = 0;
+}
+
+/**
+ * Get a cleared object from a slab. When the free list is empty, a new chunk is
+ * allocated and all of its objects are put on the free list.
+ */
+
+fsw_status_t fsw_slab_alloc(struct fsw_slab *slab, void **ptr_out)
+{
+    fsw_status_t    status;
+    fsw_u8          *chunk;
+    fsw_u32         i;
+    void            *obj;
+
+    if (slab->free_list == NULL) {
+        // the first object-sized slot of a chunk links the chunks together
+        status = fsw_alloc(slab->obj_size * (slab->chunk_objs + 1), &chunk);
+        if (status)
+            return status;
+        *(void **)chunk = slab->chunks;
+        slab->chunks = chunk;
+        slab->chunk_count++;
+        for (i = slab->chunk_objs; i > 0; i--) {
+            obj = chunk + i * slab->obj_size;
+            *(void **)obj = slab->free_list;
+            slab->free_list = obj;
+        }
+    }
+
+    obj = slab->free_list;
+    slab->free_list = *(void **)obj;
+    fsw_memzero(obj, slab->obj_size);
+    slab->alloc_count++;
+    *ptr_out = obj;
+    return FSW_SUCCESS;
+}
+
+/**
+ * Return an object to its slab. The memory is kept for reuse.
+ */
+
+void fsw_slab_free(struct fsw_slab *slab, void *ptr)
+{
+    if (ptr == NULL)
+        return;
+    *(void **)ptr = slab->free_list;
+    slab->free_list = ptr;
+}
+
+/**
+ * Free all chunks of a slab. All objects taken from the slab become invalid.
+ */
+
+void fsw_slab_destroy(struct fsw_slab *slab)
+{
+    void            *chunk;
+
+    while (slab->chunks != NULL) {
+        chunk = slab->chunks;
+        slab->chunks = *(void **)chunk;
+        fsw_free(chunk);
+    }
+    slab->free_list = NULL;
+}
+
+/**
+ * Get memory from an arena. The memory is not cleared and stays valid until
+ * the arena is reset or freed.
+ */
+
+fsw_status_t fsw_arena_alloc(struct fsw_arena *arena, fsw_u32 len, void **ptr_out)
+{
+    fsw_status_t    status;
+    struct fsw_arena_chunk *chunk;
+    fsw_u32         size;
+
+    len = FSW_ALLOC_ROUND(len);
+    chunk = arena->chunks;
+    if (chunk == NULL || chunk->size - chunk->used < len) {
+        size = len > FSW_ARENA_CHUNK_SIZE ? len : FSW_ARENA_CHUNK_SIZE;
+        status = fsw_alloc(FSW_ARENA_HEADER_SIZE + size, &chunk);
+        if (status)
+            return status;
+        chunk->size = size;
+        chunk->used = 0;
+        chunk->next = arena->chunks;
+        arena->chunks = chunk;
+        arena->chunk_count++;
+    }
+
+    *ptr_out = (fsw_u8 *)chunk + FSW_ARENA_HEADER_SIZE + chunk->used;
+    chunk->used += len;
+    arena->alloc_count++;
+    return FSW_SUCCESS;
+}
+
+/**
+ * Release everything allocated from an arena. The largest chunk is kept so that
+ * the next round of allocations doesn't have to go to the host again.
+ */
+
+void fsw_arena_reset(struct fsw_arena *arena)
+{
+    struct fsw_arena_chunk *chunk, *keep;
+
+    keep = NULL;
+    while (arena->chunks != NULL) {
+        chunk = arena->chunks;
+        arena->chunks = chunk->next;
+        if (keep == NULL || chunk->size > keep->size) {
+            if (keep != NULL)
+                fsw_free(keep);
+            keep = chunk;
+        } else
+            fsw_free(chunk);
+    }
+    if (keep != NULL) {
+        keep->next = NULL;
+        keep->used = 0;
+    }
+    arena->chunks = keep;
+}
+
+/**
+ * Free all memory of an arena.
+ */
+
+void fsw_arena_free(struct fsw_arena *arena)
+{
+    struct fsw_arena_chunk *chunk;
+
+    while (arena->chunks != NULL) {
+        chunk = arena->chunks;
+        arena->chunks = chunk->next;
+        fsw_free(chunk);
+    }
+}
+
 /**
  * Get the length of a string. Returns the number of characters in the string.
  */
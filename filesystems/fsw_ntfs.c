@@ -407,6 +407,23 @@ static fsw_status_t read_attribute_direct(struct fsw_ntfs_volume *vol, fsw_u8 *p
 
     while(len > 0 && get_extent(&ptr, &len, &lcn, &cnt, &pos)==FSW_SUCCESS) {
 	if(lcn) {
+	    /* whole clusters of the run go straight into the output buffer */
+	    fsw_u64 full = olen > 0 ? (fsw_u64)(olen >> vol->clbits) : 0;
+	    if(full > cnt)
+		full = cnt;
+	    if(full > 0) {
+		if (fsw_block_read_direct(&vol->g, lcn, (fsw_u32)full, buf) != FSW_SUCCESS)
+		{
+		    fsw_free(*optrp);
+		    *optrp = NULL;
+		    *olenp = 0;
+		    return FSW_VOLUME_CORRUPTED;
+		}
+		buf += full << vol->clbits;
+		olen -= full << vol->clbits;
+		lcn += full;
+		cnt -= full;
+	    }
 	    for(; cnt>0; lcn++, cnt--) {
 		fsw_u8 *block;
 		if (fsw_block_get(&vol->g, lcn, 0, (void **)&block) != FSW_SUCCESS)
@@ -220,7 +220,7 @@ static fsw_status_t fsw_reiserfs_dnode_fill(struct fsw_reiserfs_volume *vol, str
     status = fsw_reiserfs_item_search(vol, dno->dir_id, dno->g.dnode_id, 0, &item);
     if (status == FSW_NOT_FOUND) {
         FSW_MSG_ASSERT((FSW_MSGSTR("fsw_reiserfs_dnode_fill: cannot find stat_data for object %d/%d\n"),
-                        dno->dir_id, dno->g.dnode_id));
+                        dno->dir_id, (fsw_u32)dno->g.dnode_id));
         return FSW_VOLUME_CORRUPTED;
     }
     if (status)
@@ -257,7 +257,7 @@ static fsw_status_t fsw_reiserfs_dnode_fill(struct fsw_reiserfs_volume *vol, str
 
     } else {
         FSW_MSG_ASSERT((FSW_MSGSTR("fsw_reiserfs_dnode_fill: version %d(%d) and size %d(%d) not recognized for stat_data\n"),
-                        item.ih.ih_version, KEY_FORMAT_3_6, item_len, SD_V2_SIZE));
+                        item.ih.ih_version, KEY_FORMAT_3_6, item_len, (int)SD_V2_SIZE));
         fsw_reiserfs_item_release(vol, &item);
         return FSW_VOLUME_CORRUPTED;
     }
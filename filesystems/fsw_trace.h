@@ -0,0 +1,63 @@
+/**
+ * \file fsw_trace.h
+ * Binary format of the I/O traces written by the hosts and replayed by test/fswreplay.
+ */
+
+/*
+ * This program is licensed under the terms of the GNU GPL, version 3,
+ * or (at your option) any later version.
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _FSW_TRACE_H_
+#define _FSW_TRACE_H_
+
+#include "fsw_core.h"
+
+
+/**
+ * A trace is a header followed by fixed-size records, one per read request that the
+ * FSW core passed to the host, in the order they were made. All numbers are
+ * little-endian. Readers should use record_size to step through the records, so
+ * that fields can be added at the end.
+ */
+
+#define FSW_TRACE_MAGIC         "FSWTRACE"
+#define FSW_TRACE_VERSION       (1)
+
+struct fsw_trace_header {
+    fsw_u8      magic[8];           //!< FSW_TRACE_MAGIC, not null-terminated
+    fsw_u16     version;            //!< FSW_TRACE_VERSION
+    fsw_u16     record_size;        //!< Size of each record in bytes
+    fsw_u8      window_shift;       //!< Host read cache window size as a power of 2, 0 if the host has no cache
+    fsw_u8      cache_sets;         //!< Number of sets in the host read cache
+    fsw_u8      cache_ways;         //!< Number of windows per set in the host read cache
+    fsw_u8      reserved;
+    fsw_u8      fstype[16];         //!< Name of the file system driver, null-padded
+};
+
+/** Record types. */
+#define FSW_TRACE_MOUNT         (1) //!< A volume was mounted; block is the device size in bytes
+#define FSW_TRACE_BLOCK         (2) //!< read_block of one block
+#define FSW_TRACE_BLOCKS        (3) //!< read_blocks of a run of blocks
+#define FSW_TRACE_ASYNC         (4) //!< read_blocks_submit that was queued with the device
+#define FSW_TRACE_CLEAR         (5) //!< The host read cache of the volume was emptied
+
+/** How a request was served by the host read cache. */
+#define FSW_TRACE_UNCACHED      (0) //!< Not through the cache
+#define FSW_TRACE_HIT           (1) //!< Copied from a cached window
+#define FSW_TRACE_MISS          (2) //!< The window around it was read from the device
+
+struct fsw_trace_record {
+    fsw_u64     ticks;              //!< FSW_TICKS at the time of the request, 0 if the host has no clock
+    fsw_u64     block;              //!< First block, in units of 1 << block_shift bytes
+    fsw_u32     count;              //!< Number of blocks
+    fsw_u8      volume;             //!< Volume number, in mount order starting at 0
+    fsw_u8      type;               //!< One of the FSW_TRACE_* record types
+    fsw_u8      outcome;            //!< One of the FSW_TRACE_* cache outcomes
+    fsw_u8      block_shift;        //!< Block size as a power of 2
+};
+
+
+#endif
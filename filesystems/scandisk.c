@@ -51,7 +51,7 @@ static struct fsw_fstype_table   dummy_fstype = {
     NULL, //readlink,
 };
 
-static struct fsw_volume *create_dummy_volume(EFI_DISK_IO *diskio, UINT32 mediaid)
+static struct fsw_volume *create_dummy_volume(EFI_HANDLE handle, EFI_DISK_IO *diskio, UINT32 mediaid)
 {
     fsw_status_t err;
     struct fsw_volume *vol;
@@ -68,6 +68,8 @@ static struct fsw_volume *create_dummy_volume(EFI_DISK_IO *diskio, UINT32 mediai
     /* fstype_table->volume_free for fsw_unmount */
     vol->fstype_table = &dummy_fstype;
     /* host_data needded to fsw_block_get()/fsw_efi_read_block() */
+    /* the handle identifies the device for the shared cache */
+    Volume->Handle = handle;
     Volume->DiskIo = diskio;
     Volume->MediaId = mediaid;
 
@@ -79,13 +81,16 @@ static struct fsw_volume *create_dummy_volume(EFI_DISK_IO *diskio, UINT32 mediai
 static struct fsw_volume *clone_dummy_volume(struct fsw_volume *vol)
 {
     FSW_VOLUME_DATA *Volume = (FSW_VOLUME_DATA *)vol->host_data;
-    return create_dummy_volume(Volume->DiskIo, Volume->MediaId);
+    return create_dummy_volume(Volume->Handle, Volume->DiskIo, Volume->MediaId);
 }
 
 static void free_dummy_volume(struct fsw_volume *vol)
 {
-    fsw_free(vol->host_data);
+    FSW_VOLUME_DATA *Volume = (FSW_VOLUME_DATA *)vol->host_data;
+
     fsw_unmount(vol);
+    fsw_efi_clear_cache(Volume, TRUE);
+    fsw_free(Volume);
 }
 
 static int scan_disks(int (*hook)(struct fsw_volume *, struct fsw_volume *), struct fsw_volume *master)
@@ -114,8 +119,10 @@ static int scan_disks(int (*hook)(struct fsw_volume *, struct fsw_volume *), str
         Status = refit_call3_wrapper(BS->HandleProtocol, Handles[i], &gMyEfiBlockIoProtocolGuid, (VOID **) &blockio);
         if (Status != 0)
             continue;
-        struct fsw_volume *vol = create_dummy_volume(diskio, blockio->Media->MediaId);
+        struct fsw_volume *vol = create_dummy_volume(Handles[i], diskio, blockio->Media->MediaId);
         if(vol) {
+            /* only the superblock is read; keep it for the next scan */
+            vol->mounting = 1;
             DPRINT(L"Checking disk %d\n", i);
             if(hook(master, vol) == FSW_SUCCESS)
                 scanned++;
@@ -0,0 +1,125 @@
+/**
+ * \file bcache_bench.c
+ * Microbenchmark for the core block cache (fsw_block_get / fsw_block_release).
+ */
+
+/*
+ * This program is licensed under the terms of the GNU GPL, version 3,
+ * or (at your option) any later version.
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "fsw_core.h"
+
+#include <time.h>
+
+
+#define BENCH_LOOKUPS   (4*1024*1024)
+
+static unsigned long    device_reads;
+
+/**
+ * Fake device: fill the buffer with the block number instead of reading anything.
+ */
+
+static fsw_status_t bench_read_block(struct fsw_volume *vol, fsw_u64 phys_bno, void *buffer)
+{
+    device_reads++;
+    *(fsw_u64 *)buffer = phys_bno;
+    return FSW_SUCCESS;
+}
+
+static void bench_change_blocksize(struct fsw_volume *vol,
+                                   fsw_u32 old_phys_blocksize, fsw_u32 old_log_blocksize,
+                                   fsw_u32 new_phys_blocksize, fsw_u32 new_log_blocksize)
+{
+}
+
+static struct fsw_host_table bench_host_table = {
+    FSW_STRING_TYPE_ISO88591,
+
+    bench_change_blocksize,
+    bench_read_block
+};
+
+static double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+ * Populate the cache with nblocks blocks, then time random cache hits on them.
+ */
+
+static int bench_one(fsw_u32 nblocks)
+{
+    struct fsw_volume   *vol;
+    void                **buffers;
+    void                *buffer;
+    fsw_u32             i, seed;
+    fsw_u64             bno;
+    double              start, elapsed;
+
+    if (fsw_alloc_zero(sizeof(struct fsw_volume), (void **)&vol))
+        return 1;
+    if (fsw_alloc_zero(sizeof(void *) * nblocks, (void **)&buffers))
+        return 1;
+    vol->phys_blocksize = 512;
+    vol->log_blocksize = 512;
+    vol->host_table = &bench_host_table;
+    fsw_set_cache_budget(vol, 0xFFFFFFFF, 0);
+
+    // keep all blocks referenced while loading, so the cache has to grow to hold them
+    device_reads = 0;
+    for (i = 0; i < nblocks; i++) {
+        if (fsw_block_get(vol, (fsw_u64)i * 7, 2, &buffers[i]))
+            return 1;
+    }
+    for (i = 0; i < nblocks; i++)
+        fsw_block_release(vol, (fsw_u64)i * 7, buffers[i]);
+
+    seed = 12345;
+    start = now_ns();
+    for (i = 0; i < BENCH_LOOKUPS; i++) {
+        seed = seed * 1103515245 + 12345;
+        bno = (fsw_u64)((seed >> 8) % nblocks) * 7;
+        if (fsw_block_get(vol, bno, 2, &buffer))
+            return 1;
+        if (*(fsw_u64 *)buffer != bno) {
+            fprintf(stderr, "bcache_bench: wrong data for block %llu\n", (unsigned long long)bno);
+            return 1;
+        }
+        fsw_block_release(vol, bno, buffer);
+    }
+    elapsed = now_ns() - start;
+
+    printf("%8u blocks  %8u entries  %7.1f ns/lookup  %lu device reads\n",
+           nblocks, vol->bcache_size, elapsed / BENCH_LOOKUPS, device_reads);
+
+    // changing the block size drops the block cache
+    fsw_set_blocksize(vol, 512, 512);
+    fsw_free(buffers);
+    fsw_free(vol);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    fsw_u32 nblocks;
+
+    // measure the lookup structure, not the budget
+    fsw_set_global_cache_budget(0xFFFFFFFF);
+    for (nblocks = 16; nblocks <= 65536; nblocks <<= 2) {
+        if (bench_one(nblocks)) {
+            fprintf(stderr, "bcache_bench: failed with %u blocks\n", nblocks);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// EOF
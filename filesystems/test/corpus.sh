@@ -0,0 +1,333 @@
+#!/bin/sh
+#
+# corpus.sh - build small file system images from a known tree and check the
+# drivers against them with fswbench.
+#
+# Usage: corpus.sh [check|baseline]
+#
+# For every file system whose tools are installed, an image is built from the
+# same generated tree. fswbench must list the files, directories and sizes and
+# return the contents (by SHA-256) recorded in the baseline. Then
+# "fswbench -d <device> all" is run on the image. Its second, hot lookup pass
+# must not read from the device. The simulated device times don't depend on the
+# machine, so "baseline" records them and "check" fails if one got more than
+# TOLERANCE percent slower since.
+#
+# The baseline lives in corpus.baseline/ next to this script and is kept under
+# version control: tree.ls and tree.sha256 describe the generated tree,
+# <fs>-<device>.sim the device times. "check" fails if it is missing. Images and
+# current results go to the work directory, which is scratch space.
+#
+# Images that can only be filled through a mount (NTFS, HFS+) are built only
+# when running as root. btrfs isn't covered because its driver doesn't build
+# for the POSIX host.
+#
+# Environment: CORPUS_DIR (work directory, default ./corpus.out),
+# CORPUS_BASELINE (baseline directory, default ./corpus.baseline),
+# CORPUS_DEVICE (fswbench -d model, default vbox), CORPUS_TOLERANCE (percent,
+# default 10).
+#
+# This program is licensed under the terms of the GNU GPL, version 3,
+# or (at your option) any later version.
+#
+
+set -u
+
+HERE=$(cd "$(dirname "$0")" && pwd)
+BENCH=$HERE/fswbench
+WORK=${CORPUS_DIR:-$HERE/corpus.out}
+DEVICE=${CORPUS_DEVICE:-vbox}
+TOLERANCE=${CORPUS_TOLERANCE:-10}
+MODE=${1:-check}
+
+TREE=$WORK/tree
+IMAGES=$WORK/images
+RESULTS=$WORK/results
+BASELINE=${CORPUS_BASELINE:-$HERE/corpus.baseline}
+
+# reproducible images where the tools support it
+export SOURCE_DATE_EPOCH=1600000000
+export E2FSPROGS_FAKE_TIME=1600000000
+UUID=4c2d6f1e-8a3b-4e55-9d1c-0f6e2b7a9c31
+
+# names in EFI/refind/hash: the "same hash" ones have the same half_md4 hash
+# with $UUID as the seed, the "near" ones hash just above and below them
+HASH_PAIR="22107 35931"
+HASH_ABOVE="00649 01341 01707 02276 03173 04003 05096 05674 05845 05855 07610
+            08449 08750 08809 09994 10238 10442 11156 11560 12922 12928"
+HASH_BELOW="00052 00457 00511 01366 03008 03321 03324 05625 05802 06318 06327
+            06640 06988 07094 08470 08573 09089 09137 09875 11559 11947"
+
+FAILED=0
+
+case "$MODE" in
+    check|baseline) ;;
+    *) echo "Usage: $0 [check|baseline]" >&2; exit 2 ;;
+esac
+if [ ! -x "$BENCH" ]; then
+    echo "corpus: $BENCH not found, run make first" >&2
+    exit 2
+fi
+
+have() {
+    command -v "$1" >/dev/null 2>&1
+}
+
+# gen_file path size seed: deterministic contents
+gen_file() {
+    seq "$3" 100000000 | head -c "$2" > "$1"
+}
+
+make_tree() {
+    rm -rf "$TREE"
+    mkdir -p "$TREE/EFI/BOOT" "$TREE/EFI/refind/icons" "$TREE/boot/grub" \
+             "$TREE/deep/a/b/c/d/e/f/g/h/i/j" "$TREE/empty dir"
+
+    gen_file "$TREE/EFI/BOOT/BOOTX64.EFI" 262144 1
+    gen_file "$TREE/EFI/refind/refind.conf" 9000 2
+    i=0
+    while [ $i -lt 300 ]; do
+        gen_file "$TREE/EFI/refind/icons/os_icon$i.png" $((300 + i * 37)) $((i + 10))
+        i=$((i + 1))
+    done
+
+    gen_file "$TREE/boot/vmlinuz-6.1.0" 9000000 3
+    gen_file "$TREE/boot/initrd.img-6.1.0" 3000000 4
+    gen_file "$TREE/boot/grub/grub.cfg" 4000 5
+    gen_file "$TREE/boot/config-6.1.0" 250000 6
+    : > "$TREE/boot/empty"
+    truncate -s 5000000 "$TREE/boot/sparse"
+    printf 'end\n' >> "$TREE/boot/sparse"
+    gen_file "$TREE/boot/fragmented" 4000000 9
+    gen_file "$TREE/boot/preallocated" 20000 10
+    truncate -s 1048576 "$TREE/boot/preallocated"
+    seq 11 100000000 | head -c 20000 >> "$TREE/boot/preallocated"
+    ln -s vmlinuz-6.1.0 "$TREE/boot/vmlinuz"
+
+    # enough entries for a two-level hash tree index with 1 KiB blocks (ext4-1k)
+    mkdir "$TREE/EFI/refind/many"
+    i=0
+    while [ $i -lt 4000 ]; do
+        : > "$TREE/EFI/refind/many/entry with a rather long name number $i.conf"
+        i=$((i + 1))
+    done
+
+    mkdir "$TREE/EFI/refind/hash"
+    i=0
+    while [ $i -lt 150 ]; do
+        : > "$TREE/EFI/refind/hash/f$i"
+        i=$((i + 1))
+    done
+    for n in $HASH_PAIR; do
+        : > "$TREE/EFI/refind/hash/same hash $n"
+    done
+    for n in $HASH_ABOVE $HASH_BELOW; do
+        : > "$TREE/EFI/refind/hash/near $n"
+    done
+
+    gen_file "$TREE/deep/a/b/c/d/e/f/g/h/i/j/leaf.txt" 100 7
+    gen_file "$TREE/a file with a rather long name that goes on for quite a while.txt" 1000 8
+}
+
+# "type size path" list of the tree
+tree_list() {
+    (cd "$TREE" && find . -mindepth 1 \( -type f -printf 'f %s /%P\n' \) -o \
+                                      \( -type d -printf 'd 0 /%P\n' \) -o \
+                                      \( -type l -printf 'l 0 /%P\n' \)) | sort
+}
+
+# "sha256 path" list of the files in the tree; the empty files in many/ and
+# hash/ are only listed, the lookup benchmark finds each of them
+tree_sums() {
+    (cd "$TREE" && find . \( -path ./EFI/refind/many -o -path ./EFI/refind/hash \) -prune -o \
+                          -type f -printf '/%P\n') | sort | while IFS= read -r path; do
+        echo "$(sha256sum < "$TREE$path" | cut -d' ' -f1) $path"
+    done
+}
+
+build_ext() {
+    # build_ext name type blocksize
+    mke2fs -q -F -t "$2" -b "$3" -U "$UUID" -E hash_seed="$UUID" -d "$TREE" \
+        "$IMAGES/$1.img" 48M >/dev/null 2>&1 || return 1
+    # mke2fs -d writes linear directories; index them like a kernel would
+    # have. e2fsck exits with 1 when it changed the file system.
+    e2fsck -fyD "$IMAGES/$1.img" >/dev/null 2>&1
+    [ $? -le 1 ]
+}
+
+# split_collision name: insert the names of EFI/refind/hash again through
+# libext2fs, which splits a full leaf the way the kernel does. In this order
+# the split falls between the two "same hash" names, so a lookup of the second
+# one has to go on to the next leaf. e2fsck -D never splits equal hashes.
+split_collision() {
+    img=$IMAGES/$1.img
+    dir=/EFI/refind/hash
+    {
+        for n in $HASH_PAIR; do echo "rm \"$dir/same hash $n\""; done
+        for n in $HASH_ABOVE $HASH_BELOW; do echo "rm \"$dir/near $n\""; done
+    } > "$WORK/debugfs.cmds"
+    debugfs -w -f "$WORK/debugfs.cmds" "$img" >/dev/null 2>&1 || return 1
+    e2fsck -fyD "$img" >/dev/null 2>&1
+    [ $? -le 1 ] || return 1
+    {
+        echo "cd $dir"
+        for n in $HASH_PAIR; do echo "write /dev/null \"same hash $n\""; done
+        for n in $HASH_ABOVE $HASH_BELOW; do echo "write /dev/null \"near $n\""; done
+    } > "$WORK/debugfs.cmds"
+    debugfs -w -f "$WORK/debugfs.cmds" "$img" >/dev/null 2>&1 || return 1
+    # an index entry continuing a hash from the leaf before has the low bit set
+    if ! debugfs -R "htree $dir" "$img" 2>/dev/null | grep -q '^Entry #.*Hash 0x[0-9a-f]*[13579bdf][ ,]'; then
+        echo "corpus: warning: $1 has no hash collision across leaves" >&2
+    fi
+}
+
+# fragment name: write boot/fragmented again into one-block holes punched into a
+# filler file, which gives it an extent tree of several leaves, and preallocate
+# the hole in boot/preallocated. Its unwritten extents get blocks the filler
+# left data in, which must read back as zeros.
+fragment() {
+    img=$IMAGES/$1.img
+    {
+        echo "rm /boot/fragmented"
+        echo "rm /boot/preallocated"
+        echo "write $TREE/boot/vmlinuz-6.1.0 /filler"
+        i=0
+        while [ $i -lt 2000 ]; do
+            echo "punch /filler $i $i"
+            i=$((i + 2))
+        done
+        echo "write $TREE/boot/fragmented /boot/fragmented"
+        echo "rm /filler"
+        echo "write $TREE/boot/preallocated /boot/preallocated"
+        echo "fallocate /boot/preallocated 5 255"
+    } > "$WORK/debugfs.cmds"
+    debugfs -w -f "$WORK/debugfs.cmds" "$img" >/dev/null 2>&1
+}
+
+build_iso9660() {
+    if have xorriso; then
+        xorriso -as mkisofs -quiet -R -J -o "$IMAGES/iso9660.img" "$TREE" >/dev/null 2>&1
+    elif have genisoimage; then
+        genisoimage -quiet -R -J -o "$IMAGES/iso9660.img" "$TREE" >/dev/null 2>&1
+    else
+        return 1
+    fi
+}
+
+# build_mounted name fstype mkfs-command...: format, then fill through a loop mount
+build_mounted() {
+    name=$1 fstype=$2
+    shift 2
+    [ "$(id -u)" = 0 ] || return 1
+    truncate -s 48M "$IMAGES/$name.img"
+    "$@" "$IMAGES/$name.img" >/dev/null 2>&1 || return 1
+    mnt=$WORK/mnt
+    mkdir -p "$mnt"
+    mount -t "$fstype" -o loop "$IMAGES/$name.img" "$mnt" 2>/dev/null || return 1
+    cp -a "$TREE/." "$mnt/"
+    umount "$mnt"
+}
+
+build_image() {
+    case "$1" in
+        ext2)       have mke2fs && build_ext ext2 ext2 1024 ;;
+        ext3)       have mke2fs && build_ext ext3 ext3 1024 ;;
+        ext4)       have mke2fs && build_ext ext4 ext4 4096 && fragment ext4 ;;
+        ext4-1k)    have mke2fs && build_ext ext4-1k ext4 1024 && split_collision ext4-1k ;;
+        iso9660)    build_iso9660 ;;
+        ntfs)       have mkntfs && build_mounted ntfs ntfs-3g mkntfs -q -F -f ;;
+        hfs)        have mkfs.hfsplus && build_mounted hfs hfsplus mkfs.hfsplus ;;
+        *)          return 1 ;;
+    esac
+}
+
+fail() {
+    echo "FAIL $1: $2"
+    FAILED=1
+}
+
+check_image() {
+    name=$1
+    img=$IMAGES/$name.img
+
+    # the tree must come out as recorded; ext keeps lost+found, iso9660 may add a boot catalog
+    "$BENCH" "$img" ls 2>/dev/null | grep -v -e '^d 0 /lost+found$' -e ' /boot\.cat$' | sort > "$RESULTS/$name.ls"
+    if ! cmp -s "$BASELINE/tree.ls" "$RESULTS/$name.ls"; then
+        fail "$name" "listing differs"
+        diff "$BASELINE/tree.ls" "$RESULTS/$name.ls" | head -10
+        return
+    fi
+
+    # contents, including through the symlink
+    while read -r want path; do
+        got=$("$BENCH" "$img" cat "$path" 2>/dev/null | sha256sum | cut -d' ' -f1)
+        [ "$want" = "$got" ] || echo "$path"
+    done < "$BASELINE/tree.sha256" > "$RESULTS/$name.bad"
+    want=$(grep ' /boot/vmlinuz-6\.1\.0$' "$BASELINE/tree.sha256" | cut -d' ' -f1)
+    got=$("$BENCH" "$img" cat /boot/vmlinuz 2>/dev/null | sha256sum | cut -d' ' -f1)
+    [ "$want" = "$got" ] || echo "/boot/vmlinuz (symlink)" >> "$RESULTS/$name.bad"
+    if [ -s "$RESULTS/$name.bad" ]; then
+        fail "$name" "contents differ: $(head -3 "$RESULTS/$name.bad" | tr '\n' ' ')"
+        return
+    fi
+
+    # simulated device time per benchmark, "name ms"
+    if ! "$BENCH" -d "$DEVICE" "$img" all > "$RESULTS/$name.bench" 2>/dev/null; then
+        fail "$name" "fswbench all failed"
+        return
+    fi
+    awk '{ for (i = 1; i < NF; i++) if ($i == "sim") print $1, $(i + 1) }' "$RESULTS/$name.bench" > "$RESULTS/$name.sim"
+
+    # everything looked up once must stay in the caches
+    hot=$(awk '$1 == "lookup-hot" { for (i = 1; i < NF; i++) if ($i == "device") print $(i + 1) }' "$RESULTS/$name.bench")
+    if [ "$hot" != 0 ]; then
+        fail "$name" "hot lookups read from the device ($hot reads)"
+        return
+    fi
+
+    sim=$BASELINE/$name-$DEVICE.sim
+    if [ "$MODE" = baseline ]; then
+        cp "$RESULTS/$name.sim" "$sim"
+        echo "ok   $name (baseline recorded)"
+        return
+    fi
+    if [ ! -f "$sim" ]; then
+        fail "$name" "no baseline for device $DEVICE, run \"$0 baseline\""
+        return
+    fi
+    slower=$(awk -v tol="$TOLERANCE" '
+        NR == FNR { base[$1] = $2; next }
+        ($1 in base) && $2 > base[$1] * (1 + tol / 100) {
+            printf "%s %.1f -> %.1f ms; ", $1, base[$1], $2
+        }' "$sim" "$RESULTS/$name.sim")
+    if [ -n "$slower" ]; then
+        fail "$name" "slower than baseline: $slower"
+        return
+    fi
+    echo "ok   $name"
+}
+
+mkdir -p "$IMAGES" "$RESULTS"
+make_tree
+if [ "$MODE" = baseline ]; then
+    mkdir -p "$BASELINE"
+    tree_list > "$BASELINE/tree.ls"
+    tree_sums > "$BASELINE/tree.sha256"
+elif [ ! -f "$BASELINE/tree.ls" ] || [ ! -f "$BASELINE/tree.sha256" ]; then
+    echo "corpus: no baseline in $BASELINE, run \"$0 baseline\"" >&2
+    exit 2
+elif ! tree_list | cmp -s - "$BASELINE/tree.ls" || ! tree_sums | cmp -s - "$BASELINE/tree.sha256"; then
+    # the drivers are checked against the baseline, not against what was generated here
+    echo "corpus: warning: the generated tree differs from $BASELINE" >&2
+fi
+for fs in ext2 ext3 ext4 ext4-1k iso9660 ntfs hfs; do
+    rm -f "$IMAGES/$fs.img"
+    if ! build_image "$fs" || [ ! -f "$IMAGES/$fs.img" ]; then
+        echo "skip $fs (tools missing or not root)"
+        continue
+    fi
+    check_image "$fs"
+done
+echo "skip btrfs (driver needs EFI)"
+
+exit $FAILED
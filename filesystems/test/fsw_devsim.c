@@ -0,0 +1,198 @@
+/**
+ * \file fsw_devsim.c
+ * Simulated block device timing for the POSIX user space environment.
+ */
+
+/*
+ * This program is licensed under the terms of the GNU GPL, version 3,
+ * or (at your option) any later version.
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "fsw_devsim.h"
+
+
+/**
+ * Named device models, usable as the start of a device specification.
+ */
+
+static const struct {
+    const char  *name;
+    struct fsw_devsim_config config;
+} fsw_devsim_presets[] = {
+    //            latency    seek       bandwidth            max transfer
+    { "ssd",    { 50000,     0,         500ULL*1024*1024,    1024*1024 } },
+    { "hdd",    { 100000,    8000000,   120ULL*1024*1024,    1024*1024 } },
+    { "usb2",   { 1000000,   0,         30ULL*1024*1024,     64*1024 } },
+    { "vbox",   { 2000000,   0,         20ULL*1024*1024,     64*1024 } },   // emulated disk behind slow firmware
+    { NULL,     { 0, 0, 0, 0 } }
+};
+
+/**
+ * Parse a number with an optional unit suffix. Times are returned in nanoseconds
+ * (ns, us, ms, s; default us), sizes in bytes (k, m, g; binary). Returns 0 if the
+ * value can't be parsed.
+ */
+
+static int fsw_devsim_parse_value(const char *s, size_t len, int is_time, fsw_u64 *value_out)
+{
+    char        buf[32], *end;
+    fsw_u64     value, mult;
+
+    if (len == 0 || len >= sizeof(buf))
+        return 0;
+    memcpy(buf, s, len);
+    buf[len] = 0;
+    value = strtoull(buf, &end, 10);
+    if (end == buf)
+        return 0;
+
+    if (is_time) {
+        if (*end == 0 || strcmp(end, "us") == 0)
+            mult = 1000;
+        else if (strcmp(end, "ns") == 0)
+            mult = 1;
+        else if (strcmp(end, "ms") == 0)
+            mult = 1000000;
+        else if (strcmp(end, "s") == 0)
+            mult = 1000000000;
+        else
+            return 0;
+    } else {
+        if (*end == 0)
+            mult = 1;
+        else if ((end[0] == 'k' || end[0] == 'K') && end[1] == 0)
+            mult = 1024;
+        else if ((end[0] == 'm' || end[0] == 'M') && end[1] == 0)
+            mult = 1024 * 1024;
+        else if ((end[0] == 'g' || end[0] == 'G') && end[1] == 0)
+            mult = 1024 * 1024 * 1024;
+        else
+            return 0;
+    }
+    *value_out = value * mult;
+    return 1;
+}
+
+/**
+ * Parse a device specification: an optional preset name followed by comma-separated
+ * settings, e.g. "hdd", "latency=200us,bw=40m" or "usb2,max=32k". The settings are
+ * latency, seek (times) and bw, max (sizes; bw per second). Returns 0 if the
+ * specification is invalid.
+ */
+
+int fsw_devsim_parse(struct fsw_devsim_config *config, const char *spec)
+{
+    const char  *item, *next, *eq;
+    size_t      len;
+    fsw_u64     value;
+    int         i;
+
+    fsw_memzero(config, sizeof(struct fsw_devsim_config));
+    for (item = spec; *item; item = next) {
+        next = strchr(item, ',');
+        len = next ? (size_t)(next - item) : strlen(item);
+        next = next ? next + 1 : item + len;
+
+        eq = memchr(item, '=', len);
+        if (eq == NULL) {
+            for (i = 0; fsw_devsim_presets[i].name; i++) {
+                if (strlen(fsw_devsim_presets[i].name) == len &&
+                    memcmp(fsw_devsim_presets[i].name, item, len) == 0)
+                    break;
+            }
+            if (fsw_devsim_presets[i].name == NULL)
+                return 0;
+            *config = fsw_devsim_presets[i].config;
+            continue;
+        }
+
+#define DEVSIM_KEY(k) ((size_t)(eq - item) == strlen(k) && memcmp(item, k, eq - item) == 0)
+        if (DEVSIM_KEY("latency") || DEVSIM_KEY("seek")) {
+            if (!fsw_devsim_parse_value(eq + 1, len - (eq + 1 - item), 1, &value))
+                return 0;
+            if (DEVSIM_KEY("latency"))
+                config->latency_ns = value;
+            else
+                config->seek_ns = value;
+        } else if (DEVSIM_KEY("bw") || DEVSIM_KEY("max")) {
+            if (!fsw_devsim_parse_value(eq + 1, len - (eq + 1 - item), 0, &value))
+                return 0;
+            if (DEVSIM_KEY("bw"))
+                config->bandwidth = value;
+            else
+                config->max_transfer = (fsw_u32)value;
+        } else {
+            return 0;
+        }
+#undef DEVSIM_KEY
+    }
+    return 1;
+}
+
+/**
+ * Set up a simulated device.
+ */
+
+void fsw_devsim_init(struct fsw_devsim *sim, const struct fsw_devsim_config *config, FILE *trace)
+{
+    fsw_memzero(sim, sizeof(struct fsw_devsim));
+    sim->config = *config;
+    sim->trace = trace;
+    sim->next_offset = ~(fsw_u64)0;     // the first request always seeks
+}
+
+/**
+ * Reset the counters and the simulated time, e.g. between benchmark phases. The head
+ * position is kept.
+ */
+
+void fsw_devsim_reset(struct fsw_devsim *sim)
+{
+    sim->time_ns = 0;
+    sim->requests = 0;
+    sim->seeks = 0;
+    sim->bytes = 0;
+}
+
+/**
+ * Account for a read of size bytes at offset, split into device requests of at most
+ * max_transfer bytes. Returns the simulated time the read takes. The trace gets one
+ * line per device request: start time, offset, size and cost, with times in ns.
+ */
+
+fsw_u64 fsw_devsim_request(struct fsw_devsim *sim, fsw_u64 offset, fsw_u64 size)
+{
+    fsw_u64     chunk, cost, total = 0;
+
+    do {
+        chunk = size;
+        if (sim->config.max_transfer && chunk > sim->config.max_transfer)
+            chunk = sim->config.max_transfer;
+
+        cost = sim->config.latency_ns;
+        if (offset != sim->next_offset) {
+            cost += sim->config.seek_ns;
+            sim->seeks++;
+        }
+        if (sim->config.bandwidth)
+            cost += chunk * 1000000000ULL / sim->config.bandwidth;
+
+        if (sim->trace != NULL)
+            fprintf(sim->trace, "%llu %llu %llu %llu\n", (unsigned long long)sim->time_ns,
+                    (unsigned long long)offset, (unsigned long long)chunk, (unsigned long long)cost);
+
+        sim->time_ns += cost;
+        sim->requests++;
+        sim->bytes += chunk;
+        sim->next_offset = offset + chunk;
+        total += cost;
+        offset += chunk;
+        size -= chunk;
+    } while (size > 0);
+
+    return total;
+}
+
+// EOF
@@ -0,0 +1,59 @@
+/**
+ * \file fsw_devsim.h
+ * Simulated block device timing for the POSIX user space environment.
+ */
+
+/*
+ * This program is licensed under the terms of the GNU GPL, version 3,
+ * or (at your option) any later version.
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _FSW_DEVSIM_H_
+#define _FSW_DEVSIM_H_
+
+#include "fsw_core.h"
+
+
+/**
+ * Device model. Every request costs the fixed latency, plus the seek penalty if it
+ * doesn't start where the previous one ended, plus its size divided by the bandwidth.
+ * Requests larger than max_transfer are split. The device handles one request at a
+ * time, like the disk drivers of most firmware.
+ */
+
+struct fsw_devsim_config {
+    fsw_u64     latency_ns;         //!< Fixed cost of every request
+    fsw_u64     seek_ns;            //!< Extra cost of a request that isn't sequential
+    fsw_u64     bandwidth;          //!< Transfer rate in bytes per second, 0 for unlimited
+    fsw_u32     max_transfer;       //!< Largest request in bytes, 0 for unlimited
+};
+
+/**
+ * State of a simulated device. Time is simulated, not spent, so results don't depend
+ * on the machine or the OS cache.
+ */
+
+struct fsw_devsim {
+    struct fsw_devsim_config config;
+
+    fsw_u64     next_offset;        //!< End of the previous request
+    fsw_u64     time_ns;            //!< Simulated time spent by the device
+    fsw_u64     requests;           //!< Device requests, after splitting
+    fsw_u64     seeks;              //!< Requests that paid the seek penalty
+    fsw_u64     bytes;              //!< Bytes transferred
+
+    FILE        *trace;             //!< If not NULL, one line per device request is written here
+};
+
+
+/* functions */
+
+int     fsw_devsim_parse(struct fsw_devsim_config *config, const char *spec);
+void    fsw_devsim_init(struct fsw_devsim *sim, const struct fsw_devsim_config *config, FILE *trace);
+void    fsw_devsim_reset(struct fsw_devsim *sim);
+fsw_u64 fsw_devsim_request(struct fsw_devsim *sim, fsw_u64 offset, fsw_u64 size);
+
+
+#endif
@@ -37,11 +37,8 @@
 
 #include "fsw_posix.h"
 
-
-#ifndef FSTYPE
-/** The file system type name to use. */
-#define FSTYPE ext2
-#endif
+#include <aio.h>
+#include <sys/stat.h>
 
 
 // function prototypes
@@ -52,7 +49,12 @@ fsw_status_t fsw_posix_open_dno(struct fsw_posix_volume *pvol, const char *path,
 void fsw_posix_change_blocksize(struct fsw_volume *vol,
                               fsw_u32 old_phys_blocksize, fsw_u32 old_log_blocksize,
                               fsw_u32 new_phys_blocksize, fsw_u32 new_log_blocksize);
-fsw_status_t fsw_posix_read_block(struct fsw_volume *vol, fsw_u32 phys_bno, void *buffer);
+fsw_status_t fsw_posix_read_block(struct fsw_volume *vol, fsw_u64 phys_bno, void *buffer);
+fsw_status_t fsw_posix_read_blocks(struct fsw_volume *vol, fsw_u64 phys_bno, fsw_u32 count, void *buffer);
+fsw_status_t fsw_posix_read_blocks_submit(struct fsw_volume *vol, fsw_u64 phys_bno, fsw_u32 count,
+                                          void *buffer, void **request_out);
+fsw_status_t fsw_posix_read_blocks_complete(struct fsw_volume *vol, void *request, int wait);
+fsw_u32 fsw_posix_device_key(struct fsw_volume *vol, void *buffer, fsw_u32 buffer_size);
 
 /**
  * Dispatch table for our FSW host driver.
@@ -62,20 +64,132 @@ struct fsw_host_table   fsw_posix_host_table = {
     FSW_STRING_TYPE_ISO88591,
 
     fsw_posix_change_blocksize,
-    fsw_posix_read_block
+    fsw_posix_read_block,
+    fsw_posix_read_blocks,
+    fsw_posix_read_blocks_submit,
+    fsw_posix_read_blocks_complete,
+    fsw_posix_device_key
+};
+
+extern struct fsw_fstype_table   FSW_FSTYPE_TABLE_NAME(ext2);
+extern struct fsw_fstype_table   FSW_FSTYPE_TABLE_NAME(ext4);
+extern struct fsw_fstype_table   FSW_FSTYPE_TABLE_NAME(reiserfs);
+extern struct fsw_fstype_table   FSW_FSTYPE_TABLE_NAME(hfs);
+extern struct fsw_fstype_table   FSW_FSTYPE_TABLE_NAME(iso9660);
+extern struct fsw_fstype_table   FSW_FSTYPE_TABLE_NAME(ntfs);
+
+/**
+ * File system drivers linked into the POSIX host, in the order they are probed.
+ * ext2 comes before ext4 because it refuses volumes with ext4-only features.
+ * btrfs is missing because its multi-device scan needs EFI boot services.
+ */
+
+struct fsw_fstype_table *fsw_posix_fstypes[] = {
+    &FSW_FSTYPE_TABLE_NAME(ext2),
+    &FSW_FSTYPE_TABLE_NAME(ext4),
+    &FSW_FSTYPE_TABLE_NAME(reiserfs),
+    &FSW_FSTYPE_TABLE_NAME(hfs),
+    &FSW_FSTYPE_TABLE_NAME(iso9660),
+    &FSW_FSTYPE_TABLE_NAME(ntfs),
+    NULL
 };
 
-extern struct fsw_fstype_table   FSW_FSTYPE_TABLE_NAME(FSTYPE);
 
+/** Device model for volumes mounted from now on, NULL for none. */
+static const struct fsw_devsim_config *fsw_posix_devsim_config;
+/** Trace file for the simulated devices. */
+static FILE *fsw_posix_devsim_trace;
+
+/**
+ * Enable the simulated device timing (see fsw_devsim.h) for volumes mounted after
+ * this call, or disable it with a NULL config. The config must stay valid while
+ * mounts happen. All volumes share the trace file, if one is given.
+ */
+
+void fsw_posix_set_devsim(const struct fsw_devsim_config *config, FILE *trace)
+{
+    fsw_posix_devsim_config = config;
+    fsw_posix_devsim_trace = trace;
+}
+
+/** Binary I/O trace for volumes mounted from now on, NULL for none. */
+static FILE *fsw_posix_iotrace;
+/** Trace volume number of the next volume mounted. */
+static fsw_u8 fsw_posix_iotrace_volume;
+
+/**
+ * Record the read requests of volumes mounted after this call into an I/O trace in
+ * the format of fsw_trace.h, as the EFI host does when built with FSW_EFI_TRACE, or
+ * stop recording with NULL. The trace header is written right away. The POSIX host
+ * has no read cache, so all requests are recorded as uncached. Returns 0 if the
+ * header can't be written.
+ */
+
+int fsw_posix_set_iotrace(FILE *out)
+{
+    struct fsw_trace_header header;
+
+    fsw_posix_iotrace = out;
+    fsw_posix_iotrace_volume = 0;
+    if (out == NULL)
+        return 1;
+
+    fsw_memzero(&header, sizeof(header));
+    memcpy(header.magic, FSW_TRACE_MAGIC, sizeof(header.magic));
+    header.version = FSW_TRACE_VERSION;
+    header.record_size = sizeof(struct fsw_trace_record);
+    return fwrite(&header, sizeof(header), 1, out) == 1;
+}
+
+/**
+ * Add a record to the I/O trace of a volume, if it has one.
+ */
+
+static void fsw_posix_iotrace_record(struct fsw_posix_volume *pvol, fsw_u8 type,
+                                     fsw_u64 block, fsw_u32 count, fsw_u32 blocksize)
+{
+    struct fsw_trace_record record;
+
+    if (pvol->iotrace == NULL)
+        return;
+    fsw_memzero(&record, sizeof(record));
+    record.ticks = FSW_TICKS();
+    record.block = block;
+    record.count = count;
+    record.volume = pvol->trace_volume;
+    record.type = type;
+    record.outcome = FSW_TRACE_UNCACHED;
+    while (record.block_shift < 31 && ((fsw_u32)1 << record.block_shift) < blocksize)
+        record.block_shift++;
+    fwrite(&record, sizeof(record), 1, pvol->iotrace);
+}
+
+/**
+ * Look up a linked file system driver by name. Returns NULL if there is none.
+ */
+
+struct fsw_fstype_table * fsw_posix_find_fstype(const char *name)
+{
+    int i;
+
+    for (i = 0; fsw_posix_fstypes[i]; i++) {
+        if (strlen(name) == (size_t)fsw_posix_fstypes[i]->name.size &&
+            memcmp(name, fsw_posix_fstypes[i]->name.data, fsw_posix_fstypes[i]->name.size) == 0)
+            return fsw_posix_fstypes[i];
+    }
+    return NULL;
+}
 
 /**
- * Mount function.
+ * Mount function. If fstype_table is NULL, all linked drivers are tried in turn
+ * and the first one that accepts the volume is used.
  */
 
 struct fsw_posix_volume * fsw_posix_mount(const char *path, struct fsw_fstype_table *fstype_table)
 {
     fsw_status_t        status;
     struct fsw_posix_volume *pvol;
+    int                 i;
 
     // allocate volume structure
     status = fsw_alloc_zero(sizeof(struct fsw_posix_volume), (void **)&pvol);
@@ -91,12 +205,34 @@ struct fsw_posix_volume * fsw_posix_mount(const char *path, struct fsw_fstype_ta
         return NULL;
     }
 
+    // the simulated device has to be there for the reads done while mounting
+    if (fsw_posix_devsim_config != NULL) {
+        if (fsw_alloc(sizeof(struct fsw_devsim), &pvol->sim)) {
+            close(pvol->fd);
+            fsw_free(pvol);
+            return NULL;
+        }
+        fsw_devsim_init(pvol->sim, fsw_posix_devsim_config, fsw_posix_devsim_trace);
+    }
+    if (fsw_posix_iotrace != NULL) {
+        pvol->iotrace = fsw_posix_iotrace;
+        pvol->trace_volume = fsw_posix_iotrace_volume++;
+        fsw_posix_iotrace_record(pvol, FSW_TRACE_MOUNT, (fsw_u64)lseek(pvol->fd, 0, SEEK_END), 0, 1);
+    }
+
     // mount the filesystem
-    if (fstype_table == NULL)
-        fstype_table = &FSW_FSTYPE_TABLE_NAME(FSTYPE);
-    status = fsw_mount(pvol, &fsw_posix_host_table, fstype_table, &pvol->vol);
+    if (fstype_table != NULL) {
+        status = fsw_mount(pvol, &fsw_posix_host_table, fstype_table, &pvol->vol);
+    } else {
+        status = FSW_UNSUPPORTED;
+        for (i = 0; status && fsw_posix_fstypes[i]; i++)
+            status = fsw_mount(pvol, &fsw_posix_host_table, fsw_posix_fstypes[i], &pvol->vol);
+    }
     if (status) {
         fprintf(stderr, "fsw_posix_mount: fsw_mount returned %d\n", status);
+        close(pvol->fd);
+        if (pvol->sim != NULL)
+            fsw_free(pvol->sim);
         fsw_free(pvol);
         return NULL;
     }
@@ -110,12 +246,46 @@ struct fsw_posix_volume * fsw_posix_mount(const char *path, struct fsw_fstype_ta
 
 int fsw_posix_unmount(struct fsw_posix_volume *pvol)
 {
-    if (pvol->vol != NULL)
+    if (pvol->vol != NULL) {
+        FSW_MSG_DEBUG((FSW_MSGSTR("fsw_posix_unmount: block cache high-water mark %u bytes (all volumes %u bytes)\n"),
+                       pvol->vol->bcache_bytes_hwm, fsw_get_global_cache_hwm()));
+        FSW_MSG_DEBUG((FSW_MSGSTR("fsw_posix_unmount: %u dnodes in %u chunks, %u extent maps in %u chunks\n"),
+                       pvol->vol->dnode_slab.alloc_count, pvol->vol->dnode_slab.chunk_count,
+                       pvol->vol->extent_slab.alloc_count, pvol->vol->extent_slab.chunk_count));
         fsw_unmount(pvol->vol);
+    }
+    if (pvol->fd >= 0)
+        close(pvol->fd);
+    if (pvol->sim != NULL)
+        fsw_free(pvol->sim);
     fsw_free(pvol);
     return 0;
 }
 
+/**
+ * Print the cache and I/O counters of a volume.
+ */
+
+void fsw_posix_print_stats(struct fsw_posix_volume *pvol, FILE *out)
+{
+    struct fsw_volume_stats *st = &pvol->vol->stats;
+    int i;
+
+    fprintf(out, "block cache: %llu lookups, %llu hits, %llu misses\n",
+            (unsigned long long)st->bcache_lookups, (unsigned long long)st->bcache_hits,
+            (unsigned long long)st->bcache_misses);
+    fprintf(out, "evictions by level:");
+    for (i = 0; i <= FSW_MAX_CACHE_LEVEL; i++)
+        fprintf(out, " %llu", (unsigned long long)st->bcache_evictions[i]);
+    fprintf(out, "\n");
+    fprintf(out, "shared cache: %llu hits\n", (unsigned long long)st->shared_cache_hits);
+    fprintf(out, "device: %llu calls, %llu bytes, %.3f ms\n",
+            (unsigned long long)st->device_calls, (unsigned long long)st->bytes_read,
+            st->read_ticks / 1e6);
+    fprintf(out, "driver caches: %llu hits, %llu misses\n",
+            (unsigned long long)st->drv_cache_hits, (unsigned long long)st->drv_cache_misses);
+}
+
 /**
  * Open a named regular file.
  */
@@ -267,6 +437,7 @@ struct dirent * fsw_posix_readdir(struct fsw_posix_dir *dir)
 #endif
     memcpy(dent.d_name, dno->name.data, dno->name.size);
     dent.d_name[dno->name.size] = 0;
+    fsw_dnode_release(dno);
 
     return &dent;
 }
@@ -362,7 +533,7 @@ void fsw_posix_change_blocksize(struct fsw_volume *vol,
  * to read a block of data from the device. The buffer is allocated by the core code.
  */
 
-fsw_status_t fsw_posix_read_block(struct fsw_volume *vol, fsw_u32 phys_bno, void *buffer)
+fsw_status_t fsw_posix_read_block(struct fsw_volume *vol, fsw_u64 phys_bno, void *buffer)
 {
     struct fsw_posix_volume *pvol = (struct fsw_posix_volume *)vol->host_data;
     off_t           block_offset, seek_result;
@@ -372,6 +543,9 @@ fsw_status_t fsw_posix_read_block(struct fsw_volume *vol, fsw_u32 phys_bno, void
 
     // read from disk
     block_offset = (off_t)phys_bno * vol->phys_blocksize;
+    fsw_posix_iotrace_record(pvol, FSW_TRACE_BLOCK, phys_bno, 1, vol->phys_blocksize);
+    if (pvol->sim != NULL)
+        fsw_devsim_request(pvol->sim, block_offset, vol->phys_blocksize);
     seek_result = lseek(pvol->fd, block_offset, SEEK_SET);
     if (seek_result != block_offset)
         return FSW_IO_ERROR;
@@ -382,7 +556,145 @@ fsw_status_t fsw_posix_read_block(struct fsw_volume *vol, fsw_u32 phys_bno, void
     return FSW_SUCCESS;
 }
 
+/**
+ * FSW interface function to read a run of consecutive data blocks with a single
+ * system call.
+ */
+
+fsw_status_t fsw_posix_read_blocks(struct fsw_volume *vol, fsw_u64 phys_bno, fsw_u32 count, void *buffer)
+{
+    struct fsw_posix_volume *pvol = (struct fsw_posix_volume *)vol->host_data;
+    size_t          size = (size_t)count * vol->phys_blocksize;
+    ssize_t         read_result;
+
+    FSW_MSG_DEBUGV((FSW_MSGSTR("fsw_posix_read_blocks: %d+%d  (%d)\n"), phys_bno, count, vol->phys_blocksize));
+
+    fsw_posix_iotrace_record(pvol, FSW_TRACE_BLOCKS, phys_bno, count, vol->phys_blocksize);
+    if (pvol->sim != NULL)
+        fsw_devsim_request(pvol->sim, (fsw_u64)phys_bno * vol->phys_blocksize, size);
+    read_result = pread(pvol->fd, buffer, size, (off_t)phys_bno * vol->phys_blocksize);
+    if (read_result < 0 || (size_t)read_result != size)
+        return FSW_IO_ERROR;
+
+    return FSW_SUCCESS;
+}
+
+/**
+ * FSW interface function to start an asynchronous read of consecutive data blocks.
+ * The request is a POSIX AIO control block, freed again by the complete function.
+ */
+
+fsw_status_t fsw_posix_read_blocks_submit(struct fsw_volume *vol, fsw_u64 phys_bno, fsw_u32 count,
+                                          void *buffer, void **request_out)
+{
+    struct fsw_posix_volume *pvol = (struct fsw_posix_volume *)vol->host_data;
+    struct aiocb    *cb;
+
+    FSW_MSG_DEBUGV((FSW_MSGSTR("fsw_posix_read_blocks_submit: %d+%d  (%d)\n"), phys_bno, count, vol->phys_blocksize));
+
+    if (fsw_alloc_zero(sizeof(struct aiocb), (void **)&cb))
+        return FSW_OUT_OF_MEMORY;
+    fsw_posix_iotrace_record(pvol, FSW_TRACE_ASYNC, phys_bno, count, vol->phys_blocksize);
+    // the simulated device serves requests one at a time in the order submitted
+    if (pvol->sim != NULL)
+        fsw_devsim_request(pvol->sim, (fsw_u64)phys_bno * vol->phys_blocksize, (fsw_u64)count * vol->phys_blocksize);
+    cb->aio_fildes = pvol->fd;
+    cb->aio_offset = (off_t)phys_bno * vol->phys_blocksize;
+    cb->aio_buf = buffer;
+    cb->aio_nbytes = (size_t)count * vol->phys_blocksize;
+    if (aio_read(cb) != 0) {
+        fsw_free(cb);
+        return FSW_IO_ERROR;
+    }
+
+    *request_out = cb;
+    return FSW_SUCCESS;
+}
+
+/**
+ * FSW interface function to finish an asynchronous read.
+ */
+
+fsw_status_t fsw_posix_read_blocks_complete(struct fsw_volume *vol, void *request, int wait)
+{
+    struct aiocb    *cb = (struct aiocb *)request;
+    const struct aiocb *list[1];
+    int             error;
+    ssize_t         read_result;
+    size_t          size = cb->aio_nbytes;
+
+    list[0] = cb;
+    while ((error = aio_error(cb)) == EINPROGRESS) {
+        if (!wait)
+            return FSW_NOT_READY;
+        aio_suspend(list, 1, NULL);
+    }
+
+    read_result = aio_return(cb);
+    fsw_free(cb);
+    if (error != 0 || read_result < 0 || (size_t)read_result != size)
+        return FSW_IO_ERROR;
+
+    return FSW_SUCCESS;
+}
+
+/**
+ * FSW interface function to identify the device for the shared cache, by the device
+ * and inode number of the image file or device node and its modification time.
+ */
+
+fsw_u32 fsw_posix_device_key(struct fsw_volume *vol, void *buffer, fsw_u32 buffer_size)
+{
+    struct fsw_posix_volume *pvol = (struct fsw_posix_volume *)vol->host_data;
+    struct stat     st;
+    fsw_u64         key[4];
+
+    if (buffer_size < sizeof(key) || fstat(pvol->fd, &st) < 0)
+        return 0;
+    key[0] = st.st_dev;
+    key[1] = st.st_ino;
+    key[2] = st.st_rdev;
+    key[3] = st.st_mtime;
+    fsw_memcpy(buffer, key, sizeof(key));
+    return sizeof(key);
+}
+
 
+/**
+ * Callbacks for the fsw_dnode_stat call. The POSIX host passes a struct stat
+ * in host_data, or NULL if it doesn't need the information.
+ */
+
+void fsw_store_time_posix(struct fsw_dnode_stat *sb, int which, fsw_u32 posix_time)
+{
+    struct stat *st = (struct stat *)sb->host_data;
+
+    if (st == NULL)
+        return;
+    if (which == FSW_DNODE_STAT_CTIME)
+        st->st_ctime = posix_time;
+    else if (which == FSW_DNODE_STAT_MTIME)
+        st->st_mtime = posix_time;
+    else if (which == FSW_DNODE_STAT_ATIME)
+        st->st_atime = posix_time;
+}
+
+void fsw_store_attr_posix(struct fsw_dnode_stat *sb, fsw_u16 posix_mode)
+{
+    struct stat *st = (struct stat *)sb->host_data;
+
+    if (st != NULL)
+        st->st_mode = posix_mode;
+}
+
+void fsw_store_attr_efi(struct fsw_dnode_stat *sb, fsw_u16 attr)
+{
+    struct stat *st = (struct stat *)sb->host_data;
+
+    // EFI_FILE_READ_ONLY
+    if (st != NULL)
+        st->st_mode = (attr & 0x01) ? 0444 : 0644;
+}
 /**
  * Time mapping callback for the fsw_dnode_stat call. This function converts
  * a Posix style timestamp into an EFI_TIME structure and writes it to the
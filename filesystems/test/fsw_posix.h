@@ -39,6 +39,8 @@
 #define _FSW_POSIX_H_
 
 #include "fsw_core.h"
+#include "fsw_devsim.h"
+#include "fsw_trace.h"
 
 #include <fcntl.h>
 #include <sys/types.h>
@@ -53,6 +55,9 @@ struct fsw_posix_volume {
     struct fsw_volume           *vol;           //!< FSW volume structure
 
     int                         fd;             //!< System file descriptor for data access
+    struct fsw_devsim           *sim;           //!< Simulated device timing, NULL if not enabled
+    FILE                        *iotrace;       //!< Binary I/O trace, NULL if not enabled
+    fsw_u8                      trace_volume;   //!< Volume number in the I/O trace
 
 };
 
@@ -81,8 +86,14 @@ struct fsw_posix_dir {
 
 /* functions */
 
+extern struct fsw_fstype_table *fsw_posix_fstypes[];
+
+struct fsw_fstype_table * fsw_posix_find_fstype(const char *name);
 struct fsw_posix_volume * fsw_posix_mount(const char *path, struct fsw_fstype_table *fstype_table);
 int fsw_posix_unmount(struct fsw_posix_volume *pvol);
+void fsw_posix_set_devsim(const struct fsw_devsim_config *config, FILE *trace);
+int fsw_posix_set_iotrace(FILE *out);
+void fsw_posix_print_stats(struct fsw_posix_volume *pvol, FILE *out);
 
 struct fsw_posix_file * fsw_posix_open(struct fsw_posix_volume *pvol, const char *path, int flags, mode_t mode);
 ssize_t fsw_posix_read(struct fsw_posix_file *file, void *buf, size_t nbytes);
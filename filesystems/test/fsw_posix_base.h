@@ -45,6 +45,7 @@
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <time.h>
 
 #define FSW_LITTLE_ENDIAN (1)
 // TODO: use info from the headers to define FSW_LITTLE_ENDIAN or FSW_BIG_ENDIAN
@@ -78,6 +79,17 @@ typedef uint64_t            fsw_u64;
 #define FSW_MSGSTR(s) s
 #define FSW_MSGFUNC(str, ...) (fprintf(stderr, str, ##__VA_ARGS__))
 
+// time stamps for I/O statistics, in nanoseconds
+
+static inline fsw_u64 fsw_posix_ticks(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (fsw_u64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+#define FSW_TICKS() fsw_posix_ticks()
+
 // 64-bit hooks
 
 #define FSW_U64_SHR(val,shiftbits) ((val) >> (shiftbits))
@@ -87,4 +99,8 @@ typedef uint64_t            fsw_u64;
 #define RShiftU64(val, shift) ((val) >> (shift))
 #define LShiftU64(val, shift) ((val) << (shift))
 
+// calling convention for host table functions, only meaningful on EFI
+
+#define EFIAPI
+
 #endif
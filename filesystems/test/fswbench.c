@@ -0,0 +1,563 @@
+/**
+ * \file fswbench.c
+ * Benchmark for the file system drivers on disk images, using the POSIX host.
+ */
+
+/*
+ * This program is licensed under the terms of the GNU GPL, version 3,
+ * or (at your option) any later version.
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "fsw_posix.h"
+
+
+#define BENCH_MAX_PATHS     (256*1024)
+#define BENCH_READ_CHUNK    (64*1024)
+#define BENCH_RANDOM_CHUNK  (4*1024)
+
+/**
+ * A file or directory found by a tree walk.
+ */
+
+struct bench_path {
+    char        *path;
+    int         type;               //!< DT_REG, DT_DIR, ...
+};
+
+static struct fsw_fstype_table *bench_fstype;   // NULL: probe
+static const char       *bench_image;
+static int              bench_repeat;           // 0: default for the command
+
+static struct bench_path *paths;
+static fsw_u32          path_count;
+
+static void usage(void);
+
+/**
+ * Ask the OS to drop its cached pages of the image, so that a mount really starts
+ * cold. This only has an effect for regular files.
+ */
+
+static void bench_drop_os_cache(void)
+{
+    int fd;
+
+    fd = open(bench_image, O_RDONLY);
+    if (fd < 0)
+        return;
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+}
+
+/**
+ * Clear the counters of a volume and its simulated device before a measurement.
+ */
+
+static void bench_reset(struct fsw_posix_volume *pvol)
+{
+    fsw_memzero(&pvol->vol->stats, sizeof(pvol->vol->stats));
+    if (pvol->sim != NULL)
+        fsw_devsim_reset(pvol->sim);
+}
+
+static struct fsw_posix_volume *bench_mount(void)
+{
+    struct fsw_posix_volume *pvol;
+
+    bench_drop_os_cache();
+    fsw_shared_cache_flush();
+    pvol = fsw_posix_mount(bench_image, bench_fstype);
+    if (pvol == NULL)
+        fprintf(stderr, "fswbench: can't mount %s\n", bench_image);
+    return pvol;
+}
+
+/**
+ * Print the result of one benchmark: the rate of operations, the data rate if the
+ * benchmark moves file data, and the volume's device and block cache counters.
+ * With a simulated device, the rates are based on the CPU time plus the simulated
+ * device time, and the device requests and seeks are shown.
+ */
+
+static void bench_report(const char *name, struct fsw_posix_volume *pvol, fsw_u64 ops, fsw_u64 bytes,
+                         fsw_u64 elapsed)
+{
+    struct fsw_volume_stats *st = &pvol->vol->stats;
+    double secs;
+
+    if (pvol->sim != NULL)
+        elapsed += pvol->sim->time_ns;
+    secs = elapsed / 1e9;
+
+    if (secs <= 0)
+        secs = 1e-9;
+    printf("%-10s %8llu ops %10.3f ms %12.1f ops/s", name, (unsigned long long)ops, elapsed / 1e6, ops / secs);
+    if (bytes > 0)
+        printf(" %9.1f MB/s", bytes / secs / (1024 * 1024));
+    printf("   device %llu reads, %llu KiB", (unsigned long long)st->device_calls,
+           (unsigned long long)(st->bytes_read / 1024));
+    if (st->bcache_lookups > 0)
+        printf(", cache %.1f%% hits", 100.0 * st->bcache_hits / st->bcache_lookups);
+    if (st->shared_cache_hits > 0)
+        printf(", %llu shared", (unsigned long long)st->shared_cache_hits);
+    if (pvol->sim != NULL)
+        printf(", sim %.3f ms in %llu requests, %llu seeks", pvol->sim->time_ns / 1e6,
+               (unsigned long long)pvol->sim->requests, (unsigned long long)pvol->sim->seeks);
+    printf("\n");
+}
+
+/**
+ * Walk a directory tree, filling every dnode. The paths found are remembered for the
+ * other benchmarks.
+ */
+
+static fsw_u64 bench_walk_dir(struct fsw_posix_volume *pvol, const char *path)
+{
+    struct fsw_posix_dir *dir;
+    struct dirent *dent;
+    char        subpath[4096];
+    fsw_u64     count = 0;
+    int         type;
+
+    dir = fsw_posix_opendir(pvol, path);
+    if (dir == NULL)
+        return 0;
+    while ((dent = fsw_posix_readdir(dir)) != NULL) {
+        count++;
+        if (strcmp(dent->d_name, ".") == 0 || strcmp(dent->d_name, "..") == 0)
+            continue;
+        snprintf(subpath, sizeof(subpath), "%s%s", path, dent->d_name);
+        type = dent->d_type;
+
+        if (path_count < BENCH_MAX_PATHS) {
+            paths[path_count].path = strdup(subpath);
+            paths[path_count].type = type;
+            path_count++;
+        }
+
+        if (type == DT_DIR) {
+            strncat(subpath, "/", sizeof(subpath) - strlen(subpath) - 1);
+            count += bench_walk_dir(pvol, subpath);
+        }
+    }
+    fsw_posix_closedir(dir);
+    return count;
+}
+
+static void bench_free_paths(void)
+{
+    fsw_u32 i;
+
+    for (i = 0; i < path_count; i++)
+        free(paths[i].path);
+    path_count = 0;
+}
+
+static int bench_walk(int report)
+{
+    struct fsw_posix_volume *pvol;
+    fsw_u64     start, count;
+
+    pvol = bench_mount();
+    if (pvol == NULL)
+        return 1;
+    bench_free_paths();
+    bench_reset(pvol);
+    start = fsw_posix_ticks();
+    count = bench_walk_dir(pvol, "/");
+    if (report)
+        bench_report("walk", pvol, count, 0, fsw_posix_ticks() - start);
+    fsw_posix_unmount(pvol);
+    return 0;
+}
+
+/**
+ * Mount and unmount the volume repeatedly, each time with a cold OS cache. Unless
+ * warm is set, the shared cache is emptied before each mount as well. With warm set,
+ * the volume is mounted once before the measurement, so that the mounts measured
+ * find the metadata in the shared cache like a rescan would.
+ */
+
+static int bench_mount_cmd(int warm)
+{
+    struct fsw_posix_volume *pvol;
+    struct fsw_volume_stats total;
+    struct fsw_devsim sim_total;
+    fsw_u64     elapsed = 0, start;
+    int         i, n = bench_repeat ? bench_repeat : 10;
+
+    fsw_memzero(&total, sizeof(total));
+    fsw_memzero(&sim_total, sizeof(sim_total));
+    if (warm) {
+        pvol = bench_mount();
+        if (pvol == NULL)
+            return 1;
+        fsw_posix_unmount(pvol);
+    }
+    for (i = 0; i < n; i++) {
+        bench_drop_os_cache();
+        if (!warm)
+            fsw_shared_cache_flush();
+        start = fsw_posix_ticks();
+        pvol = fsw_posix_mount(bench_image, bench_fstype);
+        if (pvol == NULL) {
+            fprintf(stderr, "fswbench: can't mount %s\n", bench_image);
+            return 1;
+        }
+        elapsed += fsw_posix_ticks() - start;
+        total.device_calls += pvol->vol->stats.device_calls;
+        total.bytes_read += pvol->vol->stats.bytes_read;
+        total.bcache_lookups += pvol->vol->stats.bcache_lookups;
+        total.bcache_hits += pvol->vol->stats.bcache_hits;
+        total.shared_cache_hits += pvol->vol->stats.shared_cache_hits;
+        if (pvol->sim != NULL) {
+            sim_total.time_ns += pvol->sim->time_ns;
+            sim_total.requests += pvol->sim->requests;
+            sim_total.seeks += pvol->sim->seeks;
+        }
+        if (i == n - 1) {
+            pvol->vol->stats = total;
+            if (pvol->sim != NULL) {
+                pvol->sim->time_ns = sim_total.time_ns;
+                pvol->sim->requests = sim_total.requests;
+                pvol->sim->seeks = sim_total.seeks;
+            }
+            bench_report(warm ? "remount" : "mount", pvol, n, 0, elapsed);
+        }
+        fsw_posix_unmount(pvol);
+    }
+    return 0;
+}
+
+/**
+ * Look up every path found by a walk on a freshly mounted volume, first cold and then
+ * again with everything cached.
+ */
+
+static int bench_lookup(void)
+{
+    struct fsw_posix_volume *pvol;
+    struct fsw_dnode *dno;
+    struct fsw_string lookup_path;
+    fsw_u64     start, ops;
+    fsw_u32     i;
+    int         pass, n = bench_repeat ? bench_repeat : 1;
+
+    if (path_count == 0 && bench_walk(0))
+        return 1;
+    pvol = bench_mount();
+    if (pvol == NULL)
+        return 1;
+
+    for (pass = 0; pass < 2; pass++) {
+        bench_reset(pvol);
+        ops = 0;
+        start = fsw_posix_ticks();
+        do {
+            for (i = 0; i < path_count; i++) {
+                lookup_path.type = FSW_STRING_TYPE_ISO88591;
+                lookup_path.len  = strlen(paths[i].path);
+                lookup_path.size = lookup_path.len;
+                lookup_path.data = paths[i].path;
+                if (fsw_dnode_lookup_path(pvol->vol->root, &lookup_path, '/', &dno) == FSW_SUCCESS) {
+                    fsw_dnode_fill(dno);
+                    fsw_dnode_release(dno);
+                }
+                ops++;
+            }
+        } while (pass == 1 && ops < (fsw_u64)n * path_count);
+        bench_report(pass ? "lookup-hot" : "lookup", pvol, ops, 0, fsw_posix_ticks() - start);
+    }
+
+    fsw_posix_unmount(pvol);
+    return 0;
+}
+
+/**
+ * Read whole files front to back in BENCH_READ_CHUNK pieces: the named file, or all
+ * regular files found by a walk.
+ */
+
+static int bench_seqread(const char *path)
+{
+    struct fsw_posix_volume *pvol;
+    struct fsw_posix_file *file;
+    static char buffer[BENCH_READ_CHUNK];
+    fsw_u64     start, bytes = 0, files = 0;
+    ssize_t     r;
+    fsw_u32     i;
+
+    if (path == NULL && path_count == 0 && bench_walk(0))
+        return 1;
+    pvol = bench_mount();
+    if (pvol == NULL)
+        return 1;
+
+    bench_reset(pvol);
+    start = fsw_posix_ticks();
+    for (i = 0; path != NULL ? i < 1 : i < path_count; i++) {
+        if (path == NULL && paths[i].type != DT_REG)
+            continue;
+        file = fsw_posix_open(pvol, path != NULL ? path : paths[i].path, 0, 0);
+        if (file == NULL)
+            continue;
+        while ((r = fsw_posix_read(file, buffer, sizeof(buffer))) > 0)
+            bytes += r;
+        fsw_posix_close(file);
+        files++;
+    }
+    bench_report("seqread", pvol, files, bytes, fsw_posix_ticks() - start);
+
+    fsw_posix_unmount(pvol);
+    return 0;
+}
+
+/**
+ * Read BENCH_RANDOM_CHUNK pieces at random aligned offsets of one file: the named file,
+ * or the largest regular file found by a walk.
+ */
+
+static int bench_randread(const char *path)
+{
+    struct fsw_posix_volume *pvol;
+    struct fsw_posix_file *file;
+    static char buffer[BENCH_RANDOM_CHUNK];
+    fsw_u64     start, bytes = 0, size, chunks, largest = 0;
+    fsw_u32     i, seed = 12345;
+    ssize_t     r;
+    int         n = bench_repeat ? bench_repeat : 4096;
+
+    if (path == NULL) {
+        if (path_count == 0 && bench_walk(0))
+            return 1;
+        pvol = bench_mount();
+        if (pvol == NULL)
+            return 1;
+        for (i = 0; i < path_count; i++) {
+            if (paths[i].type != DT_REG || (file = fsw_posix_open(pvol, paths[i].path, 0, 0)) == NULL)
+                continue;
+            if (file->shand.dnode->size > largest) {
+                largest = file->shand.dnode->size;
+                path = paths[i].path;
+            }
+            fsw_posix_close(file);
+        }
+        fsw_posix_unmount(pvol);
+        if (path == NULL) {
+            fprintf(stderr, "fswbench: no regular files found\n");
+            return 1;
+        }
+    }
+    pvol = bench_mount();
+    if (pvol == NULL)
+        return 1;
+    file = fsw_posix_open(pvol, path, 0, 0);
+    if (file == NULL) {
+        fsw_posix_unmount(pvol);
+        return 1;
+    }
+    size = file->shand.dnode->size;
+    chunks = (size + BENCH_RANDOM_CHUNK - 1) / BENCH_RANDOM_CHUNK;
+    if (chunks == 0)
+        chunks = 1;
+
+    bench_reset(pvol);
+    start = fsw_posix_ticks();
+    for (i = 0; i < (fsw_u32)n; i++) {
+        seed = seed * 1103515245 + 12345;
+        fsw_posix_lseek(file, (off_t)((seed >> 8) % chunks) * BENCH_RANDOM_CHUNK, SEEK_SET);
+        r = fsw_posix_read(file, buffer, sizeof(buffer));
+        if (r < 0)
+            break;
+        bytes += r;
+    }
+    bench_report("randread", pvol, i, bytes, fsw_posix_ticks() - start);
+
+    fsw_posix_close(file);
+    fsw_posix_unmount(pvol);
+    return 0;
+}
+
+/**
+ * List every file, directory and symlink found by a walk as "type size path", with
+ * type f, d or l. Sizes are given for regular files only.
+ */
+
+static int bench_ls(void)
+{
+    struct fsw_posix_volume *pvol;
+    struct fsw_posix_file *file;
+    fsw_u64     size;
+    fsw_u32     i;
+
+    if (bench_walk(0))
+        return 1;
+    pvol = bench_mount();
+    if (pvol == NULL)
+        return 1;
+    for (i = 0; i < path_count; i++) {
+        size = 0;
+        if (paths[i].type == DT_REG) {
+            file = fsw_posix_open(pvol, paths[i].path, 0, 0);
+            if (file == NULL) {
+                fsw_posix_unmount(pvol);
+                return 1;
+            }
+            size = file->shand.dnode->size;
+            fsw_posix_close(file);
+        }
+        printf("%c %llu %s\n", paths[i].type == DT_REG ? 'f' : paths[i].type == DT_DIR ? 'd' :
+               paths[i].type == DT_LNK ? 'l' : '?', (unsigned long long)size, paths[i].path);
+    }
+    fsw_posix_unmount(pvol);
+    return 0;
+}
+
+/**
+ * Copy the contents of a file to stdout.
+ */
+
+static int bench_cat(const char *path)
+{
+    struct fsw_posix_volume *pvol;
+    struct fsw_posix_file *file;
+    static char buffer[BENCH_READ_CHUNK];
+    ssize_t     r;
+
+    if (path == NULL) {
+        usage();
+        return 1;
+    }
+    pvol = bench_mount();
+    if (pvol == NULL)
+        return 1;
+    file = fsw_posix_open(pvol, path, 0, 0);
+    if (file == NULL) {
+        fsw_posix_unmount(pvol);
+        return 1;
+    }
+    while ((r = fsw_posix_read(file, buffer, sizeof(buffer))) > 0)
+        fwrite(buffer, 1, r, stdout);
+    fsw_posix_close(file);
+    fsw_posix_unmount(pvol);
+    return r < 0;
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "Usage: fswbench [-t fstype] [-n count] [-d device] [-T trace] [-R iotrace]\n"
+            "                <file/device> <command> [path]\n"
+            "Commands:\n"
+            "  mount           mount and unmount count times (default 10)\n"
+            "  remount         the same, but with the shared cache kept from an earlier mount\n"
+            "  walk            read every directory and fill every dnode\n"
+            "  lookup          look up every path found by walk, cold and then count times hot\n"
+            "  seqread [path]  read one file, or all files, in %u KiB pieces\n"
+            "  randread [path] read count (default 4096) %u KiB pieces at random offsets\n"
+            "                  of one file, default the largest one\n"
+            "  all             all of the above\n"
+            "  ls              list all paths found by walk as: type size path\n"
+            "  cat path        copy a file to stdout\n"
+            "Each benchmark starts from a fresh mount with the image dropped from the OS cache\n"
+            "and the shared cache emptied, except for remount.\n"
+            "-d simulates device timing, e.g. \"hdd\" or \"usb2,max=32k\"; presets ssd, hdd,\n"
+            "   usb2, vbox; settings latency=, seek= (us, or ns/ms/s), bw=, max= (k/m/g).\n"
+            "-T writes each simulated device request to a file: time offset size cost.\n"
+            "-R records the read requests into a binary I/O trace for fswreplay.\n",
+            BENCH_READ_CHUNK / 1024, BENCH_RANDOM_CHUNK / 1024);
+}
+
+int main(int argc, char **argv)
+{
+    const char  *cmd, *path;
+    int         opt, i, err = 0, devsim = 0;
+    struct fsw_devsim_config devsim_config;
+    FILE        *trace = NULL, *iotrace = NULL;
+
+    while ((opt = getopt(argc, argv, "t:n:d:T:R:")) != -1) {
+        if (opt == 't') {
+            bench_fstype = fsw_posix_find_fstype(optarg);
+            if (bench_fstype == NULL) {
+                fprintf(stderr, "fswbench: unknown file system type %s; known types:", optarg);
+                for (i = 0; fsw_posix_fstypes[i]; i++)
+                    fprintf(stderr, " %.*s", fsw_posix_fstypes[i]->name.size,
+                            (char *)fsw_posix_fstypes[i]->name.data);
+                fprintf(stderr, "\n");
+                return 1;
+            }
+        } else if (opt == 'n') {
+            bench_repeat = atoi(optarg);
+        } else if (opt == 'd') {
+            if (!fsw_devsim_parse(&devsim_config, optarg)) {
+                fprintf(stderr, "fswbench: invalid device specification %s\n", optarg);
+                return 1;
+            }
+            devsim = 1;
+        } else if (opt == 'T') {
+            trace = fopen(optarg, "w");
+            if (trace == NULL) {
+                fprintf(stderr, "fswbench: %s: %s\n", optarg, strerror(errno));
+                return 1;
+            }
+        } else if (opt == 'R') {
+            iotrace = fopen(optarg, "wb");
+            if (iotrace == NULL || !fsw_posix_set_iotrace(iotrace)) {
+                fprintf(stderr, "fswbench: %s: %s\n", optarg, strerror(errno));
+                return 1;
+            }
+        } else {
+            usage();
+            return 1;
+        }
+    }
+    if (argc - optind < 2 || argc - optind > 3) {
+        usage();
+        return 1;
+    }
+    if (devsim)
+        fsw_posix_set_devsim(&devsim_config, trace);
+    bench_image = argv[optind];
+    cmd = argv[optind + 1];
+    path = argc - optind > 2 ? argv[optind + 2] : NULL;
+
+    paths = calloc(BENCH_MAX_PATHS, sizeof(struct bench_path));
+    if (paths == NULL)
+        return 1;
+
+    if (strcmp(cmd, "mount") == 0) {
+        err = bench_mount_cmd(0);
+    } else if (strcmp(cmd, "remount") == 0) {
+        err = bench_mount_cmd(1);
+    } else if (strcmp(cmd, "walk") == 0) {
+        err = bench_walk(1);
+    } else if (strcmp(cmd, "lookup") == 0) {
+        err = bench_lookup();
+    } else if (strcmp(cmd, "seqread") == 0) {
+        err = bench_seqread(path);
+    } else if (strcmp(cmd, "randread") == 0) {
+        err = bench_randread(path);
+    } else if (strcmp(cmd, "ls") == 0) {
+        err = bench_ls();
+    } else if (strcmp(cmd, "cat") == 0) {
+        err = bench_cat(path);
+    } else if (strcmp(cmd, "all") == 0) {
+        err = bench_mount_cmd(0) || bench_mount_cmd(1) || bench_walk(1) || bench_lookup() ||
+              bench_seqread(NULL) || bench_randread(NULL);
+    } else {
+        usage();
+        err = 1;
+    }
+
+    bench_free_paths();
+    free(paths);
+    if (trace != NULL)
+        fclose(trace);
+    if (iotrace != NULL)
+        fclose(iotrace);
+    return err;
+}
+
+// EOF
@@ -0,0 +1,346 @@
+/**
+ * \file fswreplay.c
+ * Replays an I/O trace (see fsw_trace.h) against a simulated device.
+ */
+
+/*
+ * This program is licensed under the terms of the GNU GPL, version 3,
+ * or (at your option) any later version.
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "fsw_devsim.h"
+#include "fsw_trace.h"
+
+
+#define REPLAY_MAX_VOLUMES  (256)
+#define REPLAY_MAX_WINDOWS  (4096)
+#define REPLAY_RECORD_TYPES (FSW_TRACE_CLEAR + 1)
+
+/**
+ * One window of the modelled host read cache. This follows the read cache of the
+ * EFI host: windows are aligned to their size, a window at the end of the disk only
+ * covers the part up to the end, and each set replaces its least recently used way.
+ */
+
+struct replay_window {
+    fsw_u64     start;              //!< Disk offset of the window
+    fsw_u64     size;               //!< Valid bytes in the window, 0 if unused
+    fsw_u64     last_use;           //!< Cache clock at the last use
+};
+
+/**
+ * State and counters of one traced volume.
+ */
+
+struct replay_volume {
+    int         seen;               //!< Set once the volume has a record
+    fsw_u64     disk_size;          //!< Device size from the mount record, 0 if unknown
+    struct fsw_devsim sim;          //!< Simulated device of the volume
+    struct replay_window *cache;    //!< Modelled read cache, sets * ways windows
+    fsw_u64     clock;              //!< Use counter for LRU replacement
+
+    fsw_u64     records[REPLAY_RECORD_TYPES];   //!< Records by FSW_TRACE_* type
+    fsw_u64     bytes;              //!< Bytes requested by the driver
+    fsw_u64     hits;               //!< read_block requests served by the modelled cache
+    fsw_u64     misses;             //!< read_block requests that loaded a window
+    fsw_u64     recorded_hits;      //!< Hits the host saw when recording
+    fsw_u64     recorded_misses;    //!< Misses the host saw when recording
+    fsw_u64     differ;             //!< Requests whose modelled outcome differs from the recorded one
+};
+
+static struct replay_volume volumes[REPLAY_MAX_VOLUMES];
+
+static fsw_u32  window_shift;       // 0: no read cache
+static fsw_u32  cache_sets;
+static fsw_u32  cache_ways;
+static int      same_cache;         // the model uses the recorded cache geometry
+
+/**
+ * Parse a cache geometry: "none", or window size (k/m suffix, power of 2), sets and
+ * ways separated by commas, e.g. "128k,4,2". Returns 0 if it's invalid.
+ */
+
+static int replay_parse_cache(const char *spec)
+{
+    char        *end;
+    fsw_u64     size;
+
+    if (strcmp(spec, "none") == 0) {
+        window_shift = 0;
+        return 1;
+    }
+    size = strtoull(spec, &end, 10);
+    if (*end == 'k' || *end == 'K') {
+        size *= 1024;
+        end++;
+    } else if (*end == 'm' || *end == 'M') {
+        size *= 1024 * 1024;
+        end++;
+    }
+    if (size < 512 || (size & (size - 1)) != 0 || *end != ',')
+        return 0;
+    for (window_shift = 0; ((fsw_u64)1 << window_shift) < size; window_shift++)
+        ;
+    cache_sets = (fsw_u32)strtoul(end + 1, &end, 10);
+    if (*end != ',')
+        return 0;
+    cache_ways = (fsw_u32)strtoul(end + 1, &end, 10);
+    return *end == 0 && cache_sets > 0 && (cache_sets & (cache_sets - 1)) == 0 && cache_ways > 0 &&
+           cache_sets * cache_ways <= REPLAY_MAX_WINDOWS;
+}
+
+/**
+ * Replay a read_block request through the modelled read cache: a hit costs nothing,
+ * a miss reads the whole window from the device. Returns FSW_TRACE_HIT or
+ * FSW_TRACE_MISS.
+ */
+
+static int replay_cached_read(struct replay_volume *rv, fsw_u64 offset, fsw_u64 length)
+{
+    fsw_u64     window_size = (fsw_u64)1 << window_shift;
+    fsw_u64     window_start = offset & ~(window_size - 1);
+    struct replay_window *set, *window;
+    fsw_u32     i;
+
+    set = &rv->cache[((offset >> window_shift) & (cache_sets - 1)) * cache_ways];
+    for (i = 0; i < cache_ways; i++) {
+        if (set[i].size > 0 && set[i].start == window_start && offset + length <= window_start + set[i].size) {
+            set[i].last_use = ++rv->clock;
+            return FSW_TRACE_HIT;
+        }
+    }
+
+    window = &set[0];
+    for (i = 1; i < cache_ways; i++) {
+        if (set[i].last_use < window->last_use)
+            window = &set[i];
+    }
+    window->start = window_start;
+    window->size = window_size;
+    if (rv->disk_size > window_start && rv->disk_size - window_start < window_size)
+        window->size = rv->disk_size - window_start;
+    window->last_use = ++rv->clock;
+    fsw_devsim_request(&rv->sim, window->start, window->size);
+    if (offset + length > window->start + window->size)    // the host then reads the block by itself
+        fsw_devsim_request(&rv->sim, offset, length);
+    return FSW_TRACE_MISS;
+}
+
+/**
+ * Replay one trace record.
+ */
+
+static void replay_record(const struct fsw_trace_record *rec, const struct fsw_devsim_config *config,
+                          FILE *devtrace)
+{
+    struct replay_volume *rv = &volumes[rec->volume];
+    fsw_u64     offset = rec->block << rec->block_shift;
+    fsw_u64     length = (fsw_u64)rec->count << rec->block_shift;
+    int         outcome;
+
+    if (!rv->seen) {
+        rv->seen = 1;
+        fsw_devsim_init(&rv->sim, config, devtrace);
+    }
+    if (rec->type < REPLAY_RECORD_TYPES)
+        rv->records[rec->type]++;
+
+    switch (rec->type) {
+        case FSW_TRACE_MOUNT:
+            rv->disk_size = offset;
+            break;
+
+        case FSW_TRACE_CLEAR:
+            if (rv->cache != NULL)
+                fsw_memzero(rv->cache, cache_sets * cache_ways * sizeof(struct replay_window));
+            rv->clock = 0;
+            break;
+
+        case FSW_TRACE_BLOCK:
+            rv->bytes += length;
+            if (rec->outcome == FSW_TRACE_HIT)
+                rv->recorded_hits++;
+            else if (rec->outcome == FSW_TRACE_MISS)
+                rv->recorded_misses++;
+            if (window_shift == 0) {
+                fsw_devsim_request(&rv->sim, offset, length);
+                break;
+            }
+            if (rv->cache == NULL) {
+                rv->cache = calloc(cache_sets * cache_ways, sizeof(struct replay_window));
+                if (rv->cache == NULL) {
+                    fprintf(stderr, "fswreplay: out of memory\n");
+                    exit(1);
+                }
+            }
+            outcome = replay_cached_read(rv, offset, length);
+            if (outcome == FSW_TRACE_HIT)
+                rv->hits++;
+            else
+                rv->misses++;
+            if (same_cache && rec->outcome != FSW_TRACE_UNCACHED && rec->outcome != outcome)
+                rv->differ++;
+            break;
+
+        case FSW_TRACE_BLOCKS:
+        case FSW_TRACE_ASYNC:
+            // runs bypass the cache; the device serves queued reads in order, one at a time
+            rv->bytes += length;
+            fsw_devsim_request(&rv->sim, offset, length);
+            break;
+    }
+}
+
+/**
+ * Print the counters of one volume, or the sums over all volumes.
+ */
+
+static void replay_report(const char *name, const struct replay_volume *rv)
+{
+    printf("%-8s %7llu reads %7llu runs %6llu async %8.1f MiB",
+           name, (unsigned long long)rv->records[FSW_TRACE_BLOCK], (unsigned long long)rv->records[FSW_TRACE_BLOCKS],
+           (unsigned long long)rv->records[FSW_TRACE_ASYNC], rv->bytes / (1024.0 * 1024));
+    if (window_shift > 0 && rv->hits + rv->misses > 0)
+        printf(", cache %.1f%% hits", 100.0 * rv->hits / (rv->hits + rv->misses));
+    if (rv->recorded_hits + rv->recorded_misses > 0)
+        printf(" (recorded %.1f%%)", 100.0 * rv->recorded_hits / (rv->recorded_hits + rv->recorded_misses));
+    printf(", sim %.3f ms in %llu requests, %llu seeks, %.1f MiB\n", rv->sim.time_ns / 1e6,
+           (unsigned long long)rv->sim.requests, (unsigned long long)rv->sim.seeks, rv->sim.bytes / (1024.0 * 1024));
+    if (rv->differ > 0)
+        printf("%-8s %llu reads had a different cache outcome than recorded\n", "",
+               (unsigned long long)rv->differ);
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "Usage: fswreplay [-d device] [-c cache] [-v volume] [-T trace] <iotrace>\n"
+            "Replays a binary I/O trace, recorded by a driver built with FSW_EFI_TRACE or by\n"
+            "fswbench -R, against a simulated device and prints the time it takes.\n"
+            "-d device model as for fswbench (default vbox).\n"
+            "-c read cache model for single-block reads: \"none\", or window size, sets\n"
+            "   and ways, e.g. \"128k,4,2\"; default the cache of the recording host.\n"
+            "-v replays only one volume (numbered in mount order from 0).\n"
+            "-T writes each simulated device request to a file: time offset size cost.\n");
+}
+
+int main(int argc, char **argv)
+{
+    struct fsw_devsim_config config;
+    struct fsw_trace_header header;
+    struct fsw_trace_record rec;
+    struct replay_volume total;
+    char        namebuf[16];
+    fsw_u8      *buf;
+    FILE        *in, *devtrace = NULL;
+    int         opt, i, only_volume = -1, cache_given = 0;
+    fsw_u64     n = 0;
+
+    fsw_devsim_parse(&config, "vbox");
+    while ((opt = getopt(argc, argv, "d:c:v:T:")) != -1) {
+        if (opt == 'd') {
+            if (!fsw_devsim_parse(&config, optarg)) {
+                fprintf(stderr, "fswreplay: invalid device specification %s\n", optarg);
+                return 1;
+            }
+        } else if (opt == 'c') {
+            if (!replay_parse_cache(optarg)) {
+                fprintf(stderr, "fswreplay: invalid cache specification %s\n", optarg);
+                return 1;
+            }
+            cache_given = 1;
+        } else if (opt == 'v') {
+            only_volume = atoi(optarg);
+        } else if (opt == 'T') {
+            devtrace = fopen(optarg, "w");
+            if (devtrace == NULL) {
+                fprintf(stderr, "fswreplay: %s: %s\n", optarg, strerror(errno));
+                return 1;
+            }
+        } else {
+            usage();
+            return 1;
+        }
+    }
+    if (argc - optind != 1) {
+        usage();
+        return 1;
+    }
+
+    in = fopen(argv[optind], "rb");
+    if (in == NULL) {
+        fprintf(stderr, "fswreplay: %s: %s\n", argv[optind], strerror(errno));
+        return 1;
+    }
+    if (fread(&header, sizeof(header), 1, in) != 1 ||
+        memcmp(header.magic, FSW_TRACE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != FSW_TRACE_VERSION || header.record_size < sizeof(struct fsw_trace_record)) {
+        fprintf(stderr, "fswreplay: %s: not an I/O trace of a known version\n", argv[optind]);
+        return 1;
+    }
+    if (!cache_given) {
+        window_shift = header.window_shift;
+        cache_sets = header.cache_sets;
+        cache_ways = header.cache_ways;
+        if (window_shift > 0 && (cache_sets == 0 || (cache_sets & (cache_sets - 1)) != 0 ||
+                                 cache_ways == 0 || cache_sets * cache_ways > REPLAY_MAX_WINDOWS))
+            window_shift = 0;
+    }
+    same_cache = header.window_shift > 0 && window_shift == header.window_shift &&
+                 cache_sets == header.cache_sets && cache_ways == header.cache_ways;
+
+    buf = malloc(header.record_size);
+    if (buf == NULL)
+        return 1;
+    while (fread(buf, header.record_size, 1, in) == 1) {
+        memcpy(&rec, buf, sizeof(rec));
+        n++;
+        if (only_volume >= 0 && rec.volume != only_volume)
+            continue;
+        replay_record(&rec, &config, devtrace);
+    }
+    free(buf);
+    fclose(in);
+
+    printf("trace %s: %.16s, %llu records", argv[optind], header.fstype[0] ? (char *)header.fstype : "unknown fs",
+           (unsigned long long)n);
+    if (window_shift > 0)
+        printf(", cache %u KiB x %u sets x %u ways%s\n", (1U << window_shift) / 1024, cache_sets, cache_ways,
+               same_cache ? " (as recorded)" : "");
+    else
+        printf(", no cache\n");
+
+    fsw_memzero(&total, sizeof(total));
+    for (i = 0; i < REPLAY_MAX_VOLUMES; i++) {
+        struct replay_volume *rv = &volumes[i];
+        int t;
+
+        if (!rv->seen)
+            continue;
+        snprintf(namebuf, sizeof(namebuf), "vol %d", i);
+        replay_report(namebuf, rv);
+
+        for (t = 0; t < REPLAY_RECORD_TYPES; t++)
+            total.records[t] += rv->records[t];
+        total.bytes += rv->bytes;
+        total.hits += rv->hits;
+        total.misses += rv->misses;
+        total.recorded_hits += rv->recorded_hits;
+        total.recorded_misses += rv->recorded_misses;
+        total.differ += rv->differ;
+        total.sim.time_ns += rv->sim.time_ns;
+        total.sim.requests += rv->sim.requests;
+        total.sim.seeks += rv->sim.seeks;
+        total.sim.bytes += rv->sim.bytes;
+        free(rv->cache);
+    }
+    replay_report("total", &total);
+
+    if (devtrace != NULL)
+        fclose(devtrace);
+    return 0;
+}
+
+// EOF
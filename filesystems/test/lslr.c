@@ -41,17 +41,6 @@
 #include "fsw_posix.h"
 
 
-//extern struct fsw_fstype_table FSW_FSTYPE_TABLE_NAME(ext2);
-//extern struct fsw_fstype_table FSW_FSTYPE_TABLE_NAME(reiserfs);
-extern struct fsw_fstype_table FSW_FSTYPE_TABLE_NAME(FSTYPE);
-
-static struct fsw_fstype_table *fstypes[] = {
-    //&FSW_FSTYPE_TABLE_NAME(ext2),
-    //&FSW_FSTYPE_TABLE_NAME(reiserfs),
-    &FSW_FSTYPE_TABLE_NAME(FSTYPE       ),
-    NULL
-};
-
 static int listdir(struct fsw_posix_volume *vol, char *path, int level)
 {
     struct fsw_posix_dir *dir;
@@ -108,28 +97,24 @@ static int catfile(struct fsw_posix_volume *vol, char *path)
 int main(int argc, char **argv)
 {
     struct fsw_posix_volume *vol;
-    int i;
 
     if (argc != 2) {
         fprintf(stderr, "Usage: lslr <file/device>\n");
         return 1;
     }
 
-    for (i = 0; fstypes[i]; i++) {
-        vol = fsw_posix_mount(argv[1], fstypes[i]);
-        if (vol != NULL) {
-            fprintf(stderr, "Mounted as '%s'.\n", fstypes[i]->name.data);
-            break;
-        }
-    }
+    vol = fsw_posix_mount(argv[1], NULL);
     if (vol == NULL) {
         fprintf(stderr, "Mounting failed.\n");
         return 1;
     }
+    fprintf(stderr, "Mounted as '%.*s'.\n", vol->vol->fstype_table->name.size,
+            (char *)vol->vol->fstype_table->name.data);
 
     listdir(vol, "/boot/", 0);
     catfile(vol, "/boot/testfile.txt");
 
+    fsw_posix_print_stats(vol, stderr);
     fsw_posix_unmount(vol);
 
     return 0;
@@ -38,12 +38,6 @@
 #include "fsw_posix.h"
 
 
-extern struct fsw_fstype_table FSW_FSTYPE_TABLE_NAME(reiserfs);
-extern struct fsw_fstype_table FSW_FSTYPE_TABLE_NAME(iso9660);
-extern struct fsw_fstype_table FSW_FSTYPE_TABLE_NAME(hfs);
-extern struct fsw_fstype_table FSW_FSTYPE_TABLE_NAME(ext2);
-extern struct fsw_fstype_table FSW_FSTYPE_TABLE_NAME(ext4);
-
 int main(int argc, char **argv)
 {
     struct fsw_posix_volume *vol;
@@ -55,9 +49,7 @@ int main(int argc, char **argv)
         return 1;
     }
 
-    //vol = fsw_posix_mount(argv[1], &FSW_FSTYPE_TABLE_NAME(ext2));
-    //vol = fsw_posix_mount(argv[1], &FSW_FSTYPE_TABLE_NAME(reiserfs));
-    vol = fsw_posix_mount(argv[1], &FSW_FSTYPE_TABLE_NAME(FSTYPE));
+    vol = fsw_posix_mount(argv[1], NULL);
     if (vol == NULL) {
         fprintf(stderr, "Mounting failed.\n");
         return 1;
@@ -0,0 +1,36 @@
+/*
+ * include/fsw_dir_info.h
+ *
+ * Vendor file information type understood by directory handles of the rEFInd
+ * filesystem drivers. It lets a program list a directory by name and type
+ * first and fetch the full EFI_FILE_INFO only for the entries it keeps, which
+ * saves reading an inode for every entry.
+ *
+ * SetInfo() with this type and a BOOLEAN switches the handle's Read() between
+ * the normal mode (FALSE) and the "names only" mode (TRUE). In names only mode,
+ * Read() returns EFI_FILE_INFO records with just Size, FileName and the
+ * EFI_FILE_DIRECTORY attribute filled in; the other fields are zero. Entries
+ * whose type isn't known without reading the inode are returned complete.
+ *
+ * GetInfo() with this type returns the complete EFI_FILE_INFO of the entry
+ * most recently returned by Read() on the handle, or EFI_NOT_FOUND if there
+ * is none.
+ *
+ */
+/*
+ * This program is licensed under the terms of the GNU GPL, version 3,
+ * or (at your option) any later version.
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FSW_DIR_INFO_H_
+#define __FSW_DIR_INFO_H_
+
+// {1891DA51-FCCF-4978-8F1F-EDD1592D2D7A}
+#define FSW_DIR_ENTRY_INFO_ID \
+  { \
+    0x1891da51, 0xfccf, 0x4978, { 0x8f, 0x1f, 0xed, 0xd1, 0x59, 0x2d, 0x2d, 0x7a } \
+  }
+
+#endif
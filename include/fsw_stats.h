@@ -0,0 +1,60 @@
+/*
+ * include/fsw_stats.h
+ *
+ * Vendor protocol installed by the rEFInd filesystem drivers on the handle of
+ * each volume they mount, next to the Simple File System protocol. It gives
+ * rEFInd (or any other program) access to the driver's cache and I/O counters.
+ *
+ */
+/*
+ * This program is licensed under the terms of the GNU GPL, version 3,
+ * or (at your option) any later version.
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FSW_STATS_H_
+#define __FSW_STATS_H_
+
+// {6A0D3F52-8E2B-4C71-9B0E-5D4C1A7F2E93}
+#define FSW_VOLUME_STATS_PROTOCOL_GUID \
+  { \
+    0x6a0d3f52, 0x8e2b, 0x4c71, { 0x9b, 0x0e, 0x5d, 0x4c, 0x1a, 0x7f, 0x2e, 0x93 } \
+  }
+
+#define FSW_VOLUME_STATS_PROTOCOL_REVISION  0x00010000
+
+// Number of block cache levels with their own eviction counter
+#define FSW_VOLUME_STATS_LEVELS             6
+
+typedef struct {
+    UINT64   BcacheLookups;                 // Block cache lookups
+    UINT64   BcacheHits;                    // Blocks found in the block cache
+    UINT64   BcacheMisses;                  // Blocks read from the device into the cache
+    UINT64   BcacheEvictions[FSW_VOLUME_STATS_LEVELS];  // Cached blocks discarded, per level
+    UINT64   DeviceCalls;                   // Read requests passed to the disk layer
+    UINT64   BytesRead;                     // Bytes requested from the disk layer
+    UINT64   ReadTicks;                     // Time spent reading; CPU cycles on x86, else 0
+    UINT64   HostCacheHits;                 // Reads served from the driver's disk read cache
+    UINT64   HostCacheMisses;               // Reads that refilled the disk read cache
+    UINT64   DriverCacheHits;               // Hits in filesystem-specific caches
+    UINT64   DriverCacheMisses;             // Misses in filesystem-specific caches
+} FSW_VOLUME_STATS;
+
+typedef struct _FSW_VOLUME_STATS_PROTOCOL FSW_VOLUME_STATS_PROTOCOL;
+
+// Copy the current counters of the volume into *Stats.
+typedef
+EFI_STATUS
+(EFIAPI *FSW_VOLUME_STATS_GET) (
+    IN  FSW_VOLUME_STATS_PROTOCOL   *This,
+    OUT FSW_VOLUME_STATS            *Stats
+);
+
+struct _FSW_VOLUME_STATS_PROTOCOL {
+    UINT64                  Revision;
+    CHAR16                  *DriverName;    // Name of the driver that mounted the volume
+    FSW_VOLUME_STATS_GET    GetStats;
+};
+
+#endif
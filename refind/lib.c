@@ -62,6 +62,7 @@
 #include "screen.h"
 #include "../include/refit_call_wrapper.h"
 #include "../include/RemovableMedia.h"
+#include "../include/fsw_dir_info.h"
 #include "gpt.h"
 #include "config.h"
 #include "driver_support.h"
@@ -1520,6 +1521,47 @@ VOID DirIterOpen(IN EFI_FILE_PROTOCOL *BaseDir, IN CHAR16 *RelativePath OPTIONAL
         DirIter->CloseDirHandle = EFI_ERROR(DirIter->LastStatus) ? FALSE : TRUE;
     }
     DirIter->LastFileInfo = NULL;
+    DirIter->LazyInfo = FALSE;
+    DirIter->FullInfo = FALSE;
+    if (DirIter->CloseDirHandle) {
+        // Our own handle, so ask the driver (if it's one of ours) to skip the
+        // inode reads for entries we'd filter out anyway.
+        EFI_GUID DirEntryInfoGuid = FSW_DIR_ENTRY_INFO_ID;
+        BOOLEAN  NamesOnly = TRUE;
+
+        if (refit_call4_wrapper(DirIter->DirHandle->SetInfo, DirIter->DirHandle, &DirEntryInfoGuid,
+                                sizeof(BOOLEAN), &NamesOnly) == EFI_SUCCESS)
+            DirIter->LazyInfo = TRUE;
+    }
+}
+
+// Replace a names-only DirEntry returned by a driver in names-only mode with
+// the complete information on the same entry.
+static EFI_STATUS DirEntryFullInfo(IN EFI_FILE_PROTOCOL *Directory, IN OUT EFI_FILE_INFO **DirEntry)
+{
+    EFI_STATUS    Status;
+    EFI_GUID      DirEntryInfoGuid = FSW_DIR_ENTRY_INFO_ID;
+    VOID          *Buffer;
+    UINTN         BufferSize = 256;
+
+    Buffer = AllocatePool(BufferSize);
+    if (Buffer == NULL)
+        return EFI_OUT_OF_RESOURCES;
+    Status = refit_call4_wrapper(Directory->GetInfo, Directory, &DirEntryInfoGuid, &BufferSize, Buffer);
+    if (Status == EFI_BUFFER_TOO_SMALL) {
+        MyFreePool(Buffer);
+        Buffer = AllocatePool(BufferSize);
+        if (Buffer == NULL)
+            return EFI_OUT_OF_RESOURCES;
+        Status = refit_call4_wrapper(Directory->GetInfo, Directory, &DirEntryInfoGuid, &BufferSize, Buffer);
+    }
+    if (EFI_ERROR(Status)) {
+        MyFreePool(Buffer);
+        return Status;
+    }
+    MyFreePool(*DirEntry);
+    *DirEntry = (EFI_FILE_INFO *)Buffer;
+    return EFI_SUCCESS;
 }
 
 #ifndef __MAKEWITH_GNUEFI
@@ -1565,9 +1607,10 @@ MetaiMatch (IN CHAR16 *String, IN CHAR16 *Pattern)
 BOOLEAN DirIterNext(IN OUT REFIT_DIR_ITER *DirIter, IN UINTN FilterMode, IN CHAR16 *FilePattern OPTIONAL,
                     OUT EFI_FILE_INFO **DirEntry)
 {
-    BOOLEAN KeepGoing = TRUE;
-    UINTN   i;
-    CHAR16  *OnePattern;
+    BOOLEAN    KeepGoing = TRUE;
+    UINTN      i;
+    CHAR16     *OnePattern;
+    EFI_STATUS Status;
 
     if (DirIter->LastFileInfo != NULL) {
         // NOTE: rEFIt and rEFInd through 0.13.3 called
@@ -1579,13 +1622,14 @@ BOOLEAN DirIterNext(IN OUT REFIT_DIR_ITER *DirIter, IN UINTN FilterMode, IN CHAR
     if (EFI_ERROR(DirIter->LastStatus))
         return FALSE;   // stop iteration
 
-    do {
+    for (;;) {
         DirIter->LastStatus = DirNextEntry(DirIter->DirHandle, &(DirIter->LastFileInfo), FilterMode);
         if (EFI_ERROR(DirIter->LastStatus))
            return FALSE;
         if (DirIter->LastFileInfo == NULL)  // end of listing
             return FALSE;
         if (FilePattern != NULL) {
+            KeepGoing = TRUE;
             if ((DirIter->LastFileInfo->Attribute & EFI_FILE_DIRECTORY))
                 KeepGoing = FALSE;
             i = 0;
@@ -1594,10 +1638,24 @@ BOOLEAN DirIterNext(IN OUT REFIT_DIR_ITER *DirIter, IN UINTN FilterMode, IN CHAR
                    KeepGoing = FALSE;
                MyFreePool(OnePattern);
             } // while
-            // else continue loop
-        } else
-            break;
-   } while (KeepGoing && FilePattern);
+            if (KeepGoing)
+                continue;   // no match; try the next entry
+        }
+
+        if (DirIter->LazyInfo && DirIter->FullInfo) {
+            // The names-only entry has no sizes or times, so skip an entry whose
+            // complete information can't be had (e.g., a damaged inode); only
+            // running out of memory ends the iteration.
+            Status = DirEntryFullInfo(DirIter->DirHandle, &(DirIter->LastFileInfo));
+            if (Status == EFI_OUT_OF_RESOURCES) {
+                DirIter->LastStatus = Status;
+                return FALSE;
+            }
+            if (EFI_ERROR(Status))
+                continue;
+        }
+        break;
+    } // for
 
     *DirEntry = DirIter->LastFileInfo;
     return TRUE;
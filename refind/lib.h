@@ -68,6 +68,8 @@ typedef struct {
     EFI_FILE_HANDLE     DirHandle;
     BOOLEAN             CloseDirHandle;
     EFI_FILE_INFO       *LastFileInfo;
+    BOOLEAN             LazyInfo;       // Read() returns names only; see ../include/fsw_dir_info.h
+    BOOLEAN             FullInfo;       // caller needs sizes and times; set after DirIterOpen()
 } REFIT_DIR_ITER;
 
 #define DISK_KIND_INTERNAL  (0)
@@ -20,6 +20,7 @@
 #include "lib.h"
 #include "mystrings.h"
 #include "../include/refit_call_wrapper.h"
+#include "../include/fsw_stats.h"
 #include "screen.h"
 #include "menu.h"
 
@@ -184,3 +185,53 @@ VOID WriteToLog(CHAR16 **Message, UINTN LogLineType) {
         *Message = NULL;
     }
 } // VOID WriteToLog()
+
+// Write the cache and I/O counters of all volumes mounted by rEFInd's own
+// filesystem drivers to the log. Volumes mounted by other drivers (such as
+// the firmware's FAT driver) don't publish these counters and are skipped.
+VOID LogDriverStats(VOID) {
+    EFI_STATUS                Status;
+    EFI_GUID                  StatsGuid = FSW_VOLUME_STATS_PROTOCOL_GUID;
+    EFI_HANDLE                *Handles = NULL;
+    UINTN                     HandleCount = 0, i, j;
+    FSW_VOLUME_STATS_PROTOCOL *StatsProtocol;
+    FSW_VOLUME_STATS          Stats;
+    CHAR16                    *VolName;
+
+    if (!gLogActive || GlobalConfig.LogLevel < 1)
+        return;
+
+    Status = refit_call5_wrapper(gBS->LocateHandleBuffer, ByProtocol, &StatsGuid, NULL,
+                                 &HandleCount, &Handles);
+    if (EFI_ERROR(Status))
+        return; // none of our drivers has mounted anything
+
+    LOG(1, LOG_LINE_THIN_SEP, L"Filesystem driver statistics");
+    for (i = 0; i < HandleCount; i++) {
+        Status = refit_call3_wrapper(gBS->HandleProtocol, Handles[i], &StatsGuid,
+                                     (VOID **) &StatsProtocol);
+        if (EFI_ERROR(Status))
+            continue;
+        Status = refit_call2_wrapper(StatsProtocol->GetStats, StatsProtocol, &Stats);
+        if (EFI_ERROR(Status))
+            continue;
+
+        VolName = L"unknown volume";
+        for (j = 0; j < VolumesCount; j++) {
+            if (Volumes[j]->DeviceHandle == Handles[i] && Volumes[j]->VolName)
+                VolName = Volumes[j]->VolName;
+        }
+        LOG(1, LOG_LINE_NORMAL, L"%s on '%s':", StatsProtocol->DriverName, VolName);
+        LOG(1, LOG_LINE_NORMAL, L"  block cache: %ld lookups, %ld hits, %ld misses",
+            Stats.BcacheLookups, Stats.BcacheHits, Stats.BcacheMisses);
+        LOG(1, LOG_LINE_NORMAL, L"  evictions by level: %ld %ld %ld %ld %ld %ld",
+            Stats.BcacheEvictions[0], Stats.BcacheEvictions[1], Stats.BcacheEvictions[2],
+            Stats.BcacheEvictions[3], Stats.BcacheEvictions[4], Stats.BcacheEvictions[5]);
+        LOG(1, LOG_LINE_NORMAL, L"  disk reads: %ld calls, %ld bytes, %ld ticks",
+            Stats.DeviceCalls, Stats.BytesRead, Stats.ReadTicks);
+        LOG(1, LOG_LINE_NORMAL, L"  read cache: %ld hits, %ld misses; driver caches: %ld hits, %ld misses",
+            Stats.HostCacheHits, Stats.HostCacheMisses,
+            Stats.DriverCacheHits, Stats.DriverCacheMisses);
+    } // for
+    MyFreePool(Handles);
+} // VOID LogDriverStats()
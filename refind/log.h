@@ -44,5 +44,6 @@ extern CHAR16           *gLogTemp;
 EFI_STATUS StartLogging(BOOLEAN Restart);
 VOID StopLogging(VOID);
 VOID WriteToLog(CHAR16 **Message, UINTN LogLineType);
+VOID LogDriverStats(VOID);
 
 #endif
@@ -250,6 +250,7 @@ VOID RescanAll(BOOLEAN DisplayMessage, BOOLEAN Reconnect) {
     SetVolumeIcons();
     ScanForBootloaders(DisplayMessage);
     ScanForTools();
+    LogDriverStats();
 } // VOID RescanAll()
 
 #ifdef __MAKEWITH_TIANO
@@ -525,6 +526,7 @@ efi_main (EFI_HANDLE ImageHandle, EFI_SYSTEM_TABLE *SystemTable)
     SetVolumeIcons();
     ScanForBootloaders(FALSE);
     ScanForTools();
+    LogDriverStats();
 
     // SetupScreen() clears the screen; but ScanForBootloaders() may display a
     // message that must be deleted, so do so